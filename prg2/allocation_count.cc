@@ -0,0 +1,152 @@
+// Allocation_count.cc
+
+#include "allocation_count.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// The replacements are in their own translation unit, so that the compiler does not see them paired
+// with the other code. The counter is atomic because the batch queries allocate from several threads.
+std::atomic<unsigned long long> allocation_counter(0);
+
+unsigned long long allocation_count()
+{
+    return allocation_counter.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_counter.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+    allocation_counter.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, std::nothrow_t const& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+// Over-aligned types (alignas larger than the one of malloc) come here instead
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocation_counter.fetch_add(1, std::memory_order_relaxed);
+    auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants the size as a multiple of the alignment
+    size = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+#ifdef _WIN32
+    void* memory = _aligned_malloc(size, align);
+#else
+    void* memory = std::aligned_alloc(align, size);
+#endif
+    if (memory)
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    try
+    {
+        return operator new(size, alignment);
+    }
+    catch (std::bad_alloc const&)
+    {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const& tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::nothrow_t const&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::nothrow_t const&) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void operator delete[](void* memory, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void operator delete(void* memory, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    operator delete(memory, alignment);
+}
+
+void operator delete[](void* memory, std::align_val_t alignment, std::nothrow_t const&) noexcept
+{
+    operator delete(memory, alignment);
+}
@@ -0,0 +1,11 @@
+// Allocation_count.hh
+
+#ifndef ALLOCATION_COUNT_HH
+#define ALLOCATION_COUNT_HH
+
+// Amount of calls to the global operator new (and new[]) since the program started, from all threads,
+// including the nothrow and over-aligned (std::align_val_t) forms.
+// Used by perftest to report the allocations made for each N.
+unsigned long long allocation_count();
+
+#endif // ALLOCATION_COUNT_HH
@@ -0,0 +1,46 @@
+#-------------------------------------------------
+#
+# Headless micro-benchmark of the Datastructures operations.
+# Builds only ../datastructures.cc and benchmark.cc, without Qt, MainProgram or MainWindow:
+#   qmake bench.pro && make && ./bench --sizes 1000,10000,100000 --repeat 1000
+#
+#-------------------------------------------------
+
+# Uncomment the line below for link-time optimization
+#CONFIG += ltcg
+
+# Profile-guided optimization: build with the first line uncommented, run the benchmark (it writes the .gcda
+# profiles next to the object files), then rebuild EVERYTHING with the second line uncommented instead
+#CONFIG += pgo_generate
+#CONFIG += pgo_use
+
+TEMPLATE = app
+TARGET = bench
+
+CONFIG -= qt app_bundle
+CONFIG += console c++17 warn_on release thread
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+pgo_generate {
+    QMAKE_CXXFLAGS += -fprofile-generate
+    QMAKE_LFLAGS += -fprofile-generate
+}
+pgo_use {
+    QMAKE_CXXFLAGS += -fprofile-use -fprofile-correction
+    QMAKE_LFLAGS += -fprofile-use
+}
+
+INCLUDEPATH += ..
+
+SOURCES += \
+    ../datastructures.cc \
+    benchmark.cc
+
+HEADERS += \
+    ../datastructures.hh \
+    ../flat_hash_map.hh \
+    ../thread_pool.hh \
+    ../random_data.hh \
+    ../stats.hh
@@ -0,0 +1,285 @@
+// Benchmark.cc
+//
+// Headless micro-benchmark of the Datastructures operations, built by bench.pro without Qt or MainProgram.
+// For every N the data is generated by the same Random_data (random_data.hh) that perftest uses:
+// N places with an area for every 10 places linked into a binary tree, and N ways between
+// pseudo-random crossroads. Every operation is then timed on its own freshly generated data, so that the
+// operations that change the data do not affect the others, and the same seed always gives the same data
+// and the same calls.
+//
+// Usage: bench [--sizes n1,n2,...] [--repeat count] [--seed seed] [--ops op1,op2,...] [--threads count] [--csv]
+
+#include "datastructures.hh"
+#include "random_data.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Synthetic data and the random parameters of the calls for one run of one operation. The data comes from the
+// same Random_data generators that MainProgram uses.
+struct Bench_state : Random_data {
+    Datastructures& ds;
+    unsigned long int extra_added = 0;
+
+    Bench_state(Datastructures& ds, unsigned int seed):
+        Random_data(seed),
+        ds(ds)
+    {
+        init_primes();
+    }
+
+    void add_places_areas(unsigned int count) { Random_data::add_places_areas(ds, count); }
+    void add_ways(unsigned int count) { Random_data::add_ways(ds, count); }
+
+    PlaceID random_place() { return n_to_placeid(random<unsigned long int>(0, std::max(1ul, places_added))); }
+    AreaID random_area() { return n_to_areaid(random<unsigned long int>(0, std::max(1ul, areas_added))); }
+    WayID random_way() { return n_to_wayid(random<unsigned long int>(1, ways_added + 1)); }
+    Coord random_crossroad() { return n_to_coord(random<unsigned long int>(0, std::max(1ul, ways_added))); }
+    Coord random_coord() { return {random<int>(1, 10000), random<int>(1, 10000)}; }
+    PlaceType random_type() { return PlaceType{random(0, static_cast<int>(PlaceType::NO_TYPE) + 1)}; }
+    // Part of the name of a random place, from the given position
+    Name random_name_part(std::size_t from, std::size_t length)
+    {
+        Name name = n_to_name(random<unsigned long int>(0, std::max(1ul, places_added)));
+        return name.substr(std::min(from, name.size()), length);
+    }
+    // Ids of the places and ways added during the benchmark, after the generated ones
+    unsigned long int next_extra() { return places_added + 1000000 + extra_added++; }
+};
+
+struct Operation {
+    std::string name;
+    std::function<void(Bench_state&)> call;
+};
+
+std::string const SNAPSHOT_FILE = "bench-snapshot.tmp";
+
+// One random call of every public operation, with the same kind of parameters as the test functions of perftest
+std::vector<Operation> const OPERATIONS = {
+    {"place_count", [](Bench_state& s) { s.ds.place_count(); }},
+    {"all_places", [](Bench_state& s) { s.ds.all_places(); }},
+    {"add_place", [](Bench_state& s) {
+         auto n = s.next_extra();
+         s.ds.add_place(s.n_to_placeid(n), s.n_to_name(n), s.random_type(), s.random_coord());
+     }},
+    {"get_place_name_type", [](Bench_state& s) { s.ds.get_place_name_type(s.random_place()); }},
+    {"get_place_coord", [](Bench_state& s) { s.ds.get_place_coord(s.random_place()); }},
+    {"places_alphabetically", [](Bench_state& s) { s.ds.places_alphabetically(); }},
+    {"places_coord_order", [](Bench_state& s) { s.ds.places_coord_order(); }},
+    {"visit_places_alphabetically", [](Bench_state& s) {
+         s.ds.visit_places_alphabetically([](PlaceID) { return true; }, s.random<std::size_t>(0, s.ds.place_count() + 1), 100);
+     }},
+    {"find_places_name", [](Bench_state& s) { s.ds.find_places_name(s.random_name_part(0, Name::npos)); }},
+    {"find_places_type", [](Bench_state& s) { s.ds.find_places_type(s.random_type()); }},
+    {"find_places_name_prefix", [](Bench_state& s) { s.ds.find_places_name_prefix(s.random_name_part(0, 2), 10); }},
+    {"find_places_name_substring", [](Bench_state& s) { s.ds.find_places_name_substring(s.random_name_part(1, 3), 10); }},
+    {"change_place_name", [](Bench_state& s) { s.ds.change_place_name(s.random_place(), s.random_name_part(0, Name::npos)); }},
+    {"change_place_coord", [](Bench_state& s) { s.ds.change_place_coord(s.random_place(), s.random_coord()); }},
+    {"add_area", [](Bench_state& s) {
+         auto n = s.next_extra();
+         s.ds.add_area(s.n_to_areaid(n), s.n_to_name(n), {s.random_coord(), s.random_coord(), s.random_coord()});
+     }},
+    {"get_area_name", [](Bench_state& s) { s.ds.get_area_name(s.random_area()); }},
+    {"get_area_coords", [](Bench_state& s) { s.ds.get_area_coords(s.random_area()); }},
+    {"all_areas", [](Bench_state& s) { s.ds.all_areas(); }},
+    {"subarea_in_areas", [](Bench_state& s) { s.ds.subarea_in_areas(s.random_area()); }},
+    {"all_subareas_in_area", [](Bench_state& s) { s.ds.all_subareas_in_area(s.random_area()); }},
+    {"common_area_of_subareas", [](Bench_state& s) { s.ds.common_area_of_subareas(s.random_area(), s.random_area()); }},
+    {"places_closest_to", [](Bench_state& s) { s.ds.places_closest_to(s.random_coord(), s.random_type()); }},
+    {"places_k_nearest", [](Bench_state& s) { s.ds.places_k_nearest(s.random_coord(), s.random_type(), 10); }},
+    {"places_within_radius", [](Bench_state& s) { s.ds.places_within_radius(s.random_coord(), s.random_type(), 100); }},
+    {"places_in_rect", [](Bench_state& s) {
+         Coord corner = s.random_coord();
+         s.ds.places_in_rect(corner, {corner.x + 1000, corner.y + 1000});
+     }},
+    {"remove_place", [](Bench_state& s) { s.ds.remove_place(s.random_place()); }},
+    {"all_ways", [](Bench_state& s) { s.ds.all_ways(); }},
+    {"add_way", [](Bench_state& s) {
+         s.ds.add_way(s.n_to_wayid(s.next_extra()), {s.random_crossroad(), s.random_crossroad()});
+     }},
+    {"ways_from", [](Bench_state& s) { s.ds.ways_from(s.random_crossroad()); }},
+    {"get_way_coords", [](Bench_state& s) { s.ds.get_way_coords(s.random_way()); }},
+    {"ways_in_rect", [](Bench_state& s) {
+         Coord corner = s.random_crossroad();
+         s.ds.ways_in_rect(corner, {corner.x + 100, corner.y + 100});
+     }},
+    {"remove_way", [](Bench_state& s) { s.ds.remove_way(s.random_way()); }},
+    {"route_any", [](Bench_state& s) { s.ds.route_any(s.random_crossroad(), s.random_crossroad()); }},
+    {"route_least_crossroads", [](Bench_state& s) { s.ds.route_least_crossroads(s.random_crossroad(), s.random_crossroad()); }},
+    {"route_shortest_distance", [](Bench_state& s) { s.ds.route_shortest_distance(s.random_crossroad(), s.random_crossroad()); }},
+    {"route_with_cycle", [](Bench_state& s) { s.ds.route_with_cycle(s.random_crossroad()); }},
+    {"trim_ways", [](Bench_state& s) { s.ds.trim_ways(); }},
+    {"publish_snapshot", [](Bench_state& s) {
+         s.ds.change_place_coord(s.random_place(), s.random_coord());
+         s.ds.publish_snapshot();
+     }},
+    {"route_many", [](Bench_state& s) {
+         std::vector<std::pair<Coord, Coord>> queries;
+         for (int i = 0; i < 100; ++i) {
+             queries.emplace_back(s.random_crossroad(), s.random_crossroad());
+         }
+         s.ds.route_many(queries);
+     }},
+    {"closest_many", [](Bench_state& s) {
+         std::vector<Coord> coords;
+         for (int i = 0; i < 100; ++i) {
+             coords.push_back(s.random_coord());
+         }
+         s.ds.closest_many(coords, s.random_type());
+     }},
+    {"route_distance_matrix", [](Bench_state& s) {
+         std::vector<Coord> sources;
+         std::vector<Coord> targets;
+         for (int i = 0; i < 10; ++i) {
+             sources.push_back(s.random_crossroad());
+             targets.push_back(s.random_crossroad());
+         }
+         s.ds.route_distance_matrix(sources, targets);
+     }},
+    {"save_snapshot", [](Bench_state& s) { s.ds.save_snapshot(SNAPSHOT_FILE); }},
+    {"load_snapshot", [](Bench_state& s) {
+         s.ds.save_snapshot(SNAPSHOT_FILE);
+         s.ds.load_snapshot(SNAPSHOT_FILE);
+     }},
+};
+
+struct Options {
+    std::vector<unsigned int> sizes = {1000, 10000, 100000};
+    unsigned int repeat = 1000;
+    unsigned int seed = 1;
+    unsigned int threads = 0;
+    std::vector<std::string> ops = {};
+    bool csv = false;
+};
+
+std::vector<std::string> split(std::string const& text)
+{
+    std::vector<std::string> parts;
+    std::istringstream input(text);
+    for (std::string part; std::getline(input, part, ','); ) {
+        if (!part.empty()) {
+            parts.push_back(part);
+        }
+    }
+    return parts;
+}
+
+bool parse_options(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--csv") {
+            options.csv = true;
+        } else if (arg == "--sizes" && has_value) {
+            options.sizes.clear();
+            for (auto const& size : split(argv[++i])) {
+                options.sizes.push_back(std::stoul(size));
+            }
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = std::stoul(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::stoul(argv[++i]);
+        } else if (arg == "--ops" && has_value) {
+            options.ops = split(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(std::vector<double> const& sorted, double fraction)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto rank = static_cast<std::size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--sizes n1,n2,...] [--repeat count] [--seed seed] [--ops op1,op2,...]"
+                  << " [--threads count] [--csv]" << std::endl << "Operations:";
+        for (auto const& operation : OPERATIONS) {
+            std::cerr << " " << operation.name;
+        }
+        std::cerr << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<Operation const*> selected;
+    for (auto const& operation : OPERATIONS) {
+        if (options.ops.empty() || std::find(options.ops.begin(), options.ops.end(), operation.name) != options.ops.end()) {
+            selected.push_back(&operation);
+        }
+    }
+
+    if (options.csv) {
+        std::cout << "n,operation,calls,load_sec,mean_sec,p50_sec,p99_sec,max_sec" << std::endl;
+    } else {
+        std::cout << std::left << std::setw(28) << "operation" << std::right << std::setw(9) << "N" << std::setw(8) << "calls"
+                  << std::setw(12) << "load (ms)" << std::setw(12) << "mean (us)" << std::setw(12) << "p50 (us)"
+                  << std::setw(12) << "p99 (us)" << std::setw(12) << "max (us)" << std::endl;
+    }
+
+    Datastructures ds;
+    ds.set_thread_count(options.threads);
+    for (unsigned int n : options.sizes) {
+        for (Operation const* operation : selected) {
+            ds.clear_all();
+            ds.clear_ways();
+            // The same data for every operation of this N
+            Bench_state state(ds, options.seed);
+            auto load_start = Clock::now();
+            ds.reserve(n, n);
+            state.add_places_areas(n);
+            state.add_ways(n);
+            ds.creation_finished();
+            double load_sec = std::chrono::duration<double>(Clock::now() - load_start).count();
+
+            std::vector<double> latencies;
+            latencies.reserve(options.repeat);
+            for (unsigned int i = 0; i < options.repeat; ++i) {
+                auto start = Clock::now();
+                operation->call(state);
+                latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+            }
+            double total = 0;
+            for (double latency : latencies) {
+                total += latency;
+            }
+            std::sort(latencies.begin(), latencies.end());
+            double mean = latencies.empty() ? 0 : total / latencies.size();
+            double max = latencies.empty() ? 0 : latencies.back();
+
+            if (options.csv) {
+                std::cout << n << "," << operation->name << "," << latencies.size() << "," << load_sec << "," << mean << ","
+                          << percentile(latencies, 0.5) << "," << percentile(latencies, 0.99) << "," << max << std::endl;
+            } else {
+                std::cout << std::left << std::setw(28) << operation->name << std::right << std::setw(9) << n
+                          << std::setw(8) << latencies.size() << std::fixed << std::setprecision(2)
+                          << std::setw(12) << load_sec * 1e3 << std::setw(12) << mean * 1e6
+                          << std::setw(12) << percentile(latencies, 0.5) * 1e6 << std::setw(12) << percentile(latencies, 0.99) * 1e6
+                          << std::setw(12) << max * 1e6 << std::defaultfloat << std::endl;
+            }
+        }
+    }
+    std::remove(SNAPSHOT_FILE.c_str());
+    return EXIT_SUCCESS;
+}
@@ -3,9 +3,152 @@
 #include "datastructures.hh"
 #include <cmath>
 #include <random>
+#include <queue>
+#include <numeric>
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SNAPSHOT_USE_MMAP
+#endif
 
 std::minstd_rand rand_engine; // Reasonably quick pseudo-random generator
 
+// Layout of the snapshot files, all values in native byte order:
+// magic, version, byte order mark,
+// places: count, then (id, type, x, y, name) for each,
+// areas: count, then (id, name, coordinate count, x, y...) for each,
+// subarea links: count, then (subarea id, parent id) in the order they have to be added,
+// ways: count, then (id, coordinate count, x, y...) in the order they were created.
+// Counts are 64-bit, text lengths 32-bit, ids 64-bit and coordinates and types 32-bit.
+char const SNAPSHOT_MAGIC[8] = {'D', 'S', 'S', 'N', 'A', 'P', '\0', '\0'};
+std::uint32_t const SNAPSHOT_VERSION = 1;
+std::uint32_t const SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+template <typename Type>
+void append_value(std::string& buffer, Type value)
+{
+    buffer.append(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+void append_text(std::string& buffer, std::string const& text)
+{
+    append_value<std::uint32_t>(buffer, text.size());
+    buffer.append(text);
+}
+
+void append_coords(std::string& buffer, Coord_span coords)
+{
+    append_value<std::uint64_t>(buffer, coords.size());
+    for (Coord xy : coords) {
+        append_value<std::int32_t>(buffer, xy.x);
+        append_value<std::int32_t>(buffer, xy.y);
+    }
+}
+
+// Reads values from a snapshot image. Reading past the end sets ok to false and returns zeroes.
+struct Snapshot_reader {
+    char const* position;
+    char const* end;
+    bool ok = true;
+
+    bool has(std::uint64_t bytes)
+    {
+        ok = ok && bytes <= static_cast<std::uint64_t>(end - position);
+        return ok;
+    }
+    template <typename Type>
+    Type value()
+    {
+        Type read = {};
+        if (has(sizeof(Type))) {
+            std::memcpy(&read, position, sizeof(Type));
+            position += sizeof(Type);
+        }
+        return read;
+    }
+    std::string text()
+    {
+        auto length = value<std::uint32_t>();
+        if (!has(length)) {
+            return {};
+        }
+        std::string read(position, length);
+        position += length;
+        return read;
+    }
+    std::vector<Coord> coords()
+    {
+        auto count = value<std::uint64_t>();
+        // Every coordinate takes 8 bytes. Dividing the rest instead of multiplying the count cannot wrap around,
+        // so a corrupted count fails here before it reaches the reserve.
+        ok = ok && count <= static_cast<std::uint64_t>(end - position) / 8;
+        if (!ok) {
+            return {};
+        }
+        std::vector<Coord> read = {};
+        read.reserve(count);
+        for (std::uint64_t i = 0; i != count; ++i) {
+            int x = value<std::int32_t>();
+            int y = value<std::int32_t>();
+            read.push_back({x, y});
+        }
+        return read;
+    }
+};
+
+// Read-only view of a whole file, memory-mapped where possible
+struct Mapped_file {
+    char const* data = nullptr;
+    std::size_t size = 0;
+
+    explicit Mapped_file(std::string const& filename)
+    {
+#ifdef SNAPSHOT_USE_MMAP
+        descriptor_ = open(filename.c_str(), O_RDONLY);
+        struct stat status;
+        if (descriptor_ == -1 || fstat(descriptor_, &status) != 0 || status.st_size <= 0) {
+            return;
+        }
+        void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor_, 0);
+        if (mapping == MAP_FAILED) {
+            return;
+        }
+        data = static_cast<char const*>(mapping);
+        size = status.st_size;
+#else
+        std::ifstream file(filename, std::ios::binary);
+        buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = buffer_.data();
+        size = buffer_.size();
+#endif
+    }
+    ~Mapped_file()
+    {
+#ifdef SNAPSHOT_USE_MMAP
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+        if (descriptor_ != -1) {
+            close(descriptor_);
+        }
+#endif
+    }
+    Mapped_file(Mapped_file const&) = delete;
+    Mapped_file& operator=(Mapped_file const&) = delete;
+
+private:
+#ifdef SNAPSHOT_USE_MMAP
+    int descriptor_ = -1;
+#else
+    std::vector<char> buffer_;
+#endif
+};
+
 template <typename Type>
 Type random_in_range(Type start, Type end)
 {
@@ -17,19 +160,65 @@ Type random_in_range(Type start, Type end)
     return static_cast<Type>(start+num);
 }
 
+// State of the route searches. Each thread has its own, so that the searches of several threads can run
+// at once on the same Route_graph, and it is kept between the searches to avoid reallocating it.
+Search_scratch& thread_search_scratch()
+{
+    thread_local Search_scratch scratch;
+    return scratch;
+}
+
+// Second state for the searches that go both ways, from the goal
+Search_scratch& thread_backward_search_scratch()
+{
+    thread_local Search_scratch scratch;
+    return scratch;
+}
+
+// Passes id_of(element) to visit for at most limit elements from the offset:th element of [first, last) on,
+// stopping early if visit returns false. Returns the amount of elements visited.
+template <typename Iterator, typename Visitor, typename Id_of>
+std::size_t visit_page(Iterator first, Iterator last, std::size_t offset, std::size_t limit,
+                       Visitor const& visit, Id_of id_of)
+{
+    for (; offset != 0 && first != last; --offset) {
+        ++first;
+    }
+    std::size_t visited = 0;
+    for (; first != last && visited != limit; ++first) {
+        ++visited;
+        if (!visit(id_of(*first))) {
+            break;
+        }
+    }
+    return visited;
+}
+
+// The same for a vector, which can skip the offset at once
+template <typename Id, typename Visitor>
+std::size_t visit_page(std::vector<Id> const& ids, std::size_t offset, std::size_t limit, Visitor const& visit)
+{
+    offset = std::min(offset, ids.size());
+    return visit_page(ids.begin() + offset, ids.end(), 0, limit, visit, [](Id const& id) -> Id const& { return id; });
+}
+
 Datastructures::Datastructures():
     coordinate_sorted_(false),
     alphabetical_sorted_(false),
     alphabetical_vector_ids_({}),
     coordinate_vector_ids_({}),
+    alphabetical_order_(Alphabetical_less{&place_names_}),
     places_by_id_({}),
     places_by_name_({}),
-    places_by_type_({}),
+    area_index_valid_(false),
     ways_by_id_({}),
     ways_by_coord_({}),
     visited_coordinates_({}),
-    chosen_route_({}),
-    cyclic_route_({})
+    total_way_length_(0),
+    ways_trimmed_(true),
+    ways_created_(0),
+    snapshots_published_(0),
+    deferred_updates_(false)
 {
 }
 
@@ -44,54 +233,92 @@ int Datastructures::place_count()
 
 void Datastructures::clear_all()
 {
+    places_.clear();
     places_by_id_.clear();
     places_by_name_.clear();
-    places_by_type_.clear();
+    for (auto& bucket : places_by_type_) {
+        bucket.clear();
+    }
+    areas_.clear();
     areas_by_id_.clear();
+    place_names_.clear();
+    name_substrings_.clear();
+    alphabetical_order_.clear();
+    coordinate_order_.clear();
+    for (auto& grid : place_grids_) {
+        grid.clear();
+    }
+    pending_places_.clear();
+    place_changes_.clear();
+    area_index_valid_ = false;
     alphabetical_sorted_ = false;
     coordinate_sorted_ = false;
+    place_snapshot_.reset();
 }
 
 std::vector<PlaceID> Datastructures::all_places()
 {
     std::vector<PlaceID> place_vector = {};
+    place_vector.reserve(places_by_id_.size());
     for (auto it = places_by_id_.begin(); it != places_by_id_.end(); it++) {
         place_vector.push_back(it->first);
     }
     return place_vector;
 }
 
+std::size_t Datastructures::visit_all_places(Place_visitor const& visit, std::size_t offset, std::size_t limit)
+{
+    return visit_page(places_by_id_.begin(), places_by_id_.end(), offset, limit, visit,
+                      [](auto const& entry) { return entry.first; });
+}
+
 bool Datastructures::add_place(PlaceID id, const Name& name, PlaceType type, Coord xy)
 {
+    if (deferred_updates_) {
+        if (!add_pending_place(id, name, type, xy)) {
+            return false;
+        }
+        coordinate_sorted_ = false;
+        alphabetical_sorted_ = false;
+        place_snapshot_.reset();
+        return true;
+    }
+    build_pending_indices();
     auto found_place = get_place(id);
     // Making sure that no place already exists with the same PlaceID
     if (found_place != nullptr) {
         return false;
     }
-    auto added_place = std::make_shared<Place>(id, name, type, xy);
+    Symbol name_symbol = place_names_.intern(name);
+    int slot = places_.emplace(id, name_symbol, type, xy);
 
-    places_by_id_.insert({id, added_place});
-    places_by_name_.insert({name, added_place});
-    places_by_type_.insert({type, added_place});
+    places_by_id_.insert({id, slot});
+    add_to_name_bucket(slot);
+    add_to_type_bucket(slot);
+    alphabetical_order_.insert({name_symbol, id});
+    coordinate_order_.insert(places_[slot].coordinate_order_key());
+    place_grids_[static_cast<int>(type)].insert(id, xy);
+    place_grids_[static_cast<int>(PlaceType::NO_TYPE)].insert(id, xy);
 
     // Since adding a value changes all Place-relevant datastructures, raise both flags
     coordinate_sorted_ = false;
     alphabetical_sorted_ = false;
+    place_snapshot_.reset();
     return true;
 }
 
 std::pair<Name, PlaceType> Datastructures::get_place_name_type(PlaceID id)
 {
-    std::shared_ptr<Place> wanted_place = get_place(id);
+    Place* wanted_place = get_place(id);
     if (wanted_place == nullptr) {
         return {NO_NAME, PlaceType::NO_TYPE};
     }
-    return {wanted_place->name, wanted_place->type};
+    return {place_names_.text(wanted_place->name), wanted_place->type};
 }
 
 Coord Datastructures::get_place_coord(PlaceID id)
 {
-    std::shared_ptr<Place> wanted_place = get_place(id);
+    Place* wanted_place = get_place(id);
     if (wanted_place == nullptr) {
         return NO_COORD;
     }
@@ -104,23 +331,23 @@ bool Datastructures::add_area(AreaID id, const Name &name, std::vector<Coord> co
     if (found_area != nullptr) {
         return false;
     }
-    auto added_area = std::make_shared<Area>(id, name, coords);
-    areas_by_id_.insert({id, added_area});
+    areas_by_id_.insert({id, areas_.emplace(id, place_names_.intern(name), coords)});
+    area_index_valid_ = false;
     return true;
 }
 
 Name Datastructures::get_area_name(AreaID id)
 {
-    std::shared_ptr<Area> wanted_area = get_area(id);
+    Area* wanted_area = get_area(id);
     if (wanted_area == nullptr) {
         return NO_NAME;
     }
-    return wanted_area->name;
+    return place_names_.text(wanted_area->name);
 }
 
 std::vector<Coord> Datastructures::get_area_coords(AreaID id)
 {
-    std::shared_ptr<Area> wanted_area = get_area(id);
+    Area* wanted_area = get_area(id);
     if (wanted_area == nullptr) {
         return {NO_COORD};
     }
@@ -129,124 +356,261 @@ std::vector<Coord> Datastructures::get_area_coords(AreaID id)
 
 void Datastructures::creation_finished()
 {
-    // Currently this has no purpose
+    build_pending_indices();
+    if (!area_index_valid_) {
+        build_area_index();
+    }
 }
 
 
 std::vector<PlaceID> Datastructures::places_alphabetically()
+{
+    build_pending_indices();
+    update_alphabetical_vector();
+    return alphabetical_vector_ids_;
+}
+
+void Datastructures::update_alphabetical_vector()
 {
     if (!alphabetical_sorted_) {
-        alphabetical_vector_ids_ = {};
-        std::multimap<Name, std::shared_ptr<Place>> temp_map = {};
-        // First pushing to temp_map which automatically becomes sorted
-        for (auto it = places_by_id_.begin(); it != places_by_id_.end(); ++it) {
-            temp_map.insert({it->second->name, it->second });
-        }
-        // Then simply pushing the ids in order to the vector
-        for(auto it = temp_map.begin(); it != temp_map.end(); ++it) {
-            alphabetical_vector_ids_.push_back(it->second->id);
+        stats_add(Stat::ALPHABETICAL_REBUILDS);
+        alphabetical_vector_ids_.clear();
+        alphabetical_vector_ids_.reserve(alphabetical_order_.size());
+        // The set is already in order, so simply pushing the ids in order to the vector
+        for (auto const& [name_symbol, id] : alphabetical_order_) {
+            alphabetical_vector_ids_.push_back(id);
         }
         alphabetical_sorted_ = true;
     }
-    return alphabetical_vector_ids_;
 }
 
 std::vector<PlaceID> Datastructures::places_coord_order()
+{
+    build_pending_indices();
+    update_coordinate_vector();
+    return coordinate_vector_ids_;
+}
+
+void Datastructures::update_coordinate_vector()
 {
     if (!coordinate_sorted_) {
-        coordinate_vector_ids_ = {};
-        std::multimap<Coord, std::shared_ptr<Place>> temp_map = {};
-        // First pushing to temp_map which automatically becomes sorted
-        for (auto it = places_by_id_.begin(); it != places_by_id_.end(); ++it) {
-            temp_map.insert({it->second->coordinates, it->second });
-        }
-        // Then simply pushing the ids in order to the vector
-        for(auto it = temp_map.begin(); it != temp_map.end(); ++it) {
-            coordinate_vector_ids_.push_back(it->second->id);
+        stats_add(Stat::COORDINATE_REBUILDS);
+        coordinate_vector_ids_.clear();
+        coordinate_vector_ids_.reserve(coordinate_order_.size());
+        // The set is already in order, so simply pushing the ids in order to the vector
+        for (auto const& [key, y, id] : coordinate_order_) {
+            coordinate_vector_ids_.push_back(id);
         }
         coordinate_sorted_ = true;
     }
-    return coordinate_vector_ids_;
+}
+
+std::size_t Datastructures::visit_places_alphabetically(Place_visitor const& visit, std::size_t offset, std::size_t limit)
+{
+    build_pending_indices();
+    // The first page of a changed order is cheaper to walk from the set than to rebuild the vector for
+    if (!alphabetical_sorted_ && offset == 0) {
+        return visit_page(alphabetical_order_.begin(), alphabetical_order_.end(), offset, limit, visit,
+                          [](auto const& entry) { return entry.second; });
+    }
+    update_alphabetical_vector();
+    return visit_page(alphabetical_vector_ids_, offset, limit, visit);
+}
+
+std::size_t Datastructures::visit_places_coord_order(Place_visitor const& visit, std::size_t offset, std::size_t limit)
+{
+    build_pending_indices();
+    if (!coordinate_sorted_ && offset == 0) {
+        return visit_page(coordinate_order_.begin(), coordinate_order_.end(), offset, limit, visit,
+                          [](auto const& entry) { return std::get<2>(entry); });
+    }
+    update_coordinate_vector();
+    return visit_page(coordinate_vector_ids_, offset, limit, visit);
 }
 
 std::vector<PlaceID> Datastructures::find_places_name(Name const& name)
 {
+    build_pending_indices();
     std::vector<PlaceID> found_places;
-    auto id_iterator_pair = places_by_name_.equal_range(name);
-    for (auto it = id_iterator_pair.first; it != id_iterator_pair.second; ++it) {
-        found_places.push_back(it->second->id);
+    // A name that has never been interned cannot belong to any place
+    Symbol name_symbol = place_names_.find(name);
+    if (name_symbol == NO_SYMBOL) {
+        return found_places;
+    }
+    auto bucket = places_by_name_.find(name_symbol);
+    if (bucket == places_by_name_.end()) {
+        return found_places;
+    }
+    found_places.reserve(bucket->second.size());
+    for (int slot : bucket->second) {
+        found_places.push_back(places_[slot].id);
     }
     return found_places;
 }
 
 std::vector<PlaceID> Datastructures::find_places_type(PlaceType type)
 {
+    build_pending_indices();
+    auto const& bucket = places_by_type_[static_cast<int>(type)];
+    std::vector<PlaceID> found_places;
+    found_places.reserve(bucket.size());
+    for (int slot : bucket) {
+        found_places.push_back(places_[slot].id);
+    }
+    return found_places;
+}
+
+std::vector<PlaceID> Datastructures::find_places_name_prefix(Name const& prefix, std::size_t limit)
+{
+    build_pending_indices();
+    std::vector<PlaceID> found_places;
+    // The first name that is not before the prefix is the first one starting with it, if any does
+    for (auto it = alphabetical_order_.lower_bound(std::string_view(prefix));
+         it != alphabetical_order_.end() && found_places.size() < limit; ++it) {
+        if (place_names_.text(it->first).compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        found_places.push_back(it->second);
+    }
+    return found_places;
+}
+
+std::vector<PlaceID> Datastructures::find_places_name_substring(Name const& part, std::size_t limit)
+{
+    build_pending_indices();
+    name_substrings_.update(place_names_);
     std::vector<PlaceID> found_places;
-    auto id_iterator_pair = places_by_type_.equal_range(type);
-    for (auto it = id_iterator_pair.first; it != id_iterator_pair.second; ++it) {
-        found_places.push_back(it->second->id);
+    // Names are taken in the order of their first matching suffix. Names that no place has anymore
+    // (or that only areas have) give no places.
+    Flat_hash_map<Symbol, bool> names_seen;
+    name_substrings_.for_each_match(part, [&](Symbol name) {
+        if (!names_seen.try_emplace(name, true).second) {
+            return true;
+        }
+        // Places with the same name are ordered by id, like in places_alphabetically()
+        auto bucket = places_by_name_.find(name);
+        if (bucket == places_by_name_.end()) {
+            return true;
+        }
+        auto name_begin = found_places.size();
+        for (int slot : bucket->second) {
+            found_places.push_back(places_[slot].id);
+        }
+        std::sort(found_places.begin() + name_begin, found_places.end());
+        return found_places.size() < limit;
+    });
+    if (found_places.size() > limit) {
+        found_places.resize(limit);
     }
     return found_places;
 }
 
 bool Datastructures::change_place_name(PlaceID id, const Name& newname)
 {
+    if (!deferred_updates_) {
+        build_pending_indices();
+    }
     auto found_place = get_place(id);
     if (found_place == nullptr) {
         return false;
     }
 
-    Name old_name = found_place->name;
-    auto id_iterator_pair = places_by_name_.equal_range(old_name);
-    found_place->name = newname;
-
-    for (auto it = id_iterator_pair.first; it != id_iterator_pair.second; ++it) {
-        if (it->second->id == id) {
-            auto wanted_element = places_by_name_.extract(it);
-            wanted_element.key() = newname;
-            places_by_name_.insert(std::move(wanted_element));
-            break;
-        }
+    Symbol old_name = found_place->name;
+    Symbol new_name = place_names_.intern(newname);
+    int slot = places_by_id_.at(id);
+    if (deferred_updates_) {
+        log_place_change(slot);
+    }
+    // A pending place is not in the name buckets yet
+    if (!found_place->pending) {
+        remove_from_name_bucket(slot);
+        found_place->name = new_name;
+        add_to_name_bucket(slot);
+    } else {
+        found_place->name = new_name;
+    }
+    if (!deferred_updates_) {
+        alphabetical_order_.erase({old_name, id});
+        alphabetical_order_.insert({new_name, id});
     }
     alphabetical_sorted_ = false;
+    place_snapshot_.reset();
     return true;
 }
 
 bool Datastructures::change_place_coord(PlaceID id, Coord newcoord)
 {
+    if (deferred_updates_) {
+        auto found_place = places_by_id_.find(id);
+        if (found_place == places_by_id_.end()) {
+            return false;
+        }
+        log_place_change(found_place->second);
+        places_[found_place->second].coordinates = newcoord;
+        places_[found_place->second].coordinate_key = coord_key(newcoord);
+        coordinate_sorted_ = false;
+        place_snapshot_.reset();
+        return true;
+    }
+    build_pending_indices();
     auto found_place = get_place(id);
     if (found_place == nullptr) {
         return false;
     }
 
+    // The grids find the place by its old coordinates
+    place_grids_[static_cast<int>(found_place->type)].erase(id, found_place->coordinates);
+    place_grids_[static_cast<int>(PlaceType::NO_TYPE)].erase(id, found_place->coordinates);
+    coordinate_order_.erase(found_place->coordinate_order_key());
     found_place->coordinates = newcoord;
+    found_place->coordinate_key = coord_key(newcoord);
+    coordinate_order_.insert(found_place->coordinate_order_key());
+    place_grids_[static_cast<int>(found_place->type)].insert(id, newcoord);
+    place_grids_[static_cast<int>(PlaceType::NO_TYPE)].insert(id, newcoord);
     coordinate_sorted_ = false;
+    place_snapshot_.reset();
     return true;
 }
 
 std::vector<AreaID> Datastructures::all_areas()
 {
     std::vector<AreaID> area_vector = {};
+    area_vector.reserve(areas_by_id_.size());
     for (auto it = areas_by_id_.begin(); it != areas_by_id_.end(); it++) {
         area_vector.push_back(it->first);
     }
     return area_vector;
 }
 
+std::size_t Datastructures::visit_all_areas(Area_visitor const& visit, std::size_t offset, std::size_t limit)
+{
+    return visit_page(areas_by_id_.begin(), areas_by_id_.end(), offset, limit, visit,
+                      [](auto const& entry) { return entry.first; });
+}
+
 bool Datastructures::add_subarea_to_area(AreaID id, AreaID parentid)
 {
-    auto found_subarea = get_area(id);
-    auto found_parent_area = get_area(parentid);
-    if (found_subarea == nullptr || found_parent_area == nullptr) {
+    auto subarea_slot = areas_by_id_.find(id);
+    auto parent_slot = areas_by_id_.find(parentid);
+    if (subarea_slot == areas_by_id_.end() || parent_slot == areas_by_id_.end()) {
         return false;
     }
-    // Done separately to prevent segmentation fault if found_subarea points to a nullptr
-    if (found_subarea->parent_area != nullptr) {
+    // Done separately, the area slots are only known to be valid after the first check
+    if (areas_[subarea_slot->second].parent_area != NO_SLOT) {
         return false;
     }
 
-    found_subarea->parent_area = found_parent_area;
-    found_parent_area->subareas.push_back(found_subarea);
+    int subarea = subarea_slot->second;
+    Area& parent = areas_[parent_slot->second];
+    areas_[subarea].parent_area = parent_slot->second;
+    // Appended to the end of the list of subareas
+    if (parent.last_subarea == NO_SLOT) {
+        parent.first_subarea = subarea;
+    } else {
+        areas_[parent.last_subarea].next_sibling = subarea;
+    }
+    parent.last_subarea = subarea;
+    area_index_valid_ = false;
     return true;
 }
 
@@ -258,9 +622,12 @@ std::vector<AreaID> Datastructures::subarea_in_areas(AreaID id)
     }
 
     std::vector<AreaID> parents = {};
+    if (area_index_valid_) {
+        parents.reserve(area_index_.depth[areas_by_id_.at(id)]);
+    }
     // Going through all of the parents and adding them to parents vector
-    while (found_area->parent_area != nullptr) {
-        found_area = found_area->parent_area;
+    while (found_area->parent_area != NO_SLOT) {
+        found_area = &areas_[found_area->parent_area];
         parents.push_back(found_area->id);
     }
     return parents;
@@ -268,96 +635,78 @@ std::vector<AreaID> Datastructures::subarea_in_areas(AreaID id)
 
 std::vector<PlaceID> Datastructures::places_closest_to(Coord xy, PlaceType type)
 {
-    std::unordered_multimap<PlaceType, std::shared_ptr<Place>>::iterator beginning;
-    std::unordered_multimap<PlaceType, std::shared_ptr<Place>>::iterator ending;
+    return places_k_nearest(xy, type, 3);
+}
 
-    if(type == PlaceType::NO_TYPE){
-        beginning = places_by_type_.begin();
-        ending = places_by_type_.end();
-    } else {
-        auto it_range = places_by_type_.equal_range(type);
-        beginning = it_range.first;
-        ending = it_range.second;
-    }
-
-    std::pair<double, std::shared_ptr<Place>> first_closest = {NO_DISTANCE, nullptr};
-    std::pair<double, std::shared_ptr<Place>> second_closest = {NO_DISTANCE, nullptr};
-    std::pair<double, std::shared_ptr<Place>> third_closest = {NO_DISTANCE, nullptr};
-
-    // During the loop, we first check if the closest-pairs yet have a value, and if they do, we compare them one by one to the value to determine if
-    // the place should be within the top three and change the closest-pairs accordingly
-    for(auto it = beginning; it != ending; it++){
-        double distance = calculate_euclidean({xy.x - it->second->coordinates.x, xy.y - it->second->coordinates.y});
-        if (first_closest.second == nullptr){
-            first_closest = {distance, it->second};
-        } else if(distance < first_closest.first || (distance == first_closest.first && first_closest.second->coordinates.y > it->second->coordinates.y)){
-            third_closest = second_closest;
-            second_closest = first_closest;
-            first_closest = {distance, it->second};
-        } else if (second_closest.second == nullptr){
-            second_closest = {distance, it->second};
-        } else if (distance < second_closest.first || (distance == second_closest.first && second_closest.second->coordinates.y > it->second->coordinates.y)){
-            third_closest = second_closest;
-            second_closest = {distance, it->second};
-        } else if (third_closest.second == nullptr){
-            third_closest = {distance, it->second};
-        } else if (distance < third_closest.first || (distance == third_closest.first && third_closest.second->coordinates.y > it->second->coordinates.y)){
-            third_closest = {distance, it->second};
-        }
-    }
-
-    std::vector<PlaceID> close_places_in_order = {};
-    if (third_closest.second != nullptr){
-        close_places_in_order.push_back(first_closest.second->id);
-        close_places_in_order.push_back(second_closest.second->id);
-        close_places_in_order.push_back(third_closest.second->id);
-    } else if (second_closest.second != nullptr){
-        close_places_in_order.push_back(first_closest.second->id);
-        close_places_in_order.push_back(second_closest.second->id);
-    } else if (first_closest.second != nullptr){
-        close_places_in_order.push_back(first_closest.second->id);
-    }
-
-    return close_places_in_order;
+std::vector<PlaceID> Datastructures::places_k_nearest(Coord xy, PlaceType type, std::size_t k)
+{
+    build_pending_indices();
+    return place_grids_[static_cast<int>(type)].nearest(xy, k);
+}
+
+std::vector<PlaceID> Datastructures::places_within_radius(Coord xy, PlaceType type, Distance radius)
+{
+    build_pending_indices();
+    return place_grids_[static_cast<int>(type)].within_radius(xy, radius);
 }
 
 bool Datastructures::remove_place(PlaceID id)
 {
-    std::shared_ptr<Place> to_be_removed = get_place(id);
-    if (to_be_removed == nullptr) {
+    if (!deferred_updates_) {
+        build_pending_indices();
+    }
+    auto id_iter = places_by_id_.find(id);
+    if (id_iter == places_by_id_.end()) {
         return false;
     }
+    int slot = id_iter->second;
+    Place* to_be_removed = &places_[slot];
 
-    // Only iterating over a specific key in the multimaps
-    auto name_range = places_by_name_.equal_range(to_be_removed->name);
-    for (auto name_iter = name_range.first; name_iter != name_range.second; name_iter++) {
-        if (name_iter->second->id == id) {
-            places_by_name_.erase(name_iter);
-            break;
+    if (deferred_updates_) {
+        if (to_be_removed->pending) {
+            // Never indexed, build_pending_indices() skips the slot
+            to_be_removed->pending = false;
+        } else {
+            remove_from_name_bucket(slot);
+            remove_from_type_bucket(slot);
+            log_place_change(slot);
+            place_changes_[to_be_removed->change_position].slot = NO_SLOT;
         }
+        places_by_id_.erase(id_iter);
+        places_.release(slot);
+        coordinate_sorted_ = false;
+        alphabetical_sorted_ = false;
+        place_snapshot_.reset();
+        return true;
     }
 
-    auto type_range = places_by_type_.equal_range(to_be_removed->type);
-    for (auto type_iter = type_range.first; type_iter != type_range.second; type_iter++) {
-        if (type_iter->second->id == id) {
-            places_by_type_.erase(type_iter);
-            break;
-        }
-    }
+    remove_from_name_bucket(slot);
+    remove_from_type_bucket(slot);
 
-    places_by_id_.erase(id);
+    alphabetical_order_.erase({to_be_removed->name, id});
+    coordinate_order_.erase(to_be_removed->coordinate_order_key());
+    place_grids_[static_cast<int>(to_be_removed->type)].erase(id, to_be_removed->coordinates);
+    place_grids_[static_cast<int>(PlaceType::NO_TYPE)].erase(id, to_be_removed->coordinates);
+    places_by_id_.erase(id_iter);
+    places_.release(slot);
     coordinate_sorted_ = false;
     alphabetical_sorted_ = false;
+    place_snapshot_.reset();
     return true;
 }
 
 std::vector<AreaID> Datastructures::all_subareas_in_area(AreaID id)
 {
-    auto parent_area = get_area(id);
-    if (parent_area == nullptr) {
+    auto parent_slot = areas_by_id_.find(id);
+    if (parent_slot == areas_by_id_.end()) {
         return {NO_AREA};
     }
-    return get_children(parent_area);
+    if (area_index_valid_) {
+        int slot = parent_slot->second;
+        auto first = area_index_.preorder_ids.begin() + area_index_.position[slot];
+        return std::vector<AreaID>(first + 1, first + area_index_.subtree_size[slot]);
+    }
+    return get_children(parent_slot->second);
 }
 
 AreaID Datastructures::common_area_of_subareas(AreaID id1, AreaID id2)
@@ -368,20 +717,41 @@ AreaID Datastructures::common_area_of_subareas(AreaID id1, AreaID id2)
         return NO_AREA;
     }
 
-    auto first_parent_pointer = first_area->parent_area;
-    auto second_parent_pointer = second_area->parent_area;
-    std::vector<std::shared_ptr<Area>> first_parents;
-    std::vector<std::shared_ptr<Area>> second_parents;
+    int first_parent_slot = first_area->parent_area;
+    int second_parent_slot = second_area->parent_area;
+    if (area_index_valid_) {
+        // The common area is the lowest common ancestor of the parents, as the areas themselves do not count
+        if (first_parent_slot == NO_SLOT || second_parent_slot == NO_SLOT) {
+            return NO_AREA;
+        }
+        if (area_index_.is_ancestor(first_parent_slot, second_parent_slot)) {
+            return areas_[first_parent_slot].id;
+        }
+        // Jump as high as possible while staying below the common ancestor, which is then the parent
+        int slot = first_parent_slot;
+        for (auto level = area_index_.ancestors.rbegin(); level != area_index_.ancestors.rend(); ++level) {
+            int ancestor = (*level)[slot];
+            if (ancestor != NO_SLOT && !area_index_.is_ancestor(ancestor, second_parent_slot)) {
+                slot = ancestor;
+            }
+        }
+        // Areas in different trees have no common area
+        int common = areas_[slot].parent_area;
+        return common == NO_SLOT ? NO_AREA : areas_[common].id;
+    }
+
+    std::vector<int> first_parents;
+    std::vector<int> second_parents;
 
     // Pushing all of the parents one by one into the vectors first_parents and second_parents
-    while (first_parent_pointer != nullptr) {
-        first_parents.push_back(first_parent_pointer);
-        first_parent_pointer = first_parent_pointer->parent_area;
+    while (first_parent_slot != NO_SLOT) {
+        first_parents.push_back(first_parent_slot);
+        first_parent_slot = areas_[first_parent_slot].parent_area;
     }
 
-    while (second_parent_pointer != nullptr) {
-        second_parents.push_back(second_parent_pointer);
-        second_parent_pointer = second_parent_pointer->parent_area;
+    while (second_parent_slot != NO_SLOT) {
+        second_parents.push_back(second_parent_slot);
+        second_parent_slot = areas_[second_parent_slot].parent_area;
     }
 
     // Check for the first value that differs between the parents, starting from the root
@@ -394,42 +764,148 @@ AreaID Datastructures::common_area_of_subareas(AreaID id1, AreaID id2)
     }
     // Change to the common parent instead of the first differing value by going back by one
     --result.first;
-    return result.first->get()->id;
+    return areas_[*result.first].id;
+}
+
+void Datastructures::add_to_name_bucket(int slot)
+{
+    auto& bucket = places_by_name_[places_[slot].name];
+    places_[slot].name_position = bucket.size();
+    bucket.push_back(slot);
+}
+
+void Datastructures::remove_from_name_bucket(int slot)
+{
+    auto found = places_by_name_.find(places_[slot].name);
+    auto& bucket = found->second;
+    // The last slot of the bucket takes the place of the removed one
+    int moved = bucket.back();
+    bucket[places_[slot].name_position] = moved;
+    places_[moved].name_position = places_[slot].name_position;
+    bucket.pop_back();
+    if (bucket.empty()) {
+        places_by_name_.erase(found);
+    }
+}
+
+void Datastructures::add_to_type_bucket(int slot)
+{
+    auto& bucket = places_by_type_[static_cast<int>(places_[slot].type)];
+    places_[slot].type_position = bucket.size();
+    bucket.push_back(slot);
+}
+
+void Datastructures::remove_from_type_bucket(int slot)
+{
+    auto& bucket = places_by_type_[static_cast<int>(places_[slot].type)];
+    int moved = bucket.back();
+    bucket[places_[slot].type_position] = moved;
+    places_[moved].type_position = places_[slot].type_position;
+    bucket.pop_back();
 }
 
-std::shared_ptr<Place> Datastructures::get_place(PlaceID id) {
+Place* Datastructures::get_place(PlaceID id) {
     auto search_by_id = places_by_id_.find(id);
     if (search_by_id == places_by_id_.end()) {
         return nullptr;
     }
-    return search_by_id->second;
+    return &places_[search_by_id->second];
 }
 
-std::shared_ptr<Area> Datastructures::get_area(AreaID id)
+Area* Datastructures::get_area(AreaID id)
 {
     auto search_by_id = areas_by_id_.find(id);
     if (search_by_id == areas_by_id_.end()) {
         return nullptr;
     }
-    return search_by_id->second;
+    return &areas_[search_by_id->second];
 }
 
-// This function is called recursively to find out all of the children
-std::vector<AreaID> Datastructures::get_children(std::weak_ptr<Area> current_area)
+// Walks the subtree in preorder through the links only: down to the first subarea, and from an area
+// without subareas up through the parents to the first one with a next sibling
+std::vector<AreaID> Datastructures::get_children(int area_slot)
 {
     std::vector<AreaID> subareas = {};
-    for (auto child: current_area.lock()->subareas) {
-        // Add the child to the subareas vector
-        subareas.push_back(child.lock()->id);
-        // And then return all of the subareas of the child and push them into subareas vector
-        auto children_subareas = get_children(child);
-        for (auto child: children_subareas) {
-            subareas.push_back(child);
+    int slot = areas_[area_slot].first_subarea;
+    while (slot != NO_SLOT) {
+        subareas.push_back(areas_[slot].id);
+        if (areas_[slot].first_subarea != NO_SLOT) {
+            slot = areas_[slot].first_subarea;
+            continue;
+        }
+        while (slot != area_slot && areas_[slot].next_sibling == NO_SLOT) {
+            slot = areas_[slot].parent_area;
         }
+        slot = (slot == area_slot) ? NO_SLOT : areas_[slot].next_sibling;
     }
     return subareas;
 }
 
+void Datastructures::build_area_index()
+{
+    std::size_t area_count = areas_.size();
+    area_index_.preorder_ids.clear();
+    area_index_.preorder_ids.reserve(area_count);
+    area_index_.position.assign(area_count, 0);
+    area_index_.subtree_size.assign(area_count, 1);
+    area_index_.depth.assign(area_count, 0);
+
+    // Areas are never removed, so every slot holds an area. Each tree is walked from its root in preorder through
+    // the subarea, sibling and parent links like in get_children(), and an area is finished when the walk leaves it upwards.
+    int max_depth = 0;
+    auto enter = [this, &max_depth](int slot, int depth) {
+        area_index_.position[slot] = area_index_.preorder_ids.size();
+        area_index_.depth[slot] = depth;
+        max_depth = std::max(max_depth, depth);
+        area_index_.preorder_ids.push_back(areas_[slot].id);
+    };
+    for (int root = 0; root != static_cast<int>(area_count); ++root) {
+        if (areas_[root].parent_area != NO_SLOT) {
+            continue;
+        }
+        enter(root, 0);
+        int slot = root;
+        while (slot != NO_SLOT) {
+            int child = areas_[slot].first_subarea;
+            if (child != NO_SLOT) {
+                enter(child, area_index_.depth[slot] + 1);
+                slot = child;
+                continue;
+            }
+            // Finish the area and every ancestor whose last subarea it was, then enter the next sibling
+            while (true) {
+                area_index_.subtree_size[slot] = area_index_.preorder_ids.size() - area_index_.position[slot];
+                if (slot == root) {
+                    slot = NO_SLOT;
+                    break;
+                }
+                int sibling = areas_[slot].next_sibling;
+                if (sibling != NO_SLOT) {
+                    enter(sibling, area_index_.depth[slot]);
+                    slot = sibling;
+                    break;
+                }
+                slot = areas_[slot].parent_area;
+            }
+        }
+    }
+
+    // Enough levels that the highest jump covers the deepest area
+    area_index_.ancestors.assign(1, std::vector<int>(area_count));
+    for (std::size_t slot = 0; slot != area_count; ++slot) {
+        area_index_.ancestors[0][slot] = areas_[slot].parent_area;
+    }
+    for (int jump = 2; jump <= max_depth; jump *= 2) {
+        auto const& previous = area_index_.ancestors.back();
+        std::vector<int> level(area_count);
+        for (std::size_t slot = 0; slot != area_count; ++slot) {
+            level[slot] = previous[slot] == NO_SLOT ? NO_SLOT : previous[previous[slot]];
+        }
+        area_index_.ancestors.push_back(std::move(level));
+    }
+    area_index_valid_ = true;
+}
+
 double calculate_euclidean(Coord coord)
 {
     return std::sqrt(std::pow(coord.x, 2) + std::pow(coord.y, 2));
@@ -439,109 +915,134 @@ std::vector<WayID> Datastructures::all_ways()
 {
     std::vector<WayID> way_vector = {};
     // Ways_by_id_ has no repetition
+    way_vector.reserve(ways_by_id_.size());
     for (auto it = ways_by_id_.begin(); it != ways_by_id_.end(); it++) {
-        way_vector.push_back(it->first);
+        way_vector.push_back(way_ids_.text(it->first));
     }
     return way_vector;
 }
 
+std::size_t Datastructures::visit_all_ways(Way_visitor const& visit, std::size_t offset, std::size_t limit)
+{
+    return visit_page(ways_by_id_.begin(), ways_by_id_.end(), offset, limit, visit,
+                      [this](auto const& entry) -> WayID const& { return way_ids_.text(entry.first); });
+}
+
 bool Datastructures::add_way(WayID id, std::vector<Coord> coords)
-{   
-    auto found_way = get_way(id);
+{
+    if (deferred_updates_) {
+        // Pending like the bulk additions, which keeps the ways of a crossroad in the order they were added
+        if (!add_pending_way(id, coords)) {
+            return false;
+        }
+        route_graph_.reset();
+        routing_hierarchy_.reset();
+        ways_trimmed_ = false;
+        return true;
+    }
+    // The ways of a crossroad have to stay in the order they were added
+    build_pending_indices();
     // Making sure that no way already exists with the same WayID
-    if (found_way != nullptr) {
+    if (find_way(id) != NO_SLOT) {
         return false;
     }
-    auto added_way = std::make_shared<Way>(id, coords);
     // Both ways have two ends
     Coord end1 = coords.front();
     Coord end2 = coords.back();
+    Symbol id_symbol = way_ids_.intern(id);
+    int slot = ways_.emplace(id_symbol, coords, ways_created_++);
 
     // Add to all of the data structures that take the way as the value
-    ways_by_id_.insert({id, added_way});
-    ways_by_coord_.insert({end1, added_way});
-    ways_by_coord_.insert({end2, added_way});
-
-    // Making sure to only create a Crossroad_data element if one does not exist yet with the same coordinates
-    if (visited_coordinates_.find(end1) == visited_coordinates_.end()) {
-        auto added_cr = std::make_shared<Crossroad_data>(end1);
-        visited_coordinates_.insert({end1, added_cr});
-    }
-
-    if (visited_coordinates_.find(end2) == visited_coordinates_.end()) {
-        auto added_cr = std::make_shared<Crossroad_data>(end2);
-        visited_coordinates_.insert({end2, added_cr});
-    }
+    ways_by_id_.insert({id_symbol, slot});
+    ways_by_coord_.insert({end1, slot});
+    ways_by_coord_.insert({end2, slot});
+
+    // Only creates a Crossroad_data element if one does not exist yet with the same coordinates
+    visited_coordinates_.try_emplace(end1, end1);
+    visited_coordinates_.try_emplace(end2, end2);
+    total_way_length_ += ways_.lengths[slot];
+    route_graph_.reset();
+    routing_hierarchy_.reset();
+    ways_trimmed_ = false;
     return true;
 }
 
 std::vector<std::pair<WayID, Coord>> Datastructures::ways_from(Coord xy)
 {
+    build_pending_indices();
     std::vector<std::pair<WayID, Coord>> found_ways = {};
     // Only need to go through ways connected to coordinate
     auto iterator_pair = ways_by_coord_.equal_range(xy);
     for (auto it = iterator_pair.first; it != iterator_pair.second; ++it) {
+        int slot = it->second;
         // If the first coordinate is the checked one, use the other one, if second coordinate other way around
-        if (xy == it->second->end1) {
-            found_ways.push_back(std::make_pair(it->second->id, it->second->end2));
+        if (xy == ways_.end1[slot]) {
+            found_ways.push_back(std::make_pair(way_ids_.text(ways_.ids[slot]), ways_.end2[slot]));
         } else {
-            found_ways.push_back(std::make_pair(it->second->id, it->second->end1));
+            found_ways.push_back(std::make_pair(way_ids_.text(ways_.ids[slot]), ways_.end1[slot]));
         }
     }
     return found_ways;
 }
 
-std::vector<Coord> Datastructures::get_way_coords(WayID id)
+Coord_span Datastructures::get_way_coords(WayID id)
 {
-    std::shared_ptr<Way> wanted_way = get_way(id);
-    if (wanted_way == nullptr) {
-        return {NO_COORD};
+    static Coord const no_way_coords[] = {NO_COORD};
+    int slot = find_way(id);
+    if (slot == NO_SLOT) {
+        return {no_way_coords, 1};
     }
-    return wanted_way->coordinates;
+    return ways_.coords_of(slot);
 }
 
 void Datastructures::clear_ways()
 {
+    ways_.clear();
     ways_by_id_.clear();
+    way_ids_.clear();
     ways_by_coord_.clear();
     visited_coordinates_.clear();
-    chosen_route_.clear();
-    cyclic_route_.clear();
+    pending_ways_.clear();
+    way_grid_.clear();
+    route_graph_.reset();
+    routing_hierarchy_.reset();
+    total_way_length_ = 0;
+    ways_trimmed_ = true;
 }
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_any(Coord fromxy, Coord toxy)
 {
-    if (ways_from(toxy).size() == 0 || ways_from(fromxy).size() == 0) {
-        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
-    }
-    // Prepares for search
-    clean_for_search(NORMAL);
-    search_any(fromxy, toxy, 0);
-    // Flip to correct order
-    std::reverse(chosen_route_.begin(), chosen_route_.end());
-    return chosen_route_;
+    build_route_graph();
+    return route_graph_->route_any(fromxy, toxy, thread_search_scratch());
 }
 
 bool Datastructures::remove_way(WayID id)
 {
-    std::shared_ptr<Way> searched_way = get_way(id);
-    if (searched_way == nullptr) {
+    build_pending_indices();
+    int slot = find_way(id);
+    if (slot == NO_SLOT) {
         return false;
     }
+    remove_way_in_slot(slot);
+    return true;
+}
+
+void Datastructures::remove_way_in_slot(int slot)
+{
     // Pickup both of the ends of the way
-    Coord wanted_coord1 = searched_way->end1;
-    Coord wanted_coord2 = searched_way->end2;
+    Coord wanted_coord1 = ways_.end1[slot];
+    Coord wanted_coord2 = ways_.end2[slot];
     auto iterator_pair = ways_by_coord_.equal_range(wanted_coord1);
     for (auto it = iterator_pair.first; it != iterator_pair.second; ++it) {
         // If an identical id can be found, remove it from the multimap
-        if (id == it->second->id) {
+        if (slot == it->second) {
             ways_by_coord_.erase(it);
             // Only one possible since id is unique
             break;
         }
     }
     // If there are no more ways connecting to the coordinate
-    if (ways_from(wanted_coord1).size() == 0) {
+    if (ways_by_coord_.find(wanted_coord1) == ways_by_coord_.end()) {
         visited_coordinates_.erase(wanted_coord1);
     }
 
@@ -550,130 +1051,1925 @@ bool Datastructures::remove_way(WayID id)
     auto iterator_pair2 = ways_by_coord_.equal_range(wanted_coord2);
     for (auto it2 = iterator_pair2.first; it2 != iterator_pair2.second; ++it2) {
         // If an identical id can be found, remove it from the multimap
-        if (id == it2->second->id) {
+        if (slot == it2->second) {
             ways_by_coord_.erase(it2);
             // Only one possible since id is unique
             break;
         }
     }
-    if (ways_from(wanted_coord2).size() == 0) {
+    if (ways_by_coord_.find(wanted_coord2) == ways_by_coord_.end()) {
         visited_coordinates_.erase(wanted_coord2);
     }
 
-    // Finally erase it by using the id
-    ways_by_id_.erase(id);
-    return true;
+    // Finally erase it by using the id, the coordinates are not needed until the slot is reused
+    total_way_length_ -= ways_.lengths[slot];
+    ways_by_id_.erase(ways_.ids[slot]);
+    ways_.release(slot);
+    route_graph_.reset();
+    routing_hierarchy_.reset();
 }
 
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_least_crossroads(Coord fromxy, Coord toxy)
 {
-    // No answer
-    return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    build_route_graph();
+    return route_graph_->route_least_crossroads(fromxy, toxy, thread_search_scratch());
 }
 
 std::vector<std::tuple<Coord, WayID> > Datastructures::route_with_cycle(Coord fromxy)
 {
-    // If cannot traverse from starting node
-    if (ways_from(fromxy).size() == 0) {
-        return {{NO_COORD, NO_WAY}};
-    }
-    // Prepares for search
-    clean_for_search(CYCLE);
-    search_cycle(fromxy, NO_COORD);
-    // Flip to correct order
-    std::reverse(cyclic_route_.begin(), cyclic_route_.end());
-    return cyclic_route_;
+    build_route_graph();
+    return route_graph_->route_with_cycle(fromxy, thread_search_scratch());
 }
 
 std::vector<std::tuple<Coord, WayID, Distance> > Datastructures::route_shortest_distance(Coord fromxy, Coord toxy)
 {
-    // No answer
-    return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    build_route_graph();
+    if (routing_hierarchy_ != nullptr) {
+        return routing_hierarchy_->route_shortest_distance(fromxy, toxy, thread_search_scratch(), thread_backward_search_scratch());
+    }
+    return route_graph_->route_shortest_distance(fromxy, toxy, thread_search_scratch());
 }
 
-Distance Datastructures::trim_ways()
+std::size_t Datastructures::prepare_routing()
 {
-    // No answer
-    return NO_DISTANCE;
+    build_route_graph();
+    if (routing_hierarchy_ == nullptr) {
+        routing_hierarchy_ = std::make_shared<Contraction_hierarchy const>(route_graph_);
+    }
+    return routing_hierarchy_->shortcut_count;
 }
 
-void Datastructures::search_any(Coord current, Coord goal, int route_length)
+Distance Datastructures::trim_ways()
 {
-    // Update the accessed coordinates and current route length
-    visited_coordinates_.at(current)->distance = route_length;
-    visited_coordinates_.at(current)->visited = true;
-    if (current == goal) {
-        // When goal is reached, raise flag for other recursive functions
-        route_found_ = true;
-        // Add the finishing value to the vector with goal, NO_WAY
-        chosen_route_.push_back({goal,NO_WAY,visited_coordinates_.at(current)->distance});
-        return;
+    // A forest stays a forest when ways are removed, so there is nothing to trim
+    if (ways_trimmed_) {
+        return total_way_length_;
     }
-    // Recursively loop over all values using DFS
-    auto current_ways = ways_from(current);
-    for (auto it = current_ways.begin(); it != current_ways.end(); ++it) {
-        // If already visited no need to check
-        if (visited_coordinates_.at(it->second)->visited == true) {
-            continue;
-        }
-        // Keep up the current total length of the route
-        search_any(it->second, goal, route_length + ways_by_id_.at(it->first)->length);
-        // When the route has been found, each instance can simply record their current data and return
-        if (route_found_) {
-            chosen_route_.push_back({current,it->first,visited_coordinates_.at(current)->distance});
-            return;
+    build_route_graph();
+    // Removing the ways drops route_graph_, so keep the graph alive until the end
+    std::shared_ptr<Route_graph const> graph = route_graph_;
+    // The only allocation for the ways: their slots, sorted shortest first
+    std::vector<int> ways_in_order = {};
+    ways_in_order.reserve(ways_by_id_.size());
+    for (auto it = ways_by_id_.begin(); it != ways_by_id_.end(); ++it) {
+        ways_in_order.push_back(it->second);
+    }
+    std::sort(ways_in_order.begin(), ways_in_order.end(), [this](int way1, int way2) {
+        int length1 = ways_.lengths[way1];
+        int length2 = ways_.lengths[way2];
+        return length1 < length2 || (length1 == length2 && way1 < way2);
+    });
+
+    Disjoint_set components;
+    components.reset(graph->node_coords.size());
+    Distance remaining_length = 0;
+    // Ways closing a cycle are moved to the front of the vector, over positions that have already been read
+    std::vector<int>::size_type rejected_count = 0;
+    for (int way : ways_in_order) {
+        auto [end1, end2] = graph->way_ends[way];
+        if (components.unite(end1, end2)) {
+            remaining_length += ways_.lengths[way];
+        } else {
+            ways_in_order[rejected_count++] = way;
         }
     }
-    return;
+
+    // Removing a way only releases its slot, so the slots of the other rejected ways stay valid
+    for (std::vector<int>::size_type i = 0; i != rejected_count; ++i) {
+        remove_way_in_slot(ways_in_order[i]);
+    }
+    ways_trimmed_ = true;
+    return remaining_length;
 }
 
-void Datastructures::search_cycle(Coord current, Coord previous)
+
+void Datastructures::build_route_graph()
 {
-    // If the current node has been visited before, we have found a loop
-    if (visited_coordinates_.at(current)->visited == true) {
-        route_found_ = true;
-        // Add the finishing value to the vector with the cycle-node, NO_WAY
-        cyclic_route_.push_back({current,NO_WAY});
+    if (route_graph_ != nullptr) {
         return;
     }
-    visited_coordinates_.at(current)->visited = true;
-    auto current_ways = ways_from(current);
-    for (auto it = current_ways.begin(); it != current_ways.end(); ++it) {
-        // Prevents from going straight backwards to the previous node
-        if (it->second == previous) {
-            continue;
+    stats_add(Stat::ROUTE_GRAPH_REBUILDS);
+    build_pending_indices();
+    // A new graph is built each time, the previous one may still be used by a Query_snapshot
+    auto graph = std::make_shared<Route_graph>();
+    graph->way_ends.assign(ways_.size(), {-1, -1});
+    graph->way_ids.assign(ways_.size(), NO_WAY);
+
+    // Number the crossroads densely
+    graph->node_of_coord.reserve(visited_coordinates_.size());
+    graph->node_coords.reserve(visited_coordinates_.size());
+    for (auto it = visited_coordinates_.begin(); it != visited_coordinates_.end(); ++it) {
+        graph->node_of_coord.insert({it->first, static_cast<int>(graph->node_coords.size())});
+        graph->node_coords.push_back(it->first);
+    }
+
+    // Both ends of every way are in ways_by_coord_, so it contains exactly the edges of the graph
+    graph->offsets.reserve(graph->node_coords.size() + 1);
+    graph->edges.reserve(ways_by_coord_.size());
+    for (Coord xy : graph->node_coords) {
+        graph->offsets.push_back(graph->edges.size());
+        auto iterator_pair = ways_by_coord_.equal_range(xy);
+        for (auto it = iterator_pair.first; it != iterator_pair.second; ++it) {
+            int slot = it->second;
+            Coord other_end = (xy == ways_.end1[slot]) ? ways_.end2[slot] : ways_.end1[slot];
+            int neighbor = graph->node_of_coord.at(other_end);
+            int node = graph->offsets.size() - 1;
+            graph->edges.push_back({neighbor, slot, ways_.lengths[slot]});
+            if (xy == ways_.end1[slot]) {
+                graph->way_ends[slot] = {node, neighbor};
+                graph->way_ids[slot] = way_ids_.text(ways_.ids[slot]);
+            }
         }
-        search_cycle(it->second, current);
-        if (route_found_) {
-            cyclic_route_.push_back({current,it->first});
-            return;
+    }
+    graph->offsets.push_back(graph->edges.size());
+
+    // Label the connected components with union-find over the ways, so that the searches can reject
+    // a pair in different components before walking the whole component of the start
+    Disjoint_set components;
+    components.reset(graph->node_coords.size());
+    for (auto [end1, end2] : graph->way_ends) {
+        if (end1 != -1) {
+            components.unite(end1, end2);
         }
     }
-    return;
+    graph->component.resize(graph->node_coords.size());
+    for (int node = 0; node != static_cast<int>(graph->node_coords.size()); ++node) {
+        graph->component[node] = components.find(node);
+    }
+    route_graph_ = std::move(graph);
 }
 
-void Datastructures::clean_for_search(int type)
+
+int Datastructures::find_way(WayID id)
 {
-    // Undo flag
-    route_found_ = false;
-    for (auto it = visited_coordinates_.begin(); it != visited_coordinates_.end(); ++it) {
-        it->second->distance = NO_VALUE;
-        it->second->visited = false;
+    Symbol id_symbol = way_ids_.find(id);
+    if (id_symbol == NO_SYMBOL) {
+        return NO_SLOT;
     }
-    // Clear current routes
-    if (type == NORMAL) {
-        chosen_route_.clear();
-    } else {
-        cyclic_route_.clear();
+    auto search_by_id = ways_by_id_.find(id_symbol);
+    if (search_by_id == ways_by_id_.end()) {
+        return NO_SLOT;
     }
+    return search_by_id->second;
 }
 
-std::shared_ptr<Way> Datastructures::get_way(WayID id)
+void Datastructures::reserve(std::size_t place_count, std::size_t way_count)
 {
-    auto search_by_id = ways_by_id_.find(id);
-    if (search_by_id == ways_by_id_.end()) {
-        return nullptr;
+    places_.reserve(place_count);
+    places_by_id_.reserve(place_count);
+    places_by_name_.reserve(place_count);
+    ways_.reserve(way_count);
+    ways_by_id_.reserve(way_count);
+    // Every way has two ends, and at most two new crossroads
+    ways_by_coord_.reserve(2 * way_count);
+    visited_coordinates_.reserve(2 * way_count);
+}
+
+std::size_t Datastructures::add_places_bulk(std::vector<Place_record> const& places)
+{
+    places_by_id_.reserve(places_by_id_.size() + places.size());
+    std::size_t added = 0;
+    for (auto const& place : places) {
+        added += add_pending_place(place.id, place.name, place.type, place.coordinates);
     }
-    return search_by_id->second;
+    if (added != 0) {
+        coordinate_sorted_ = false;
+        alphabetical_sorted_ = false;
+        place_snapshot_.reset();
+    }
+    return added;
+}
+
+std::size_t Datastructures::add_ways_bulk(std::vector<Way_record> ways)
+{
+    ways_by_id_.reserve(ways_by_id_.size() + ways.size());
+    std::size_t added = 0;
+    for (auto const& way : ways) {
+        added += add_pending_way(way.id, way.coordinates);
+    }
+    if (added != 0) {
+        route_graph_.reset();
+        routing_hierarchy_.reset();
+        ways_trimmed_ = false;
+    }
+    return added;
+}
+
+bool Datastructures::add_pending_place(PlaceID id, Name const& name, PlaceType type, Coord xy)
+{
+    // Making sure that no place already exists with the same PlaceID
+    auto [id_entry, inserted] = places_by_id_.try_emplace(id, NO_SLOT);
+    if (!inserted) {
+        return false;
+    }
+    int slot = places_.emplace(id, place_names_.intern(name), type, xy);
+    id_entry->second = slot;
+    places_[slot].pending = true;
+    pending_places_.push_back(slot);
+    return true;
+}
+
+bool Datastructures::add_pending_way(WayID const& id, std::vector<Coord> const& coords)
+{
+    // Making sure that no way already exists with the same WayID
+    Symbol id_symbol = way_ids_.intern(id);
+    auto [id_entry, inserted] = ways_by_id_.try_emplace(id_symbol, NO_SLOT);
+    if (!inserted) {
+        return false;
+    }
+    int slot = ways_.emplace(id_symbol, coords, ways_created_++);
+    id_entry->second = slot;
+    total_way_length_ += ways_.lengths[slot];
+    pending_ways_.push_back(slot);
+    return true;
+}
+
+void Datastructures::log_place_change(int slot)
+{
+    Place& place = places_[slot];
+    // A pending place is indexed with its final keys anyway, and a logged one already has its original keys logged
+    if (place.pending || place.change_position != NO_SLOT) {
+        return;
+    }
+    place.change_position = place_changes_.size();
+    place_changes_.push_back({place.id, slot, place.name, place.coordinates, place.type});
+}
+
+void Datastructures::set_deferred_updates(bool deferred)
+{
+    deferred_updates_ = deferred;
+    if (!deferred) {
+        build_pending_indices();
+    }
+}
+
+bool Datastructures::deferred_updates() const
+{
+    return deferred_updates_;
+}
+
+std::vector<PlaceID> Datastructures::places_in_rect(Coord lower_left, Coord upper_right)
+{
+    build_pending_indices();
+    return place_grids_[static_cast<int>(PlaceType::NO_TYPE)].within_rect(lower_left, upper_right);
+}
+
+std::vector<WayID> Datastructures::ways_in_rect(Coord lower_left, Coord upper_right)
+{
+    way_grid_.update(ways_);
+    std::vector<WayID> found_ways = {};
+    for (int slot : way_grid_.slots_in_rect(lower_left, upper_right)) {
+        found_ways.push_back(way_ids_.text(ways_.ids[slot]));
+    }
+    return found_ways;
+}
+
+std::pair<Coord, Coord> Datastructures::map_bounds()
+{
+    build_pending_indices();
+    way_grid_.update(ways_);
+    auto bounds = place_grids_[static_cast<int>(PlaceType::NO_TYPE)].bounds();
+    auto way_bounds = way_grid_.bounds();
+    if (bounds.first == NO_COORD) {
+        return way_bounds;
+    }
+    if (way_bounds.first != NO_COORD) {
+        bounds.first = {std::min(bounds.first.x, way_bounds.first.x), std::min(bounds.first.y, way_bounds.first.y)};
+        bounds.second = {std::max(bounds.second.x, way_bounds.second.x), std::max(bounds.second.y, way_bounds.second.y)};
+    }
+    return bounds;
+}
+
+void Datastructures::build_pending_indices()
+{
+    if (!pending_places_.empty() || !place_changes_.empty()) {
+        places_by_name_.reserve(places_by_name_.size() + pending_places_.size());
+        std::size_t entry_count = pending_places_.size() + place_changes_.size();
+        std::vector<std::pair<Symbol, PlaceID>> alphabetical_entries = {};
+        std::vector<std::tuple<long long, int, PlaceID>> coordinate_entries = {};
+        std::array<std::vector<Place_grid::Entry>, static_cast<int>(PlaceType::NO_TYPE) + 1> grid_entries = {};
+        alphabetical_entries.reserve(entry_count);
+        coordinate_entries.reserve(entry_count);
+        grid_entries[static_cast<int>(PlaceType::NO_TYPE)].reserve(entry_count);
+        auto add_alphabetical_entry = [&alphabetical_entries](Place const& place) {
+            alphabetical_entries.push_back({place.name, place.id});
+        };
+        auto add_coordinate_entries = [&coordinate_entries, &grid_entries](Place const& place) {
+            coordinate_entries.push_back(place.coordinate_order_key());
+            grid_entries[static_cast<int>(place.type)].push_back({place.coordinates, place.id});
+            grid_entries[static_cast<int>(PlaceType::NO_TYPE)].push_back({place.coordinates, place.id});
+        };
+        // The changed places lose the keys they were indexed with, unless the key ended up the same again, and the places
+        // that still exist get their current keys together with the pending places. The old keys are erased in order, so
+        // that consecutive erases walk down mostly the same path of the tree, and before anything is inserted.
+        std::vector<std::pair<Symbol, PlaceID>> old_alphabetical_keys = {};
+        std::vector<std::tuple<long long, int, PlaceID>> old_coordinate_keys = {};
+        for (Place_change const& change : place_changes_) {
+            Place* place = (change.slot == NO_SLOT) ? nullptr : &places_[change.slot];
+            if (place == nullptr || place->name != change.old_name) {
+                old_alphabetical_keys.push_back({change.old_name, change.id});
+                if (place != nullptr) {
+                    add_alphabetical_entry(*place);
+                }
+            }
+            if (place == nullptr || place->coordinates != change.old_coordinates) {
+                old_coordinate_keys.push_back({coord_key(change.old_coordinates), change.old_coordinates.y, change.id});
+                place_grids_[static_cast<int>(change.type)].erase(change.id, change.old_coordinates);
+                place_grids_[static_cast<int>(PlaceType::NO_TYPE)].erase(change.id, change.old_coordinates);
+                if (place != nullptr) {
+                    add_coordinate_entries(*place);
+                }
+            }
+            if (place != nullptr) {
+                place->change_position = NO_SLOT;
+            }
+        }
+        place_changes_.clear();
+        std::sort(old_alphabetical_keys.begin(), old_alphabetical_keys.end(), alphabetical_order_.key_comp());
+        std::sort(old_coordinate_keys.begin(), old_coordinate_keys.end());
+        for (auto const& key : old_alphabetical_keys) {
+            alphabetical_order_.erase(key);
+        }
+        for (auto const& key : old_coordinate_keys) {
+            coordinate_order_.erase(key);
+        }
+        for (int slot : pending_places_) {
+            // Removed before it was indexed, or listed a second time after its slot was reused
+            if (!places_[slot].pending) {
+                continue;
+            }
+            places_[slot].pending = false;
+            add_to_name_bucket(slot);
+            add_to_type_bucket(slot);
+            add_alphabetical_entry(places_[slot]);
+            add_coordinate_entries(places_[slot]);
+        }
+        // Inserting a sorted range into a set puts every element next to the previous one without searching the tree
+        std::sort(alphabetical_entries.begin(), alphabetical_entries.end(), alphabetical_order_.key_comp());
+        std::sort(coordinate_entries.begin(), coordinate_entries.end());
+        alphabetical_order_.insert(alphabetical_entries.begin(), alphabetical_entries.end());
+        coordinate_order_.insert(coordinate_entries.begin(), coordinate_entries.end());
+        for (std::size_t type = 0; type != place_grids_.size(); ++type) {
+            place_grids_[type].insert_many(grid_entries[type]);
+        }
+        pending_places_.clear();
+    }
+
+    if (!pending_ways_.empty()) {
+        ways_by_coord_.reserve(ways_by_coord_.size() + 2 * pending_ways_.size());
+        visited_coordinates_.reserve(visited_coordinates_.size() + 2 * pending_ways_.size());
+        // Same insertions as add_way() in the same order, so ways_from() sees no difference
+        for (int slot : pending_ways_) {
+            Coord end1 = ways_.end1[slot];
+            Coord end2 = ways_.end2[slot];
+            ways_by_coord_.insert({end1, slot});
+            ways_by_coord_.insert({end2, slot});
+            visited_coordinates_.try_emplace(end1, end1);
+            visited_coordinates_.try_emplace(end2, end2);
+        }
+        pending_ways_.clear();
+    }
+}
+
+bool Datastructures::save_snapshot(std::string const& filename)
+{
+    std::string buffer = {};
+    buffer.append(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    append_value(buffer, SNAPSHOT_VERSION);
+    append_value(buffer, SNAPSHOT_BYTE_ORDER);
+
+    append_value<std::uint64_t>(buffer, places_by_id_.size());
+    for (auto const& [id, slot] : places_by_id_) {
+        Place const& place = places_[slot];
+        append_value<std::int64_t>(buffer, id);
+        append_value<std::int32_t>(buffer, static_cast<int>(place.type));
+        append_value<std::int32_t>(buffer, place.coordinates.x);
+        append_value<std::int32_t>(buffer, place.coordinates.y);
+        append_text(buffer, place_names_.text(place.name));
+    }
+
+    // Areas are never removed, so their slots are in the order they were added
+    append_value<std::uint64_t>(buffer, areas_.size());
+    std::uint64_t link_count = 0;
+    for (std::size_t slot = 0; slot != areas_.size(); ++slot) {
+        Area const& area = areas_[slot];
+        append_value<std::int64_t>(buffer, area.id);
+        append_text(buffer, place_names_.text(area.name));
+        append_coords(buffer, area.coordinates);
+        link_count += (area.parent_area != NO_SLOT);
+    }
+    // Every parent gets its subareas back in the same order
+    append_value<std::uint64_t>(buffer, link_count);
+    for (std::size_t slot = 0; slot != areas_.size(); ++slot) {
+        for (int subarea = areas_[slot].first_subarea; subarea != NO_SLOT; subarea = areas_[subarea].next_sibling) {
+            append_value<std::int64_t>(buffer, areas_[subarea].id);
+            append_value<std::int64_t>(buffer, areas_[slot].id);
+        }
+    }
+
+    std::vector<int> ways_in_order = {};
+    ways_in_order.reserve(ways_by_id_.size());
+    for (auto const& [id_symbol, slot] : ways_by_id_) {
+        ways_in_order.push_back(slot);
+    }
+    std::sort(ways_in_order.begin(), ways_in_order.end(), [this](int way1, int way2) {
+        return ways_.creation_numbers[way1] < ways_.creation_numbers[way2];
+    });
+    append_value<std::uint64_t>(buffer, ways_in_order.size());
+    for (int slot : ways_in_order) {
+        append_text(buffer, way_ids_.text(ways_.ids[slot]));
+        append_coords(buffer, ways_.coords_of(slot));
+    }
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    file.write(buffer.data(), buffer.size());
+    return static_cast<bool>(file);
+}
+
+bool Datastructures::load_snapshot(std::string const& filename)
+{
+    Mapped_file file(filename);
+    if (file.data == nullptr || !read_snapshot(file.data, file.size, false)) {
+        return false;
+    }
+    clear_all();
+    clear_ways();
+    return read_snapshot(file.data, file.size, true);
+}
+
+bool Datastructures::read_snapshot(char const* data, std::size_t size, bool apply)
+{
+    Snapshot_reader reader = {data, data + size};
+    if (!reader.has(sizeof(SNAPSHOT_MAGIC)) || std::memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        return false;
+    }
+    reader.position += sizeof(SNAPSHOT_MAGIC);
+    if (reader.value<std::uint32_t>() != SNAPSHOT_VERSION || reader.value<std::uint32_t>() != SNAPSHOT_BYTE_ORDER) {
+        return false;
+    }
+
+    auto place_count = reader.value<std::uint64_t>();
+    std::vector<Place_record> places = {};
+    for (std::uint64_t i = 0; i != place_count && reader.ok; ++i) {
+        PlaceID id = reader.value<std::int64_t>();
+        int type = reader.value<std::int32_t>();
+        int x = reader.value<std::int32_t>();
+        int y = reader.value<std::int32_t>();
+        Name name = reader.text();
+        if (type < 0 || type > static_cast<int>(PlaceType::NO_TYPE)) {
+            return false;
+        }
+        if (apply) {
+            places.push_back({id, std::move(name), static_cast<PlaceType>(type), {x, y}});
+        }
+    }
+    if (apply) {
+        reserve(places.size(), 0);
+        add_places_bulk(places);
+    }
+
+    auto area_count = reader.value<std::uint64_t>();
+    for (std::uint64_t i = 0; i != area_count && reader.ok; ++i) {
+        AreaID id = reader.value<std::int64_t>();
+        Name name = reader.text();
+        std::vector<Coord> coords = reader.coords();
+        if (apply) {
+            add_area(id, name, std::move(coords));
+        }
+    }
+
+    auto link_count = reader.value<std::uint64_t>();
+    for (std::uint64_t i = 0; i != link_count && reader.ok; ++i) {
+        AreaID id = reader.value<std::int64_t>();
+        AreaID parentid = reader.value<std::int64_t>();
+        if (apply) {
+            add_subarea_to_area(id, parentid);
+        }
+    }
+
+    auto way_count = reader.value<std::uint64_t>();
+    std::vector<Way_record> ways = {};
+    for (std::uint64_t i = 0; i != way_count && reader.ok; ++i) {
+        WayID id = reader.text();
+        std::vector<Coord> coords = reader.coords();
+        // A way always has both of its ends
+        if (reader.ok && coords.empty()) {
+            return false;
+        }
+        if (apply) {
+            ways.push_back({std::move(id), std::move(coords)});
+        }
+    }
+    if (apply) {
+        reserve(places_by_id_.size(), ways.size());
+        add_ways_bulk(std::move(ways));
+        creation_finished();
+    }
+    return reader.ok && reader.position == reader.end;
+}
+
+void Datastructures::publish_snapshot()
+{
+    build_pending_indices();
+    build_route_graph();
+    if (place_snapshot_ == nullptr) {
+        auto places = std::make_shared<Place_snapshot>();
+        places->grids = place_grids_;
+        places->ids_by_name.reserve(places_by_name_.size());
+        for (auto const& [name_symbol, bucket] : places_by_name_) {
+            auto& ids = places->ids_by_name[place_names_.text(name_symbol)];
+            ids.reserve(bucket.size());
+            for (int slot : bucket) {
+                ids.push_back(places_[slot].id);
+            }
+        }
+        for (std::size_t type = 0; type != places_by_type_.size(); ++type) {
+            places->ids_by_type[type].reserve(places_by_type_[type].size());
+            for (int slot : places_by_type_[type]) {
+                places->ids_by_type[type].push_back(places_[slot].id);
+            }
+        }
+        place_snapshot_ = std::move(places);
+    }
+    auto snapshot = std::make_shared<Query_snapshot const>(++snapshots_published_, route_graph_, routing_hierarchy_, place_snapshot_);
+    std::atomic_store(&published_snapshot_, std::shared_ptr<Query_snapshot const>(std::move(snapshot)));
+}
+
+std::shared_ptr<Query_snapshot const> Datastructures::latest_snapshot() const
+{
+    return std::atomic_load(&published_snapshot_);
+}
+
+void Datastructures::set_thread_count(unsigned int count)
+{
+    thread_pool_.resize(count);
+}
+
+unsigned int Datastructures::thread_count() const
+{
+    return thread_pool_.thread_count();
+}
+
+std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> Datastructures::route_many(std::vector<std::pair<Coord, Coord>> const& queries)
+{
+    publish_snapshot();
+    std::shared_ptr<Query_snapshot const> snapshot = latest_snapshot();
+    std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> routes(queries.size());
+    thread_pool_.run(queries.size(), [&](std::size_t i) {
+        routes[i] = snapshot->route_shortest_distance(queries[i].first, queries[i].second);
+    });
+    return routes;
+}
+
+std::vector<std::vector<PlaceID>> Datastructures::closest_many(std::vector<Coord> const& coords, PlaceType type)
+{
+    publish_snapshot();
+    std::shared_ptr<Query_snapshot const> snapshot = latest_snapshot();
+    std::vector<std::vector<PlaceID>> places(coords.size());
+    thread_pool_.run(coords.size(), [&](std::size_t i) {
+        places[i] = snapshot->places_closest_to(coords[i], type);
+    });
+    return places;
+}
+
+std::vector<Distance> Datastructures::route_distance_matrix(std::vector<Coord> const& sources, std::vector<Coord> const& targets)
+{
+    build_route_graph();
+    // The searches of the workers all use this graph even if route_graph_ would be replaced
+    std::shared_ptr<Route_graph const> graph = route_graph_;
+    Distance_targets target_nodes = graph->make_targets(targets);
+    std::vector<Distance> matrix(sources.size() * targets.size(), NO_DISTANCE);
+    thread_pool_.run(sources.size(), [&](std::size_t i) {
+        graph->distances_from(sources[i], target_nodes, thread_search_scratch(), matrix.data() + i * targets.size());
+    });
+    return matrix;
+}
+
+std::vector<std::pair<std::string, std::uint64_t>> Datastructures::stats() const
+{
+    std::vector<std::pair<std::string, std::uint64_t>> values = {};
+    if (STATS_ENABLED) {
+        for (std::size_t stat = 0; stat != STAT_NAMES.size(); ++stat) {
+            values.push_back({STAT_NAMES[stat], stats_value(static_cast<Stat>(stat))});
+        }
+    }
+    return values;
+}
+
+void Datastructures::reset_stats()
+{
+    stats_reset();
+}
+
+int Way_table::emplace(Symbol id, std::vector<Coord> const& way_coords, std::uint64_t creation_number)
+{
+    // Calculate the total length according to the specification. std::floor rounds down to integers.
+    Distance length = 0;
+    for (std::vector<Coord>::size_type i = 0; i + 1 < way_coords.size(); ++i) {
+        double dx = way_coords[i].x - way_coords[i+1].x;
+        double dy = way_coords[i].y - way_coords[i+1].y;
+        int section_length = std::floor(std::sqrt(dx * dx + dy * dy));
+        length += section_length;
+    }
+
+    int slot;
+    if (free_slots.empty()) {
+        slot = ids.size();
+        ids.push_back(id);
+        end1.push_back(way_coords.front());
+        end2.push_back(way_coords.back());
+        lengths.push_back(length);
+        creation_numbers.push_back(creation_number);
+        coord_begin.push_back(coords.size());
+        coord_count.push_back(way_coords.size());
+    } else {
+        slot = free_slots.back();
+        free_slots.pop_back();
+        ids[slot] = id;
+        end1[slot] = way_coords.front();
+        end2[slot] = way_coords.back();
+        lengths[slot] = length;
+        creation_numbers[slot] = creation_number;
+        coord_begin[slot] = coords.size();
+        coord_count[slot] = way_coords.size();
+    }
+    coords.insert(coords.end(), way_coords.begin(), way_coords.end());
+    ++revision;
+    return slot;
+}
+
+void Way_table::release(int slot)
+{
+    ids[slot] = NO_SYMBOL;
+    released_coords += coord_count[slot];
+    coord_count[slot] = 0;
+    free_slots.push_back(slot);
+    ++revision;
+    if (released_coords > coords.size() / 2) {
+        compact();
+    }
+}
+
+void Way_table::reserve(std::size_t way_count)
+{
+    ids.reserve(way_count);
+    end1.reserve(way_count);
+    end2.reserve(way_count);
+    lengths.reserve(way_count);
+    creation_numbers.reserve(way_count);
+    coord_begin.reserve(way_count);
+    coord_count.reserve(way_count);
+}
+
+void Way_table::clear()
+{
+    ids.clear();
+    end1.clear();
+    end2.clear();
+    lengths.clear();
+    creation_numbers.clear();
+    coord_begin.clear();
+    coord_count.clear();
+    coords.clear();
+    free_slots.clear();
+    released_coords = 0;
+    ++revision;
+}
+
+void Way_table::compact()
+{
+    std::vector<Coord> live_coords = {};
+    live_coords.reserve(coords.size() - released_coords);
+    for (std::size_t slot = 0; slot != ids.size(); ++slot) {
+        std::uint32_t begin = live_coords.size();
+        live_coords.insert(live_coords.end(), coords.begin() + coord_begin[slot],
+                           coords.begin() + coord_begin[slot] + coord_count[slot]);
+        coord_begin[slot] = begin;
+    }
+    coords.swap(live_coords);
+    released_coords = 0;
+}
+
+void Way_grid::update(Way_table const& ways)
+{
+    if (built_ && revision_ == ways.revision) {
+        return;
+    }
+    cells_.clear();
+    large_slots_.clear();
+    boxes_.assign(ways.size(), {NO_COORD, NO_COORD});
+    bounds_ = {NO_COORD, NO_COORD};
+    built_ = true;
+    revision_ = ways.revision;
+
+    std::vector<long long> extents = {};
+    for (std::size_t slot = 0; slot != ways.size(); ++slot) {
+        if (ways.ids[slot] == NO_SYMBOL) {
+            continue;
+        }
+        Coord_span way_coords = ways.coords_of(slot);
+        Box box = {way_coords.front(), way_coords.front()};
+        for (Coord const& xy : way_coords) {
+            box.lower_left = {std::min(box.lower_left.x, xy.x), std::min(box.lower_left.y, xy.y)};
+            box.upper_right = {std::max(box.upper_right.x, xy.x), std::max(box.upper_right.y, xy.y)};
+        }
+        boxes_[slot] = box;
+        if (bounds_.lower_left == NO_COORD) {
+            bounds_ = box;
+        } else {
+            bounds_.lower_left = {std::min(bounds_.lower_left.x, box.lower_left.x), std::min(bounds_.lower_left.y, box.lower_left.y)};
+            bounds_.upper_right = {std::max(bounds_.upper_right.x, box.upper_right.x), std::max(bounds_.upper_right.y, box.upper_right.y)};
+        }
+        extents.push_back(std::max(static_cast<long long>(box.upper_right.x) - box.lower_left.x,
+                                   static_cast<long long>(box.upper_right.y) - box.lower_left.y));
+    }
+    if (extents.empty()) {
+        cell_size_ = 1;
+        return;
+    }
+
+    // Cells as large as the median way, but no smaller than what would give about one way per cell over the whole
+    // map, so that the cells of a view of the whole map can still be gone through quickly
+    std::nth_element(extents.begin(), extents.begin() + extents.size() / 2, extents.end());
+    long long span = std::max(static_cast<long long>(bounds_.upper_right.x) - bounds_.lower_left.x,
+                              static_cast<long long>(bounds_.upper_right.y) - bounds_.lower_left.y);
+    long long spread_size = span / std::max<long long>(1, static_cast<long long>(std::sqrt(static_cast<double>(extents.size()))));
+    cell_size_ = static_cast<int>(std::min<long long>(std::max({1LL, extents[extents.size() / 2], spread_size}),
+                                                      std::numeric_limits<int>::max() / 4));
+
+    for (std::size_t slot = 0; slot != boxes_.size(); ++slot) {
+        Box const& box = boxes_[slot];
+        if (box.lower_left == NO_COORD) {
+            continue;
+        }
+        int min_x = cell_of(box.lower_left.x);
+        int max_x = cell_of(box.upper_right.x);
+        int min_y = cell_of(box.lower_left.y);
+        int max_y = cell_of(box.upper_right.y);
+        if ((static_cast<long long>(max_x) - min_x + 1) * (static_cast<long long>(max_y) - min_y + 1) > MAX_WAY_CELLS) {
+            large_slots_.push_back(slot);
+            continue;
+        }
+        for (int cell_x = min_x; cell_x <= max_x; ++cell_x) {
+            for (int cell_y = min_y; cell_y <= max_y; ++cell_y) {
+                cells_[cell_key(cell_x, cell_y)].push_back(slot);
+            }
+        }
+    }
+}
+
+std::vector<int> Way_grid::slots_in_rect(Coord lower_left, Coord upper_right) const
+{
+    std::vector<int> found = {};
+    if (bounds_.lower_left == NO_COORD || upper_right.x < lower_left.x || upper_right.y < lower_left.y) {
+        return found;
+    }
+    int min_x = cell_of(std::max(lower_left.x, bounds_.lower_left.x));
+    int max_x = cell_of(std::min(upper_right.x, bounds_.upper_right.x));
+    int min_y = cell_of(std::max(lower_left.y, bounds_.lower_left.y));
+    int max_y = cell_of(std::min(upper_right.y, bounds_.upper_right.y));
+    if (max_x < min_x || max_y < min_y) {
+        return found;
+    }
+    // A view of most of the map covers more cells than there are ways in, then going through the ways is quicker
+    if ((static_cast<long long>(max_x) - min_x + 1) * (static_cast<long long>(max_y) - min_y + 1) > static_cast<long long>(cells_.size())) {
+        for (auto const& cell : cells_) {
+            found.insert(found.end(), cell.second.begin(), cell.second.end());
+        }
+    } else {
+        for (int cell_x = min_x; cell_x <= max_x; ++cell_x) {
+            for (int cell_y = min_y; cell_y <= max_y; ++cell_y) {
+                auto cell = cells_.find(cell_key(cell_x, cell_y));
+                if (cell != cells_.end()) {
+                    found.insert(found.end(), cell->second.begin(), cell->second.end());
+                }
+            }
+        }
+    }
+    found.insert(found.end(), large_slots_.begin(), large_slots_.end());
+
+    auto outside = [this, lower_left, upper_right](int slot) {
+        Box const& box = boxes_[slot];
+        return box.upper_right.x < lower_left.x || box.lower_left.x > upper_right.x ||
+               box.upper_right.y < lower_left.y || box.lower_left.y > upper_right.y;
+    };
+    found.erase(std::remove_if(found.begin(), found.end(), outside), found.end());
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    return found;
+}
+
+std::pair<Coord, Coord> Way_grid::bounds() const
+{
+    return {bounds_.lower_left, bounds_.upper_right};
+}
+
+void Way_grid::clear()
+{
+    cells_.clear();
+    large_slots_.clear();
+    boxes_.clear();
+    bounds_ = {NO_COORD, NO_COORD};
+    cell_size_ = 1;
+    built_ = false;
+}
+
+int Way_grid::cell_of(int value) const
+{
+    // Rounds towards negative infinity like Place_grid::cell_of()
+    return value >= 0 ? value / cell_size_ : -((-(value + 1)) / cell_size_) - 1;
+}
+
+long long Way_grid::cell_key(int cell_x, int cell_y)
+{
+    return (static_cast<long long>(cell_x) << 32) ^ static_cast<unsigned int>(cell_y);
+}
+
+void Disjoint_set::reset(std::size_t count)
+{
+    parent.resize(count);
+    std::iota(parent.begin(), parent.end(), 0);
+    rank.assign(count, 0);
+}
+
+int Disjoint_set::find(int node)
+{
+    int root = node;
+    while (parent[root] != root) {
+        root = parent[root];
+    }
+    // Path compression: point every node on the way directly to the root
+    while (parent[node] != root) {
+        int next = parent[node];
+        parent[node] = root;
+        node = next;
+    }
+    return root;
+}
+
+bool Disjoint_set::unite(int node1, int node2)
+{
+    int root1 = find(node1);
+    int root2 = find(node2);
+    if (root1 == root2) {
+        return false;
+    }
+    // Union by rank keeps the trees shallow
+    if (rank[root1] < rank[root2]) {
+        std::swap(root1, root2);
+    }
+    parent[root2] = root1;
+    if (rank[root1] == rank[root2]) {
+        ++rank[root1];
+    }
+    return true;
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Route_graph::route_any(Coord fromxy, Coord toxy, Search_scratch& scratch) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    auto from_it = node_of_coord.find(fromxy);
+    auto to_it = node_of_coord.find(toxy);
+    // Either of the coordinates has no ways
+    if (from_it == node_of_coord.end() || to_it == node_of_coord.end()) {
+        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    }
+    if (!connected(from_it->second, to_it->second)) {
+        return {};
+    }
+    return search_any(from_it->second, to_it->second, scratch);
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Route_graph::route_least_crossroads(Coord fromxy, Coord toxy, Search_scratch& scratch) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    auto from_it = node_of_coord.find(fromxy);
+    auto to_it = node_of_coord.find(toxy);
+    // Either of the coordinates has no ways
+    if (from_it == node_of_coord.end() || to_it == node_of_coord.end()) {
+        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    }
+    int start = from_it->second;
+    int goal = to_it->second;
+    if (!connected(start, goal)) {
+        return {};
+    }
+
+    scratch.start(node_coords.size());
+    scratch.reach(start, 0, -1, -1);
+    scratch.queue.push_back(start);
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    // The queue vector is only appended to, so the nodes before next are the already processed ones
+    for (std::vector<int>::size_type next = 0; next != scratch.queue.size() && !scratch.reached(goal); ++next) {
+        int current = scratch.queue[next];
+        expanded.add();
+        for (int e = offsets[current]; e != offsets[current + 1]; ++e) {
+            Graph_edge const& edge = edges[e];
+            if (scratch.reached(edge.neighbor)) {
+                continue;
+            }
+            scratch.reach(edge.neighbor, scratch.distance[current] + edge.length, current, e);
+            // A node is never reached with fewer crossroads than the first time, so we can stop at once
+            if (edge.neighbor == goal) {
+                break;
+            }
+            scratch.queue.push_back(edge.neighbor);
+        }
+    }
+
+    if (!scratch.reached(goal)) {
+        return {};
+    }
+    return route_from_scratch(goal, scratch);
+}
+
+std::vector<std::tuple<Coord, WayID>> Route_graph::route_with_cycle(Coord fromxy, Search_scratch& scratch) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    auto from_it = node_of_coord.find(fromxy);
+    // If cannot traverse from starting node
+    if (from_it == node_of_coord.end()) {
+        return {{NO_COORD, NO_WAY}};
+    }
+    return search_cycle(from_it->second, scratch);
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Route_graph::route_shortest_distance(Coord fromxy, Coord toxy, Search_scratch& scratch) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    auto from_it = node_of_coord.find(fromxy);
+    auto to_it = node_of_coord.find(toxy);
+    // Either of the coordinates has no ways
+    if (from_it == node_of_coord.end() || to_it == node_of_coord.end()) {
+        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    }
+    int start = from_it->second;
+    int goal = to_it->second;
+    if (!connected(start, goal)) {
+        return {};
+    }
+
+    // The length of a way is the sum of its floored sections, and every section between two different
+    // integer coordinates is at least 1 long, so a way is never shorter than half of the straight line
+    // between its ends. Half of the euclidean distance is therefore an admissible and consistent heuristic.
+    auto heuristic = [this, toxy](int node) {
+        Coord node_coord = node_coords[node];
+        return static_cast<Distance>(calculate_euclidean({node_coord.x - toxy.x, node_coord.y - toxy.y}) / 2);
+    };
+
+    // Heap entries are (estimated total, distance so far, node), smallest estimate on top
+    using Heap_entry = std::tuple<Distance, Distance, int>;
+    std::priority_queue<Heap_entry, std::vector<Heap_entry>, std::greater<Heap_entry>> open;
+    scratch.start(node_coords.size());
+    scratch.reach(start, 0, -1, -1);
+    open.push({heuristic(start), 0, start});
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    Stats_tally pushes(Stat::HEAP_PUSHES);
+    pushes.add();
+
+    while (!open.empty()) {
+        auto [estimate, current_distance, current] = open.top();
+        open.pop();
+        // Outdated entry, the node has been reached with a shorter distance since
+        if (current_distance != scratch.distance[current]) {
+            continue;
+        }
+        if (current == goal) {
+            break;
+        }
+        expanded.add();
+        for (int e = offsets[current]; e != offsets[current + 1]; ++e) {
+            Graph_edge const& edge = edges[e];
+            Distance new_distance = current_distance + edge.length;
+            if (!scratch.reached(edge.neighbor) || new_distance < scratch.distance[edge.neighbor]) {
+                scratch.reach(edge.neighbor, new_distance, current, e);
+                open.push({new_distance + heuristic(edge.neighbor), new_distance, edge.neighbor});
+                pushes.add();
+            }
+        }
+    }
+
+    if (!scratch.reached(goal)) {
+        return {};
+    }
+    return route_from_scratch(goal, scratch);
+}
+
+Distance_targets Route_graph::make_targets(std::vector<Coord> const& targets) const
+{
+    Distance_targets target_nodes;
+    target_nodes.nodes.reserve(targets.size());
+    target_nodes.is_target.assign(node_coords.size(), false);
+    for (Coord xy : targets) {
+        auto it = node_of_coord.find(xy);
+        int node = (it == node_of_coord.end()) ? -1 : it->second;
+        target_nodes.nodes.push_back(node);
+        if (node != -1 && !target_nodes.is_target[node]) {
+            target_nodes.is_target[node] = true;
+            target_nodes.components.push_back(component[node]);
+        }
+    }
+    return target_nodes;
+}
+
+void Route_graph::distances_from(Coord fromxy, Distance_targets const& targets, Search_scratch& scratch, Distance* row) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    std::fill(row, row + targets.nodes.size(), NO_DISTANCE);
+    auto from_it = node_of_coord.find(fromxy);
+    if (from_it == node_of_coord.end()) {
+        return;
+    }
+    int start = from_it->second;
+    // Only the targets in the component of the source can be settled, the search stops after the last of them
+    std::size_t unsettled_targets = std::count(targets.components.begin(), targets.components.end(), component[start]);
+    if (unsettled_targets == 0) {
+        return;
+    }
+
+    // Plain Dijkstra, as there is no single goal for a heuristic. Heap entries are (distance, node).
+    using Heap_entry = std::pair<Distance, int>;
+    std::priority_queue<Heap_entry, std::vector<Heap_entry>, std::greater<Heap_entry>> open;
+    scratch.start(node_coords.size());
+    scratch.reach(start, 0, -1, -1);
+    open.push({0, start});
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    Stats_tally pushes(Stat::HEAP_PUSHES);
+    pushes.add();
+
+    while (!open.empty()) {
+        auto [current_distance, current] = open.top();
+        open.pop();
+        // Outdated entry, the node has been reached with a shorter distance since
+        if (current_distance != scratch.distance[current]) {
+            continue;
+        }
+        // A node is settled when it is popped, so the distances of all targets are final once the last one is
+        if (targets.is_target[current] && --unsettled_targets == 0) {
+            break;
+        }
+        expanded.add();
+        for (int e = offsets[current]; e != offsets[current + 1]; ++e) {
+            Graph_edge const& edge = edges[e];
+            Distance new_distance = current_distance + edge.length;
+            if (!scratch.reached(edge.neighbor) || new_distance < scratch.distance[edge.neighbor]) {
+                scratch.reach(edge.neighbor, new_distance, current, e);
+                open.push({new_distance, edge.neighbor});
+                pushes.add();
+            }
+        }
+    }
+
+    // If the heap ran out first, every reachable node has been settled
+    for (std::size_t i = 0; i != targets.nodes.size(); ++i) {
+        int node = targets.nodes[i];
+        if (node != -1 && scratch.reached(node)) {
+            row[i] = scratch.distance[node];
+        }
+    }
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Route_graph::search_any(int start, int goal, Search_scratch& scratch) const
+{
+    scratch.start(node_coords.size());
+    scratch.stack.clear();
+    scratch.reach(start, 0, -1, -1);
+    scratch.stack.push_back({start, offsets[start] - 1});
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    expanded.add();
+
+    // DFS with an explicit stack, each frame continues from the edge after the one it explored last
+    while (!scratch.stack.empty()) {
+        Search_frame& frame = scratch.stack.back();
+        if (frame.node == goal) {
+            // The stack is the route, and the previous-links of the scratch follow it
+            return route_from_scratch(goal, scratch);
+        }
+        ++frame.edge;
+        if (frame.edge == offsets[frame.node + 1]) {
+            scratch.stack.pop_back();
+            continue;
+        }
+        Graph_edge const& edge = edges[frame.edge];
+        // If already visited no need to check
+        if (scratch.reached(edge.neighbor)) {
+            continue;
+        }
+        // Keep up the current total length of the route
+        scratch.reach(edge.neighbor, scratch.distance[frame.node] + edge.length, frame.node, frame.edge);
+        scratch.stack.push_back({edge.neighbor, offsets[edge.neighbor] - 1});
+        expanded.add();
+    }
+    return {};
+}
+
+std::vector<std::tuple<Coord, WayID>> Route_graph::search_cycle(int start, Search_scratch& scratch) const
+{
+    scratch.start(node_coords.size());
+    scratch.stack.clear();
+    scratch.reach(start, 0, -1, -1);
+    scratch.stack.push_back({start, offsets[start] - 1});
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    expanded.add();
+
+    while (!scratch.stack.empty()) {
+        Search_frame& frame = scratch.stack.back();
+        ++frame.edge;
+        if (frame.edge == offsets[frame.node + 1]) {
+            scratch.stack.pop_back();
+            continue;
+        }
+        Graph_edge const& edge = edges[frame.edge];
+        // Prevents from going straight backwards to the previous node
+        if (edge.neighbor == scratch.previous[frame.node]) {
+            continue;
+        }
+        // If the next node has been visited before, we have found a loop and the stack holds the route to it
+        if (scratch.reached(edge.neighbor)) {
+            std::vector<std::tuple<Coord, WayID>> route = {};
+            route.reserve(scratch.stack.size() + 1);
+            for (auto const& step : scratch.stack) {
+                route.push_back({node_coords[step.node], way_ids[edges[step.edge].way]});
+            }
+            // Add the finishing value to the vector with the cycle-node, NO_WAY
+            route.push_back({node_coords[edge.neighbor], NO_WAY});
+            return route;
+        }
+        scratch.reach(edge.neighbor, 0, frame.node, frame.edge);
+        scratch.stack.push_back({edge.neighbor, offsets[edge.neighbor] - 1});
+        expanded.add();
+    }
+    return {};
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Route_graph::route_from_scratch(int goal, Search_scratch const& scratch) const
+{
+    // Walk the route backwards from the goal and flip it to the correct order
+    std::vector<std::tuple<Coord, WayID, Distance>> route = {{node_coords[goal], NO_WAY, scratch.distance[goal]}};
+    for (int node = goal; scratch.previous[node] != -1; node = scratch.previous[node]) {
+        int from = scratch.previous[node];
+        route.push_back({node_coords[from], way_ids[edges[scratch.arrived_by[node]].way], scratch.distance[from]});
+    }
+    std::reverse(route.begin(), route.end());
+    return route;
+}
+
+// Contraction state of a Contraction_hierarchy under construction. links holds the shortest arc between every pair of
+// neighbors that have not been contracted yet; when a node is contracted its links become its upward links.
+struct Hierarchy_builder {
+    // A witness search gives up after settling this many nodes, and a shortcut is added to be safe
+    static constexpr int WITNESS_SETTLE_LIMIT = 64;
+    // The contraction stops when the remaining nodes have more links than this on average
+    static constexpr std::size_t CORE_AVERAGE_DEGREE = 16;
+
+    std::vector<Hierarchy_arc>& arcs;
+    std::vector<std::vector<Hierarchy_link>> links;
+    std::vector<int> contracted_neighbors;
+    std::size_t link_count = 0;
+    Search_scratch witness;
+    std::vector<std::pair<Distance, int>> heap;
+
+    Hierarchy_builder(std::vector<Hierarchy_arc>& hierarchy_arcs, std::size_t node_count):
+        arcs(hierarchy_arcs), links(node_count), contracted_neighbors(node_count, 0)
+    {
+    }
+
+    // Adds the arc unless its ends are already linked at most as short, returns true if it was added
+    bool add_arc(Hierarchy_arc const& arc)
+    {
+        auto& links1 = links[arc.end1];
+        auto existing = std::find_if(links1.begin(), links1.end(),
+                                     [&arc](Hierarchy_link const& link) { return link.neighbor == arc.end2; });
+        if (existing != links1.end() && existing->length <= arc.length) {
+            return false;
+        }
+        int arc_id = static_cast<int>(arcs.size());
+        arcs.push_back(arc);
+        if (existing != links1.end()) {
+            // Replace the longer arc at both ends
+            existing->arc = arc_id;
+            existing->length = arc.length;
+            for (auto& link : links[arc.end2]) {
+                if (link.neighbor == arc.end1) {
+                    link.arc = arc_id;
+                    link.length = arc.length;
+                }
+            }
+        } else {
+            links1.push_back({arc.end2, arc_id, arc.length});
+            links[arc.end2].push_back({arc.end1, arc_id, arc.length});
+            link_count += 2;
+        }
+        return true;
+    }
+
+    // Dijkstra from source over the uncontracted nodes except excluded, up to the distance limit or the settle limit
+    void witness_search(int source, int excluded, Distance limit)
+    {
+        witness.start(links.size());
+        witness.reach(source, 0, -1, -1);
+        heap.clear();
+        heap.push_back({0, source});
+        int settled = 0;
+        while (!heap.empty() && settled != WITNESS_SETTLE_LIMIT) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<std::pair<Distance, int>>());
+            auto [current_distance, current] = heap.back();
+            heap.pop_back();
+            if (current_distance != witness.distance[current]) {
+                continue;
+            }
+            if (current_distance > limit) {
+                break;
+            }
+            ++settled;
+            for (auto const& link : links[current]) {
+                Distance new_distance = current_distance + link.length;
+                if (link.neighbor != excluded && (!witness.reached(link.neighbor) || new_distance < witness.distance[link.neighbor])) {
+                    witness.reach(link.neighbor, new_distance, current, -1);
+                    heap.push_back({new_distance, link.neighbor});
+                    std::push_heap(heap.begin(), heap.end(), std::greater<std::pair<Distance, int>>());
+                }
+            }
+        }
+    }
+
+    // The amount of shortcuts contracting the node needs, which are also added if apply is true
+    int shortcuts_needed(int node, bool apply)
+    {
+        int shortcuts = 0;
+        // Adding the shortcuts only changes the links of the neighbors, so these stay valid
+        auto const& around = links[node];
+        for (std::size_t i = 0; i + 1 < around.size(); ++i) {
+            Distance longest_next = 0;
+            for (std::size_t j = i + 1; j != around.size(); ++j) {
+                longest_next = std::max(longest_next, around[j].length);
+            }
+            witness_search(around[i].neighbor, node, around[i].length + longest_next);
+            for (std::size_t j = i + 1; j != around.size(); ++j) {
+                Distance via_node = around[i].length + around[j].length;
+                int other = around[j].neighbor;
+                // A route at most as short that avoids the node makes the shortcut unnecessary
+                if (witness.reached(other) && witness.distance[other] <= via_node) {
+                    continue;
+                }
+                ++shortcuts;
+                if (apply) {
+                    add_arc({around[i].neighbor, other, via_node, -1, node, around[i].arc, around[j].arc});
+                }
+            }
+        }
+        return shortcuts;
+    }
+
+    // Edge difference plus the amount of already contracted neighbors, which spreads the contraction evenly
+    int priority(int node)
+    {
+        return shortcuts_needed(node, false) - static_cast<int>(links[node].size()) + contracted_neighbors[node];
+    }
+
+    // Contracts the node and returns its links, which all lead to nodes contracted later
+    std::vector<Hierarchy_link> contract(int node)
+    {
+        shortcuts_needed(node, true);
+        std::vector<Hierarchy_link> up = std::move(links[node]);
+        links[node].clear();
+        for (auto const& link : up) {
+            auto& neighbor_links = links[link.neighbor];
+            for (std::size_t i = 0; i != neighbor_links.size(); ++i) {
+                if (neighbor_links[i].neighbor == node) {
+                    neighbor_links[i] = neighbor_links.back();
+                    neighbor_links.pop_back();
+                    break;
+                }
+            }
+            ++contracted_neighbors[link.neighbor];
+        }
+        link_count -= 2 * up.size();
+        return up;
+    }
+};
+
+Contraction_hierarchy::Contraction_hierarchy(std::shared_ptr<Route_graph const> route_graph):
+    graph(std::move(route_graph))
+{
+    std::size_t node_count = graph->node_coords.size();
+    Hierarchy_builder builder(arcs, node_count);
+    // The original arcs are the shortest way between each pair of crossroads, the loops are never on a shortest route
+    for (std::size_t node = 0; node != node_count; ++node) {
+        for (int e = graph->offsets[node]; e != graph->offsets[node + 1]; ++e) {
+            Graph_edge const& edge = graph->edges[e];
+            if (edge.neighbor > static_cast<int>(node)) {
+                builder.add_arc({static_cast<int>(node), edge.neighbor, edge.length, edge.way, -1, -1, -1});
+            }
+        }
+    }
+    std::size_t original_arcs = arcs.size();
+
+    // Lazy updates: a popped node whose priority has grown past the next one is put back instead of contracted
+    using Priority_entry = std::pair<int, int>;
+    std::priority_queue<Priority_entry, std::vector<Priority_entry>, std::greater<Priority_entry>> order;
+    for (std::size_t node = 0; node != node_count; ++node) {
+        order.push({builder.priority(static_cast<int>(node)), static_cast<int>(node)});
+    }
+    std::vector<std::vector<Hierarchy_link>> up(node_count);
+    std::vector<char> contracted(node_count, false);
+    node_at.reserve(node_count);
+    std::size_t remaining = node_count;
+    while (!order.empty() && builder.link_count <= remaining * Hierarchy_builder::CORE_AVERAGE_DEGREE) {
+        int node = order.top().second;
+        order.pop();
+        if (contracted[node]) {
+            continue;
+        }
+        int current_priority = builder.priority(node);
+        if (!order.empty() && current_priority > order.top().first) {
+            order.push({current_priority, node});
+            continue;
+        }
+        up[node] = builder.contract(node);
+        contracted[node] = true;
+        node_at.push_back(node);
+        --remaining;
+    }
+    // The links left between the core nodes lead up from both of their ends
+    for (std::size_t node = 0; node != node_count; ++node) {
+        if (!contracted[node]) {
+            up[node] = std::move(builder.links[node]);
+            node_at.push_back(node);
+        }
+    }
+    shortcut_count = arcs.size() - original_arcs;
+    core_size = remaining;
+
+    // Renumber the nodes in the order they were contracted. The searches only go up, so they stay within the
+    // last part of the numbers and touch much less memory than with the original numbers.
+    rank.assign(node_count, 0);
+    for (std::size_t position = 0; position != node_count; ++position) {
+        rank[node_at[position]] = static_cast<int>(position);
+    }
+    for (auto& arc : arcs) {
+        arc.end1 = rank[arc.end1];
+        arc.end2 = rank[arc.end2];
+        if (arc.way == -1) {
+            arc.middle = rank[arc.middle];
+        }
+    }
+    up_offsets.assign(node_count + 1, 0);
+    for (std::size_t position = 0; position != node_count; ++position) {
+        up_offsets[position + 1] = up_offsets[position] + static_cast<int>(up[node_at[position]].size());
+    }
+    up_links.reserve(up_offsets[node_count]);
+    for (int node : node_at) {
+        for (auto link : up[node]) {
+            link.neighbor = rank[link.neighbor];
+            up_links.push_back(link);
+        }
+    }
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Contraction_hierarchy::route_shortest_distance(Coord fromxy, Coord toxy,
+                                                                                              Search_scratch& forward, Search_scratch& backward) const
+{
+    stats_add(Stat::ROUTE_QUERIES);
+    auto from_it = graph->node_of_coord.find(fromxy);
+    auto to_it = graph->node_of_coord.find(toxy);
+    // Either of the coordinates has no ways
+    if (from_it == graph->node_of_coord.end() || to_it == graph->node_of_coord.end()) {
+        return {{NO_COORD, NO_WAY, NO_DISTANCE}};
+    }
+    if (!graph->connected(from_it->second, to_it->second)) {
+        return {};
+    }
+    int start = rank[from_it->second];
+    int goal = rank[to_it->second];
+
+    // Heap entries are (distance, node). The arrived_by of the scratches are arc ids.
+    using Heap_entry = std::pair<Distance, int>;
+    using Heap = std::priority_queue<Heap_entry, std::vector<Heap_entry>, std::greater<Heap_entry>>;
+    Heap forward_open;
+    Heap backward_open;
+    forward.start(graph->node_coords.size());
+    backward.start(graph->node_coords.size());
+    forward.reach(start, 0, -1, -1);
+    backward.reach(goal, 0, -1, -1);
+    forward_open.push({0, start});
+    backward_open.push({0, goal});
+    Stats_tally expanded(Stat::NODES_EXPANDED);
+    Stats_tally pushes(Stat::HEAP_PUSHES);
+    pushes.add(2);
+
+    Distance best = std::numeric_limits<Distance>::max();
+    int meeting = -1;
+    while (true) {
+        // A direction is finished when it cannot reach a meeting point shorter than the best one anymore
+        bool forward_done = forward_open.empty() || forward_open.top().first >= best;
+        bool backward_done = backward_open.empty() || backward_open.top().first >= best;
+        if (forward_done && backward_done) {
+            break;
+        }
+        // Take the next node from the direction with the smaller distance
+        bool use_forward = !forward_done && (backward_done || forward_open.top().first <= backward_open.top().first);
+        Heap& open = use_forward ? forward_open : backward_open;
+        Search_scratch& self = use_forward ? forward : backward;
+        Search_scratch const& other = use_forward ? backward : forward;
+
+        auto [current_distance, current] = open.top();
+        open.pop();
+        // Outdated entry, the node has been reached with a shorter distance since
+        if (current_distance != self.distance[current]) {
+            continue;
+        }
+        if (other.reached(current) && current_distance + other.distance[current] < best) {
+            best = current_distance + other.distance[current];
+            meeting = current;
+        }
+        // Stall on demand: if a node above is already known to be closer through this link, the node is not on a
+        // shortest upward route and the search does not have to continue from it
+        bool stalled = false;
+        for (int l = up_offsets[current]; l != up_offsets[current + 1] && !stalled; ++l) {
+            Hierarchy_link const& link = up_links[l];
+            stalled = self.reached(link.neighbor) && self.distance[link.neighbor] + link.length < current_distance;
+        }
+        if (stalled) {
+            continue;
+        }
+        expanded.add();
+        for (int l = up_offsets[current]; l != up_offsets[current + 1]; ++l) {
+            Hierarchy_link const& link = up_links[l];
+            Distance new_distance = current_distance + link.length;
+            if (!self.reached(link.neighbor) || new_distance < self.distance[link.neighbor]) {
+                self.reach(link.neighbor, new_distance, current, link.arc);
+                open.push({new_distance, link.neighbor});
+                pushes.add();
+            }
+        }
+    }
+    if (meeting == -1) {
+        return {};
+    }
+
+    // The arcs of the route in order from the start, each with the node it is traversed from
+    std::vector<std::pair<int, int>> route_arcs = {};
+    for (int node = meeting; forward.previous[node] != -1; node = forward.previous[node]) {
+        route_arcs.push_back({forward.arrived_by[node], forward.previous[node]});
+    }
+    std::reverse(route_arcs.begin(), route_arcs.end());
+    for (int node = meeting; backward.previous[node] != -1; node = backward.previous[node]) {
+        route_arcs.push_back({backward.arrived_by[node], node});
+    }
+
+    // Unpack the shortcuts depth first, so that the ways come out in the order of the route
+    std::vector<std::tuple<Coord, WayID, Distance>> route = {};
+    Distance distance = 0;
+    std::vector<std::pair<int, int>> unpack_stack = {};
+    for (auto const& route_arc : route_arcs) {
+        unpack_stack.push_back(route_arc);
+        while (!unpack_stack.empty()) {
+            auto [arc_id, from] = unpack_stack.back();
+            unpack_stack.pop_back();
+            Hierarchy_arc const& arc = arcs[arc_id];
+            if (arc.way != -1) {
+                route.push_back({graph->node_coords[node_at[from]], graph->way_ids[arc.way], distance});
+                distance += arc.length;
+            } else if (from == arc.end1) {
+                unpack_stack.push_back({arc.second, arc.middle});
+                unpack_stack.push_back({arc.first, arc.end1});
+            } else {
+                unpack_stack.push_back({arc.first, arc.middle});
+                unpack_stack.push_back({arc.second, arc.end2});
+            }
+        }
+    }
+    route.push_back({graph->node_coords[node_at[goal]], NO_WAY, distance});
+    return route;
+}
+
+void Place_grid::insert(PlaceID id, Coord xy)
+{
+    ++count_;
+    add_to_cell({xy, id});
+    // A place far outside the others would leave the cells too small for the area they now cover
+    if (count_ > 2 * built_count_ || box_cells() > 4 * built_box_cells_) {
+        rebuild();
+    }
+}
+
+void Place_grid::insert_many(std::vector<Entry> const& entries)
+{
+    count_ += entries.size();
+    for (auto const& entry : entries) {
+        add_to_cell(entry);
+    }
+    if (count_ > 2 * built_count_ || box_cells() > 4 * built_box_cells_) {
+        rebuild();
+    }
+}
+
+void Place_grid::erase(PlaceID id, Coord xy)
+{
+    auto cell = cells_.find(cell_key(cell_of(xy.x), cell_of(xy.y)));
+    if (cell == cells_.end()) {
+        return;
+    }
+    auto& places = cell->second;
+    auto found = std::find_if(places.begin(), places.end(), [id](Entry const& entry) { return entry.id == id; });
+    if (found == places.end()) {
+        return;
+    }
+    // Order inside a cell does not matter, so swap the last one in its place
+    *found = places.back();
+    places.pop_back();
+    if (places.empty()) {
+        cells_.erase(cell);
+    }
+    --count_;
+    if (count_ * 4 < built_count_) {
+        rebuild();
+    }
+}
+
+void Place_grid::clear()
+{
+    cells_.clear();
+    cell_size_ = 1;
+    count_ = 0;
+    built_count_ = 0;
+    built_box_cells_ = 0;
+}
+
+std::vector<PlaceID> Place_grid::nearest(Coord xy, std::size_t k) const
+{
+    if (count_ == 0 || k == 0) {
+        return {};
+    }
+    auto squared_distance = [xy](Entry const& place) {
+        long long dx = static_cast<long long>(place.coordinates.x) - xy.x;
+        long long dy = static_cast<long long>(place.coordinates.y) - xy.y;
+        return dx * dx + dy * dy;
+    };
+    auto closer = [&squared_distance](Entry const& place1, Entry const& place2) {
+        auto distance1 = squared_distance(place1);
+        auto distance2 = squared_distance(place2);
+        if (distance1 != distance2) { return distance1 < distance2; }
+        if (place1.coordinates.y != place2.coordinates.y) { return place1.coordinates.y < place2.coordinates.y; }
+        return place1.id < place2.id;
+    };
+
+    int center_x = cell_of(xy.x);
+    int center_y = cell_of(xy.y);
+    // Rings closer than the bounding box are empty, and beyond the furthest corner there is nothing left
+    int first_ring = std::max({0, min_cell_x_ - center_x, center_x - max_cell_x_, min_cell_y_ - center_y, center_y - max_cell_y_});
+    int last_ring = std::max({center_x - min_cell_x_, max_cell_x_ - center_x, center_y - min_cell_y_, max_cell_y_ - center_y});
+
+    std::vector<Entry> found = {};
+    // Ring ring has at most 8 * ring cells. Once the rings would have looked up more cells than there are
+    // non-empty ones, going through all of the places is quicker.
+    double cells_looked_up = 0;
+    for (int ring = first_ring; ring <= last_ring; ++ring) {
+        cells_looked_up += (ring == 0) ? 1.0 : 8.0 * ring;
+        if (cells_looked_up > static_cast<double>(cells_.size())) {
+            found.clear();
+            for (auto const& cell : cells_) {
+                found.insert(found.end(), cell.second.begin(), cell.second.end());
+            }
+            break;
+        }
+        if (ring == 0) {
+            collect(center_x, center_x, center_y, center_y, found);
+        } else {
+            // Top and bottom rows of the ring, then the columns between them
+            collect(center_x - ring, center_x + ring, center_y - ring, center_y - ring, found);
+            collect(center_x - ring, center_x + ring, center_y + ring, center_y + ring, found);
+            collect(center_x - ring, center_x - ring, center_y - ring + 1, center_y + ring - 1, found);
+            collect(center_x + ring, center_x + ring, center_y - ring + 1, center_y + ring - 1, found);
+        }
+        if (found.size() >= k) {
+            std::nth_element(found.begin(), found.begin() + (k - 1), found.end(), closer);
+            // Every place in the next ring is at least ring * cell_size_ away from xy
+            long long next_ring_distance = static_cast<long long>(ring) * cell_size_;
+            if (squared_distance(found[k - 1]) <= next_ring_distance * next_ring_distance) {
+                break;
+            }
+        }
+    }
+
+    auto result_size = std::min(k, found.size());
+    std::partial_sort(found.begin(), found.begin() + result_size, found.end(), closer);
+    std::vector<PlaceID> closest = {};
+    closest.reserve(result_size);
+    for (std::size_t i = 0; i != result_size; ++i) {
+        closest.push_back(found[i].id);
+    }
+    return closest;
+}
+
+std::vector<PlaceID> Place_grid::within_radius(Coord xy, Distance radius) const
+{
+    if (count_ == 0 || radius < 0) {
+        return {};
+    }
+    long long radius_squared = static_cast<long long>(radius) * radius;
+    // The bounding square of the circle, kept within the range of int
+    auto clamped = [](long long value) {
+        return static_cast<int>(std::min<long long>(std::max<long long>(value, std::numeric_limits<int>::min()),
+                                                    std::numeric_limits<int>::max()));
+    };
+    int min_x = std::max(cell_of(clamped(static_cast<long long>(xy.x) - radius)), min_cell_x_);
+    int max_x = std::min(cell_of(clamped(static_cast<long long>(xy.x) + radius)), max_cell_x_);
+    int min_y = std::max(cell_of(clamped(static_cast<long long>(xy.y) - radius)), min_cell_y_);
+    int max_y = std::min(cell_of(clamped(static_cast<long long>(xy.y) + radius)), max_cell_y_);
+    if (max_x < min_x || max_y < min_y) {
+        return {};
+    }
+    std::vector<Entry> found = {};
+    // A circle covering more cells than there are places in goes through the places instead
+    if ((static_cast<long long>(max_x) - min_x + 1) * (static_cast<long long>(max_y) - min_y + 1) > static_cast<long long>(cells_.size())) {
+        for (auto const& cell : cells_) {
+            found.insert(found.end(), cell.second.begin(), cell.second.end());
+        }
+    } else {
+        collect(min_x, max_x, min_y, max_y, found);
+    }
+
+    std::vector<std::pair<std::tuple<long long, int, PlaceID>, PlaceID>> inside = {};
+    for (auto const& place : found) {
+        long long dx = static_cast<long long>(place.coordinates.x) - xy.x;
+        long long dy = static_cast<long long>(place.coordinates.y) - xy.y;
+        if (dx * dx + dy * dy <= radius_squared) {
+            inside.push_back({{dx * dx + dy * dy, place.coordinates.y, place.id}, place.id});
+        }
+    }
+    std::sort(inside.begin(), inside.end());
+    std::vector<PlaceID> result = {};
+    result.reserve(inside.size());
+    for (auto const& place : inside) {
+        result.push_back(place.second);
+    }
+    return result;
+}
+
+std::vector<PlaceID> Place_grid::within_rect(Coord lower_left, Coord upper_right) const
+{
+    std::vector<PlaceID> result = {};
+    if (count_ == 0 || upper_right.x < lower_left.x || upper_right.y < lower_left.y) {
+        return result;
+    }
+    int min_x = std::max(cell_of(lower_left.x), min_cell_x_);
+    int max_x = std::min(cell_of(upper_right.x), max_cell_x_);
+    int min_y = std::max(cell_of(lower_left.y), min_cell_y_);
+    int max_y = std::min(cell_of(upper_right.y), max_cell_y_);
+    if (max_x < min_x || max_y < min_y) {
+        return result;
+    }
+    auto add_inside = [&result, lower_left, upper_right](std::vector<Entry> const& places) {
+        for (auto const& place : places) {
+            if (place.coordinates.x >= lower_left.x && place.coordinates.x <= upper_right.x &&
+                place.coordinates.y >= lower_left.y && place.coordinates.y <= upper_right.y) {
+                result.push_back(place.id);
+            }
+        }
+    };
+    // A rectangle covering more cells than there are places in goes through the places instead
+    if ((static_cast<long long>(max_x) - min_x + 1) * (static_cast<long long>(max_y) - min_y + 1) > static_cast<long long>(cells_.size())) {
+        for (auto const& cell : cells_) {
+            add_inside(cell.second);
+        }
+        return result;
+    }
+    for (int cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        for (int cell_y = min_y; cell_y <= max_y; ++cell_y) {
+            auto cell = cells_.find(cell_key(cell_x, cell_y));
+            if (cell != cells_.end()) {
+                add_inside(cell->second);
+            }
+        }
+    }
+    return result;
+}
+
+std::pair<Coord, Coord> Place_grid::bounds() const
+{
+    if (count_ == 0) {
+        return {NO_COORD, NO_COORD};
+    }
+    auto clamped = [](long long value) {
+        return static_cast<int>(std::min<long long>(std::max<long long>(value, std::numeric_limits<int>::min()),
+                                                    std::numeric_limits<int>::max()));
+    };
+    return {{clamped(static_cast<long long>(min_cell_x_) * cell_size_), clamped(static_cast<long long>(min_cell_y_) * cell_size_)},
+            {clamped((static_cast<long long>(max_cell_x_) + 1) * cell_size_ - 1), clamped((static_cast<long long>(max_cell_y_) + 1) * cell_size_ - 1)}};
+}
+
+int Place_grid::cell_of(int value) const
+{
+    // Rounds towards negative infinity so that the cells of negative coordinates are as large as the others
+    return value >= 0 ? value / cell_size_ : -((-(value + 1)) / cell_size_) - 1;
+}
+
+double Place_grid::box_cells() const
+{
+    if (cells_.empty()) {
+        return 0;
+    }
+    // In double, as the box of int coordinates with cells of size 1 has up to 2^64 cells
+    return (static_cast<double>(max_cell_x_) - min_cell_x_ + 1) * (static_cast<double>(max_cell_y_) - min_cell_y_ + 1);
+}
+
+long long Place_grid::cell_key(int cell_x, int cell_y)
+{
+    return (static_cast<long long>(cell_x) << 32) ^ static_cast<unsigned int>(cell_y);
+}
+
+void Place_grid::add_to_cell(Entry const& entry)
+{
+    int cell_x = cell_of(entry.coordinates.x);
+    int cell_y = cell_of(entry.coordinates.y);
+    if (cells_.empty()) {
+        min_cell_x_ = max_cell_x_ = cell_x;
+        min_cell_y_ = max_cell_y_ = cell_y;
+    } else {
+        min_cell_x_ = std::min(min_cell_x_, cell_x);
+        max_cell_x_ = std::max(max_cell_x_, cell_x);
+        min_cell_y_ = std::min(min_cell_y_, cell_y);
+        max_cell_y_ = std::max(max_cell_y_, cell_y);
+    }
+    cells_[cell_key(cell_x, cell_y)].push_back(entry);
+}
+
+void Place_grid::rebuild()
+{
+    std::vector<Entry> places = {};
+    places.reserve(count_);
+    Coord min = {std::numeric_limits<int>::max(), std::numeric_limits<int>::max()};
+    Coord max = {std::numeric_limits<int>::min(), std::numeric_limits<int>::min()};
+    for (auto& cell : cells_) {
+        for (auto const& place : cell.second) {
+            min = {std::min(min.x, place.coordinates.x), std::min(min.y, place.coordinates.y)};
+            max = {std::max(max.x, place.coordinates.x), std::max(max.y, place.coordinates.y)};
+            places.push_back(place);
+        }
+    }
+    cells_.clear();
+    built_count_ = places.size();
+    built_box_cells_ = 0;
+    if (places.empty()) {
+        cell_size_ = 1;
+        return;
+    }
+
+    // Aim for about two places per cell over the area the places cover
+    double width = static_cast<double>(max.x) - min.x + 1;
+    double height = static_cast<double>(max.y) - min.y + 1;
+    double cell_size = std::sqrt(2 * width * height / places.size());
+    cell_size_ = static_cast<int>(std::min(std::max(cell_size, 1.0), static_cast<double>(std::numeric_limits<int>::max() / 4)));
+    cells_.reserve(places.size());
+    for (auto const& place : places) {
+        add_to_cell(place);
+    }
+    built_box_cells_ = box_cells();
+}
+
+void Place_grid::collect(int min_x, int max_x, int min_y, int max_y, std::vector<Entry>& found) const
+{
+    min_x = std::max(min_x, min_cell_x_);
+    max_x = std::min(max_x, max_cell_x_);
+    min_y = std::max(min_y, min_cell_y_);
+    max_y = std::min(max_y, max_cell_y_);
+    for (int cell_x = min_x; cell_x <= max_x; ++cell_x) {
+        for (int cell_y = min_y; cell_y <= max_y; ++cell_y) {
+            auto cell = cells_.find(cell_key(cell_x, cell_y));
+            if (cell != cells_.end()) {
+                found.insert(found.end(), cell->second.begin(), cell->second.end());
+            }
+        }
+    }
+}
+
+Symbol Symbol_table::intern(std::string const& text)
+{
+    auto entry = symbols_.find(text);
+    if (entry != symbols_.end()) {
+        return entry->second;
+    }
+    Symbol symbol = static_cast<Symbol>(texts_.size());
+    texts_.push_back(text);
+    symbols_.insert({texts_.back(), symbol});
+    return symbol;
+}
+
+Symbol Symbol_table::find(std::string const& text) const
+{
+    auto entry = symbols_.find(text);
+    if (entry == symbols_.end()) {
+        return NO_SYMBOL;
+    }
+    return entry->second;
+}
+
+void Symbol_table::clear()
+{
+    symbols_.clear();
+    texts_.clear();
+}
+
+void Substring_index::update(Symbol_table const& table)
+{
+    if (text_count_ == table.size()) {
+        return;
+    }
+    // The table only grows, so only the suffixes of the new texts have to be sorted and merged with the old ones
+    std::size_t old_suffix_count = suffixes_.size();
+    for (; text_count_ != table.size(); ++text_count_) {
+        Symbol symbol = static_cast<Symbol>(text_count_);
+        for (std::size_t i = 0; i != table.text(symbol).size(); ++i) {
+            suffixes_.push_back({static_cast<int>(text_.size() + i), symbol});
+        }
+        text_ += table.text(symbol);
+        text_.push_back('\0');
+    }
+    char const* text = text_.data();
+    auto suffix_less = [text](Suffix const& suffix1, Suffix const& suffix2) {
+        return std::strcmp(text + suffix1.position, text + suffix2.position) < 0;
+    };
+    std::sort(suffixes_.begin() + old_suffix_count, suffixes_.end(), suffix_less);
+    std::inplace_merge(suffixes_.begin(), suffixes_.begin() + old_suffix_count, suffixes_.end(), suffix_less);
+}
+
+std::pair<std::size_t, std::size_t> Substring_index::match_range(std::string_view part) const
+{
+    char const* text = text_.data();
+    // Compares only the first characters of the suffix, as many as the part has
+    auto compare = [text, part](Suffix const& suffix) { return std::strncmp(text + suffix.position, part.data(), part.size()); };
+    auto first = std::partition_point(suffixes_.begin(), suffixes_.end(), [&compare](Suffix const& suffix) { return compare(suffix) < 0; });
+    auto last = std::partition_point(first, suffixes_.end(), [&compare](Suffix const& suffix) { return compare(suffix) == 0; });
+    return {first - suffixes_.begin(), last - suffixes_.begin()};
+}
+
+void Substring_index::clear()
+{
+    text_.clear();
+    text_count_ = 0;
+    suffixes_.clear();
+}
+
+Query_snapshot::Query_snapshot(std::uint64_t epoch, std::shared_ptr<Route_graph const> routes,
+                               std::shared_ptr<Contraction_hierarchy const> hierarchy, std::shared_ptr<Place_snapshot const> places):
+    epoch_(epoch),
+    routes_(std::move(routes)),
+    hierarchy_(std::move(hierarchy)),
+    places_(std::move(places))
+{
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Query_snapshot::route_any(Coord fromxy, Coord toxy) const
+{
+    return routes_->route_any(fromxy, toxy, thread_search_scratch());
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Query_snapshot::route_least_crossroads(Coord fromxy, Coord toxy) const
+{
+    return routes_->route_least_crossroads(fromxy, toxy, thread_search_scratch());
+}
+
+std::vector<std::tuple<Coord, WayID>> Query_snapshot::route_with_cycle(Coord fromxy) const
+{
+    return routes_->route_with_cycle(fromxy, thread_search_scratch());
+}
+
+std::vector<std::tuple<Coord, WayID, Distance>> Query_snapshot::route_shortest_distance(Coord fromxy, Coord toxy) const
+{
+    if (hierarchy_ != nullptr) {
+        return hierarchy_->route_shortest_distance(fromxy, toxy, thread_search_scratch(), thread_backward_search_scratch());
+    }
+    return routes_->route_shortest_distance(fromxy, toxy, thread_search_scratch());
+}
+
+std::vector<PlaceID> Query_snapshot::places_closest_to(Coord xy, PlaceType type) const
+{
+    return places_k_nearest(xy, type, 3);
+}
+
+std::vector<PlaceID> Query_snapshot::places_k_nearest(Coord xy, PlaceType type, std::size_t k) const
+{
+    return places_->grids[static_cast<int>(type)].nearest(xy, k);
+}
+
+std::vector<PlaceID> Query_snapshot::places_within_radius(Coord xy, PlaceType type, Distance radius) const
+{
+    return places_->grids[static_cast<int>(type)].within_radius(xy, radius);
+}
+
+std::vector<PlaceID> Query_snapshot::find_places_name(Name const& name) const
+{
+    auto bucket = places_->ids_by_name.find(name);
+    if (bucket == places_->ids_by_name.end()) {
+        return {};
+    }
+    return bucket->second;
+}
+
+std::vector<PlaceID> Query_snapshot::find_places_type(PlaceType type) const
+{
+    return places_->ids_by_type[static_cast<int>(type)];
 }
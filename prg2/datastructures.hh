@@ -11,10 +11,21 @@
 #include <functional>
 #include <unordered_map>
 #include <map>
+#include <set>
 #include <memory>
 #include <math.h>
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string_view>
+// Only available when building with Qt, the headless benchmark (bench/bench.pro) builds without it
+#ifdef QT_CORE_LIB
 #include <QDebug>
+#endif
+#include "flat_hash_map.hh"
+#include "thread_pool.hh"
+#include "stats.hh"
 
 // Types for IDs
 using PlaceID = long long int;
@@ -22,6 +33,9 @@ using AreaID = long long int;
 using Name = std::string;
 using WayID = std::string;
 
+// Interned Name or WayID, see Symbol_table
+using Symbol = std::uint32_t;
+
 // Return values for cases where required thing was not found
 PlaceID const NO_PLACE = -1;
 AreaID const NO_AREA = -1;
@@ -33,6 +47,12 @@ int const NO_VALUE = std::numeric_limits<int>::min();
 // Return value for cases where name values were not found
 Name const NO_NAME = "!!NO_NAME!!";
 
+// Slot index used for "no element" inside the Slab storages
+int const NO_SLOT = -1;
+
+// Return value of Symbol_table::find() for strings that have not been interned
+Symbol const NO_SYMBOL = std::numeric_limits<Symbol>::max();
+
 // Enumeration for different place types
 // !!Note since this is a C++11 "scoped enumeration", you'll have to refer to
 // individual values as PlaceType::SHELTER etc.
@@ -41,6 +61,12 @@ enum class PlaceType { OTHER=0, FIREPIT, SHELTER, PARKING, PEAK, BAY, AREA, NO_T
 // Type for a distance (in metres)
 using Distance = int;
 
+// Called with each id of a paged result in turn, returning false stops the paging early.
+// The visitor may query the data structures but must not change them.
+using Place_visitor = std::function<bool(PlaceID)>;
+using Area_visitor = std::function<bool(AreaID)>;
+using Way_visitor = std::function<bool(WayID const&)>;
+
 // Return value for cases where Duration is unknown
 Distance const NO_DISTANCE = NO_VALUE;
 
@@ -51,66 +77,107 @@ struct Coord
     int y = NO_VALUE;
 };
 
-// Type to store the data of each Place
-struct Place {
-    Place(PlaceID id, Name const& name, PlaceType type, Coord coordinates):
-        id(id), name(name), type(type), coordinates(coordinates)
-
-    {}
-    PlaceID id;
-    Name name;
-    PlaceType type;
-    Coord coordinates;
-};
 
 // Type to store the data of each Area
 struct Area {
-    Area(AreaID id, Name const& name, std::vector<Coord> coordinates):
-        id(id), name(name), coordinates(coordinates), parent_area(nullptr), subareas({})
+    Area(AreaID id, Symbol name, std::vector<Coord> coordinates):
+        id(id), name(name), coordinates(coordinates),
+        parent_area(NO_SLOT), first_subarea(NO_SLOT), last_subarea(NO_SLOT), next_sibling(NO_SLOT)
     {}
     AreaID id;
-    Name name;
+    // Interned in the name table of Datastructures
+    Symbol name;
     std::vector<Coord> coordinates;
-    // One possible parent area
-    std::shared_ptr<Area> parent_area;
-    // Several possible subareas
-    std::vector<std::weak_ptr<Area>> subareas;
+    // Slot of the one possible parent area, NO_SLOT if there is none
+    int parent_area;
+    // The subareas are a list linked through their slots in the order they were added: the first and last subarea
+    // of this area, and the next subarea of the same parent. NO_SLOT ends the list.
+    int first_subarea;
+    int last_subarea;
+    int next_sibling;
 };
 
-// Type to store the data of each Area
-struct Way {
-    Way(WayID id, std::vector<Coord> coordinates):
-        id(id), coordinates(coordinates), end1(*coordinates.begin()), end2(*coordinates.rbegin()), length(0)
-    {
-        // Calculate the total length according to the specification. std::floor rounds down to integers.
-        for (std::vector<int>::size_type i = 0; i != coordinates.size() - 1; ++i) {
-            int section_length = std::floor(std::sqrt(std::pow(coordinates[i].x - coordinates[i+1].x, 2)
-                                            + std::pow(coordinates[i].y - coordinates[i+1].y, 2)));
-            length += section_length;
-        }
-    }
-    WayID id;
-    std::vector<Coord> coordinates;
-    // Both ends of the way stored
-    Coord end1;
-    Coord end2;
-    int length;
+// Read-only view of consecutive coordinates, like the std::span of C++20. It does not own the coordinates,
+// so a view returned by Datastructures::get_way_coords() is only valid until the ways are changed.
+class Coord_span
+{
+public:
+    Coord_span() = default;
+    Coord_span(Coord const* data, std::size_t size): data_(data), size_(size) {}
+    Coord_span(std::vector<Coord> const& coords): data_(coords.data()), size_(coords.size()) {}
+
+    Coord const* begin() const { return data_; }
+    Coord const* end() const { return data_ + size_; }
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    Coord const& operator[](std::size_t i) const { return data_[i]; }
+    Coord const& front() const { return data_[0]; }
+    Coord const& back() const { return data_[size_ - 1]; }
+    std::vector<Coord> to_vector() const { return {begin(), end()}; }
+
+private:
+    Coord const* data_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+// All Ways in struct-of-arrays form. A way is a slot, reused after it is released like in a Slab, and every field has
+// its own column, so the loops that need only one field (the ends in build_route_graph(), the lengths in trim_ways())
+// read one contiguous array. The coordinates of all ways are in one pool instead of a vector of their own, so a way
+// costs no allocation. A reused slot gets its coordinates at the end of the pool, and the pool is compacted once
+// more than half of it belongs to released ways.
+struct Way_table {
+    // Interned WayIDs, NO_SYMBOL for released slots
+    std::vector<Symbol> ids;
+    // Both ends of the ways, and their lengths according to the specification
+    std::vector<Coord> end1;
+    std::vector<Coord> end2;
+    std::vector<Distance> lengths;
+    // Running number of the add_way() that created the way. Snapshots add the ways back in this order,
+    // which keeps the order of the ways of every crossroad (and so the routes found) the same.
+    std::vector<std::uint64_t> creation_numbers;
+    // The coordinates of slot s are coords[coord_begin[s]] ... coords[coord_begin[s] + coord_count[s] - 1]
+    std::vector<std::uint32_t> coord_begin;
+    std::vector<std::uint32_t> coord_count;
+    std::vector<Coord> coords;
+    std::vector<int> free_slots;
+    // Amount of coordinates in the pool that belong to released slots
+    std::size_t released_coords = 0;
+    // Increased by every emplace(), release() and clear(), so that the indices built from the table can tell
+    // whether they are still up to date
+    std::uint64_t revision = 0;
+
+    // Estimate of performance: O(k) amortized, where k is the amount of coordinates of the way
+    // Short rationale for estimate: The fields are appended to the columns (or written to a free slot) and the
+    // coordinates to the pool; the length is one floor(sqrt()) per section
+    int emplace(Symbol id, std::vector<Coord> const& way_coords, std::uint64_t creation_number);
+
+    // Estimate of performance: O(1) amortized
+    // Short rationale for estimate: Compacting the pool is linear, but it only happens after at least as many
+    // coordinates have been released as stay in the pool
+    void release(int slot);
+
+    void reserve(std::size_t way_count);
+    // Drops every way at once, keeping the allocated capacity for the next ones
+    void clear();
+    // Amount of slots including the released ones, every slot index is below this
+    std::size_t size() const { return ids.size(); }
+    Coord_span coords_of(int slot) const { return {coords.data() + coord_begin[slot], coord_count[slot]}; }
+
+private:
+    // Estimate of performance: O(c + w), where c is the amount of coordinates and w of slots
+    // Short rationale for estimate: The coordinates of the live ways are copied once to a new pool
+    void compact();
 };
 
-// Stores the data each crossroad-coordinate has
+// Stores the data each crossroad-coordinate has. The per-search state lives in Search_scratch.
 struct Crossroad_data {
+    Crossroad_data() = default;
     Crossroad_data(Coord coordinates):
-        coordinates(coordinates), visited(false), distance(NO_DISTANCE)
+        coordinates(coordinates)
     {}
     Coord coordinates;
-    bool visited;
-    int distance;
 };
 
-// Used by the cleaning function for ways
-const int NORMAL = 0;
-const int CYCLE = 1;
-
 // Function used to calculate the euclidean distance
 // Estimate of performance: O(1)
 // Short rationale for estimate: Only makes a set amount of operations to the coordinates
@@ -119,32 +186,532 @@ double calculate_euclidean(Coord coord);
 inline bool operator==(Coord c1, Coord c2) { return c1.x == c2.x && c1.y == c2.y; }
 inline bool operator!=(Coord c1, Coord c2) { return !(c1==c2); }
 
+// Squared euclidean distance from the origin. It orders coordinates exactly like calculate_euclidean(),
+// but needs no floating point and cannot round two different distances to the same value.
+inline long long coord_key(Coord coord) {
+    return static_cast<long long>(coord.x) * coord.x + static_cast<long long>(coord.y) * coord.y;
+}
+
 // Changed inline operator< to do what it should do according to the project specification
 inline bool operator<(Coord c1, Coord c2) {
-    double c1_e = calculate_euclidean(c1);
-    double c2_e = calculate_euclidean(c2);
+    long long c1_key = coord_key(c1);
+    long long c2_key = coord_key(c2);
     // First compare the distance
-    if (c1_e < c2_e) { return true; }
-    else if (c1_e > c2_e) { return false; }
+    if (c1_key != c2_key) { return c1_key < c2_key; }
     // Then compare y. Since if both are equal, the order does not matter, it will always return false
     else { return c1.y < c2.y; }
 }
 
+// Type to store the data of each Place
+struct Place {
+    Place(PlaceID id, Symbol name, PlaceType type, Coord coordinates):
+        id(id), name(name), type(type), coordinates(coordinates), coordinate_key(coord_key(coordinates))
+
+    {}
+    PlaceID id;
+    // Interned in the name table of Datastructures
+    Symbol name;
+    PlaceType type;
+    Coord coordinates;
+    // coord_key(coordinates), has to be updated together with them
+    long long coordinate_key;
+    // Positions of the slot of the place in its places_by_name_ and places_by_type_ buckets
+    int name_position = 0;
+    int type_position = 0;
+    // In pending_places_ and not in any index other than places_by_id_ yet
+    bool pending = false;
+    // Entry of the place in the change log of the deferred updates, NO_SLOT if its indices use its current name and coordinates
+    int change_position = NO_SLOT;
+
+    // The position of the place in the coordinate order: distance, then y, then id
+    std::tuple<long long, int, PlaceID> coordinate_order_key() const { return {coordinate_key, coordinates.y, id}; }
+};
+
 struct CoordHash
 {
     std::size_t operator()(Coord xy) const
     {
-        auto hasher = std::hash<int>();
-        auto xhash = hasher(xy.x);
-        auto yhash = hasher(xy.y);
-        // Combine hash values (magic!)
-        return xhash ^ (yhash + 0x9e3779b9 + (xhash << 6) + (xhash >> 2));
+        // Both halves packed into one 64-bit value, so that two different coordinates never hash the same.
+        // The combination used before hashed half a million coordinates to only about 65 000 values.
+        std::uint64_t packed = (static_cast<std::uint64_t>(static_cast<std::uint32_t>(xy.x)) << 32)
+                               | static_cast<std::uint32_t>(xy.y);
+        return std::hash<std::uint64_t>()(packed);
     }
 };
 
 // Return value for cases where coordinates were not found
 Coord const NO_COORD = {NO_VALUE, NO_VALUE};
 
+// One place given to Datastructures::add_places_bulk()
+struct Place_record {
+    PlaceID id;
+    Name name;
+    PlaceType type;
+    Coord coordinates;
+};
+
+// An indexed place changed or removed in the deferred update mode. The sorted orders and the place grids still have
+// the place with these keys, until build_pending_indices() replaces them with the current ones.
+struct Place_change {
+    PlaceID id;
+    // Slot of the place, NO_SLOT once the place has been removed
+    int slot;
+    Symbol old_name;
+    Coord old_coordinates;
+    PlaceType type;
+};
+
+// One way given to Datastructures::add_ways_bulk()
+struct Way_record {
+    WayID id;
+    std::vector<Coord> coordinates;
+};
+
+// One way as seen from one of its ends in the Route_graph
+struct Graph_edge {
+    int neighbor;
+    int way;
+    Distance length;
+};
+
+// One level of the explicit depth-first search stack: the node and the index of the edge currently explored from it
+struct Search_frame {
+    int node;
+    int edge;
+};
+
+// Per-query bookkeeping of the route searches, indexed by Route_graph node. A node only counts as reached
+// when its stamp equals the current epoch, so starting a new search is O(1) instead of resetting every node.
+struct Search_scratch {
+    unsigned int epoch = 0;
+    std::vector<unsigned int> stamp;
+    std::vector<Distance> distance;
+    // The edge used to arrive to the node and the node it was left from, -1 for the starting node
+    std::vector<int> arrived_by;
+    std::vector<int> previous;
+    // Reusable queue for breadth-first searches and stack for depth-first searches
+    std::vector<int> queue;
+    std::vector<Search_frame> stack;
+
+    void start(std::size_t node_count)
+    {
+        if (stamp.size() < node_count) {
+            stamp.resize(node_count, 0);
+            distance.resize(node_count);
+            arrived_by.resize(node_count);
+            previous.resize(node_count);
+        }
+        // After a wrap-around old stamps could look current again
+        if (++epoch == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            epoch = 1;
+        }
+        queue.clear();
+    }
+    bool reached(int node) const { return stamp[node] == epoch; }
+    void reach(int node, Distance node_distance, int from, int edge)
+    {
+        stamp[node] = epoch;
+        distance[node] = node_distance;
+        previous[node] = from;
+        arrived_by[node] = edge;
+    }
+};
+
+// Targets of Route_graph::distances_from(), built once for all of the sources of a distance matrix
+struct Distance_targets {
+    // Node of every target coordinate, -1 if the coordinate has no ways
+    std::vector<int> nodes;
+    // One flag per node of the graph, and the component of every distinct target node
+    std::vector<char> is_target;
+    std::vector<int> components;
+};
+
+// Compact crossroad graph used by the route searches. Every crossroad gets a dense node index
+// and the adjacency is stored in CSR form: the edges leaving node n are
+// edges[offsets[n]] ... edges[offsets[n+1]-1], in the same order ways_from() would return them.
+// The way of a Graph_edge is its slot in the way Slab. A built graph is never changed, it is replaced by a new one
+// when the ways change, so it can be searched by several threads at once, each with its own Search_scratch.
+struct Route_graph {
+    Flat_hash_map<Coord, int, CoordHash> node_of_coord;
+    std::vector<Coord> node_coords;
+    std::vector<int> offsets;
+    std::vector<Graph_edge> edges;
+    // Way slot -> the nodes of its ends, {-1, -1} for free slots
+    std::vector<std::pair<int, int>> way_ends;
+    // Way slot -> its WayID, copied so that the results do not depend on the later state of the ways
+    std::vector<WayID> way_ids;
+    // Node -> the representative node of its connected component, labelled with union-find when the graph is built
+    std::vector<int> component;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Compares two component labels. The route searches return no route at once for
+    // nodes in different components instead of walking the whole component of the start.
+    bool connected(int node1, int node2) const { return component[node1] == component[node2]; }
+
+    // Estimate of performance: O(n + m), where n is the amount of crossroads and m the amount of ways. Ω(1) for coordinates
+    // in different components.
+    // Short rationale for estimate: Depth-first search that visits every node and edge at most once
+    std::vector<std::tuple<Coord, WayID, Distance>> route_any(Coord fromxy, Coord toxy, Search_scratch& scratch) const;
+
+    // Estimate of performance: O(n + m), Ω(1) when fromxy == toxy or they are in different components
+    // Short rationale for estimate: Breadth-first search that stops as soon as the goal is reached
+    std::vector<std::tuple<Coord, WayID, Distance>> route_least_crossroads(Coord fromxy, Coord toxy, Search_scratch& scratch) const;
+
+    // Estimate of performance: O(n + m)
+    // Short rationale for estimate: Depth-first search that stops at the first node reached a second time
+    std::vector<std::tuple<Coord, WayID>> route_with_cycle(Coord fromxy, Search_scratch& scratch) const;
+
+    // Estimate of performance: O((n + m) log n), Ω(1) when fromxy == toxy or they are in different components
+    // Short rationale for estimate: A* (Dijkstra with an admissible euclidean heuristic) using a binary heap
+    std::vector<std::tuple<Coord, WayID, Distance>> route_shortest_distance(Coord fromxy, Coord toxy, Search_scratch& scratch) const;
+
+    // Estimate of performance: O(t + n), where t is the amount of targets
+    // Short rationale for estimate: One lookup per target and one flag per node
+    Distance_targets make_targets(std::vector<Coord> const& targets) const;
+
+    // Estimate of performance: O((n + m) log n), usually much less
+    // Short rationale for estimate: Dijkstra with a binary heap from the source, which stops as soon as every target
+    // has been settled instead of searching the whole graph
+    // row[i] is set to the shortest distance to targets.nodes[i], NO_DISTANCE if there is no route.
+    void distances_from(Coord fromxy, Distance_targets const& targets, Search_scratch& scratch, Distance* row) const;
+
+private:
+    // Estimate of performance: O(n + m)
+    // Short rationale for estimate: we traverse without repetition, which is a DFS searching algorithm, therefore O(n + m).
+    // Uses the stack of the scratch instead of recursion.
+    std::vector<std::tuple<Coord, WayID, Distance>> search_any(int start, int goal, Search_scratch& scratch) const;
+
+    // Estimate of performance: O(n + m)
+    // Short rationale for estimate: we traverse without repetition (until the single looping node is found), which is a
+    // DFS searching algorithm, therefore O(n + m). Uses the stack of the scratch instead of recursion.
+    std::vector<std::tuple<Coord, WayID>> search_cycle(int start, Search_scratch& scratch) const;
+
+    // Estimate of performance: O(n), where n is the amount of crossroads on the route
+    // Short rationale for estimate: Follows the previous-links of the scratch back from the goal once
+    // Builds the returned vector of the route searches once the goal has been reached
+    std::vector<std::tuple<Coord, WayID, Distance>> route_from_scratch(int goal, Search_scratch const& scratch) const;
+};
+
+// One arc of a Contraction_hierarchy between the nodes end1 and end2: either one way of the Route_graph, or a shortcut
+// that stands for the arc from end1 to a contracted node and the arc from that node to end2
+struct Hierarchy_arc {
+    int end1;
+    int end2;
+    Distance length;
+    // Way slot of an original arc, -1 for a shortcut
+    int way;
+    // Only for shortcuts: the contracted node, and the arcs end1-middle and middle-end2 that the shortcut replaces
+    int middle;
+    int first;
+    int second;
+};
+
+// An arc of a Contraction_hierarchy as seen from one of its ends
+struct Hierarchy_link {
+    int neighbor;
+    int arc;
+    Distance length;
+};
+
+// Contraction hierarchy over a Route_graph for the shortest distance queries. The nodes are contracted one at a time,
+// least important first, and contracting a node adds a shortcut between each pair of its remaining neighbors whose
+// shortest route goes through it. A query is then a bidirectional Dijkstra that only follows the links up to nodes
+// contracted later, which reaches far fewer nodes than a search over the whole graph, and the shortcuts of the found
+// route are unpacked back into ways. Random maps are not as hierarchical as road networks, so the contraction stops
+// when the remaining nodes get too densely linked; between these core nodes the links lead up both ways.
+// Like the Route_graph, a built hierarchy is never changed and can be searched by several threads at once.
+struct Contraction_hierarchy {
+    std::shared_ptr<Route_graph const> graph;
+    // The nodes are numbered in the order they were contracted, the core nodes last: rank maps a Route_graph node to
+    // its number here and node_at back. The arcs and links use these numbers.
+    std::vector<int> rank;
+    std::vector<int> node_at;
+    std::vector<Hierarchy_arc> arcs;
+    // CSR of the upward links: the links leaving node n are up_links[up_offsets[n]] ... up_links[up_offsets[n+1]-1]
+    std::vector<int> up_offsets;
+    std::vector<Hierarchy_link> up_links;
+    std::size_t shortcut_count = 0;
+    std::size_t core_size = 0;
+
+    // Estimate of performance: O(n d^2 w log w), where n is the amount of crossroads, d their degree at the time they
+    // are contracted and w the node limit of the witness searches
+    // Short rationale for estimate: Contracting a node runs a limited Dijkstra (witness search) from each of its
+    // neighbors to see which shortcuts are needed, and the priorities of the nodes are recomputed the same way
+    explicit Contraction_hierarchy(std::shared_ptr<Route_graph const> route_graph);
+
+    // Estimate of performance: O(k log k + r), where k is the amount of nodes the upward searches reach, usually a small
+    // part of the graph, and r the amount of ways on the route
+    // Short rationale for estimate: Two Dijkstras over the upward links, each stopping when it cannot improve the best
+    // meeting point anymore, then every shortcut on the route is unpacked with an explicit stack
+    // Returns the same as Route_graph::route_shortest_distance()
+    std::vector<std::tuple<Coord, WayID, Distance>> route_shortest_distance(Coord fromxy, Coord toxy,
+                                                                            Search_scratch& forward, Search_scratch& backward) const;
+};
+
+// The area forest flattened in preorder, so that every area is followed by all of its direct and indirect subareas.
+// Built by Datastructures::creation_finished() and dropped again by any change to the areas.
+struct Area_index {
+    // Ids of the areas in preorder; the subareas of an area are the slice after it of length subtree_size - 1
+    std::vector<AreaID> preorder_ids;
+    // Area slot -> its position in preorder_ids, the size of its subtree (itself included) and its depth
+    std::vector<int> position;
+    std::vector<int> subtree_size;
+    std::vector<int> depth;
+    // ancestors[k][slot] is the 2^k:th parent of the area, NO_SLOT if it does not have one
+    std::vector<std::vector<int>> ancestors;
+
+    // True also when the areas are the same
+    bool is_ancestor(int ancestor, int slot) const
+    {
+        return position[ancestor] <= position[slot] && position[slot] < position[ancestor] + subtree_size[ancestor];
+    }
+};
+
+// Interning table that gives every distinct string a dense 32-bit Symbol. The containers store and hash
+// the Symbols, and the strings are only looked up again when they are returned. Symbols are never released
+// before clear(), so a table holds every distinct string it has been given since then.
+struct Symbol_table {
+    // Returns the existing Symbol of the text or adds a new one
+    Symbol intern(std::string const& text);
+    // NO_SYMBOL if the text has not been interned
+    Symbol find(std::string const& text) const;
+    std::string const& text(Symbol symbol) const { return texts_[symbol]; }
+    // Amount of interned texts, every Symbol is below this
+    std::size_t size() const { return texts_.size(); }
+    void clear();
+
+private:
+    // The keys point to the strings in texts_, which a deque never moves, so each text is stored only once
+    Flat_hash_map<std::string_view, Symbol> symbols_;
+    std::deque<std::string> texts_;
+};
+
+// Orders (name, id) pairs alphabetically by the text of the name and then by the id.
+// A pair can also be compared with a bare text that goes before every pair with the same name, so that lower_bound()
+// of the set finds the first name starting with a prefix.
+struct Alphabetical_less {
+    using is_transparent = void;
+
+    Symbol_table const* names;
+    bool operator()(std::pair<Symbol, PlaceID> const& place1, std::pair<Symbol, PlaceID> const& place2) const
+    {
+        // Different Symbols always have different texts
+        if (place1.first != place2.first) {
+            return names->text(place1.first) < names->text(place2.first);
+        }
+        return place1.second < place2.second;
+    }
+    bool operator()(std::pair<Symbol, PlaceID> const& place, std::string_view text) const
+    {
+        return std::string_view(names->text(place.first)) < text;
+    }
+};
+
+// Suffix array over the texts of a Symbol_table, used for finding the texts that contain a given part.
+// The table only grows between clears, so the index is rebuilt whenever the table has texts it has not seen yet.
+struct Substring_index {
+    // Rebuilds the index if the table has grown since the last update
+    void update(Symbol_table const& table);
+    // Calls visit(symbol) with the text of every suffix that starts with the part, in the order of the suffixes, until visit
+    // returns false. A text containing the part several times is visited once for every occurrence.
+    template <typename Visit>
+    void for_each_match(std::string_view part, Visit visit) const
+    {
+        auto [first, last] = match_range(part);
+        for (std::size_t i = first; i != last && visit(suffixes_[i].symbol); ++i) {
+        }
+    }
+    void clear();
+
+private:
+    // All texts, each followed by '\0', so a suffix compared with strcmp ends at the end of its own text
+    std::string text_;
+    // Amount of texts of the table in text_
+    std::size_t text_count_ = 0;
+    // Every suffix of every text as its position in text_ and the Symbol of its text, in alphabetical order
+    struct Suffix {
+        int position;
+        Symbol symbol;
+    };
+    std::vector<Suffix> suffixes_;
+
+    // The range of suffixes_ starting with the part
+    std::pair<std::size_t, std::size_t> match_range(std::string_view part) const;
+};
+
+// Contiguous storage for Places, Areas and Ways. Every element keeps its slot index until it is released,
+// so the other containers can refer to it with a plain int instead of a shared_ptr of its own allocation.
+// Released slots are reused by the next insertions. Pointers and references to the elements are only
+// valid until the next emplace(), slot indices stay valid until the slot is released.
+template <typename Type>
+struct Slab {
+    std::vector<Type> slots;
+    std::vector<int> free_slots;
+
+    template <typename... Args>
+    int emplace(Args&&... args)
+    {
+        if (free_slots.empty()) {
+            slots.emplace_back(std::forward<Args>(args)...);
+            return static_cast<int>(slots.size()) - 1;
+        }
+        int slot = free_slots.back();
+        free_slots.pop_back();
+        slots[slot] = Type(std::forward<Args>(args)...);
+        return slot;
+    }
+    void release(int slot) { free_slots.push_back(slot); }
+    void reserve(std::size_t count) { slots.reserve(count); }
+    // Drops every element at once, keeping the allocated capacity for the next ones
+    void clear()
+    {
+        slots.clear();
+        free_slots.clear();
+    }
+    // Amount of slots including the released ones, every slot index is below this
+    std::size_t size() const { return slots.size(); }
+    Type& operator[](int slot) { return slots[slot]; }
+    Type const& operator[](int slot) const { return slots[slot]; }
+};
+
+// Disjoint-set forest over dense node indices, with path compression and union by rank
+struct Disjoint_set {
+    std::vector<int> parent;
+    std::vector<unsigned char> rank;
+
+    // Makes every node 0 ... count-1 its own set
+    void reset(std::size_t count);
+    int find(int node);
+    // Returns false if the nodes were already in the same set
+    bool unite(int node1, int node2);
+};
+
+// Uniform grid over the places of one type, used by the nearest-place queries. The cell size is chosen from
+// the density of the places, and the grid is rebuilt whenever the amount of places has doubled or dropped to a
+// quarter since the last build, or the places have spread over four times the cells they covered then, so that
+// a cell holds only a few places on average and the queries never sweep large empty areas.
+// The cells store copies of the ids and coordinates, so the queries never have to look at the Places themselves.
+struct Place_grid {
+    struct Entry {
+        Coord coordinates;
+        PlaceID id;
+    };
+
+    // Erasing has to be done with the coordinates the place was inserted with
+    void insert(PlaceID id, Coord xy);
+    // Same as inserting the entries one by one, but the grid is rebuilt at most once
+    void insert_many(std::vector<Entry> const& entries);
+    void erase(PlaceID id, Coord xy);
+    void clear();
+
+    // Closest places first, ties broken by the smaller y-coordinate and then by the smaller id
+    std::vector<PlaceID> nearest(Coord xy, std::size_t k) const;
+    std::vector<PlaceID> within_radius(Coord xy, Distance radius) const;
+    // In no particular order
+    std::vector<PlaceID> within_rect(Coord lower_left, Coord upper_right) const;
+    // A rectangle containing every place, rounded outwards to whole cells; {NO_COORD, NO_COORD} if there are none
+    std::pair<Coord, Coord> bounds() const;
+
+private:
+    std::unordered_map<long long, std::vector<Entry>> cells_;
+    int cell_size_ = 1;
+    std::size_t count_ = 0;
+    std::size_t built_count_ = 0;
+    // Amount of cells in the bounding box right after the last build
+    double built_box_cells_ = 0;
+    // Bounding box of the cells that have places in them, valid when count_ > 0
+    int min_cell_x_ = 0;
+    int max_cell_x_ = 0;
+    int min_cell_y_ = 0;
+    int max_cell_y_ = 0;
+
+    int cell_of(int value) const;
+    static long long cell_key(int cell_x, int cell_y);
+    void add_to_cell(Entry const& entry);
+    double box_cells() const;
+    void rebuild();
+    // Adds the places of the cells in [min_x, max_x] x [min_y, max_y] that are also within the bounding box
+    void collect(int min_x, int max_x, int min_y, int max_y, std::vector<Entry>& found) const;
+};
+
+// Uniform grid over the bounding boxes of the ways, used by Datastructures::ways_in_rect(). A way is listed in every cell
+// its bounding box overlaps, and the cells are about as large as a typical way, so that most ways are in only a few cells.
+// The few ways much larger than that are kept in a list of their own instead of in hundreds of cells.
+// The grid is rebuilt from the Way_table by the first query after the ways have changed.
+struct Way_grid {
+    // Estimate of performance: O(1) if the ways have not changed since the last call, otherwise O(w + c),
+    // where w is the amount of ways with their coordinates and c the amount of cells they are listed in
+    // Short rationale for estimate: The bounding boxes are computed in one pass over the coordinate pool
+    void update(Way_table const& ways);
+    // Slots of the ways whose bounding box overlaps the rectangle, in increasing order
+    std::vector<int> slots_in_rect(Coord lower_left, Coord upper_right) const;
+    // A rectangle containing every way, {NO_COORD, NO_COORD} if there are none
+    std::pair<Coord, Coord> bounds() const;
+    void clear();
+
+private:
+    struct Box {
+        Coord lower_left;
+        Coord upper_right;
+    };
+
+    // A way overlapping more cells than this goes to large_slots_
+    static constexpr long long MAX_WAY_CELLS = 16;
+
+    std::unordered_map<long long, std::vector<int>> cells_;
+    std::vector<int> large_slots_;
+    // By slot, {NO_COORD, NO_COORD} for the released slots
+    std::vector<Box> boxes_;
+    Box bounds_ = {NO_COORD, NO_COORD};
+    int cell_size_ = 1;
+    bool built_ = false;
+    std::uint64_t revision_ = 0;
+
+    int cell_of(int value) const;
+    static long long cell_key(int cell_x, int cell_y);
+};
+
+// Copies of the place indices for a Query_snapshot, by id instead of slot
+struct Place_snapshot {
+    std::array<Place_grid, static_cast<int>(PlaceType::NO_TYPE) + 1> grids;
+    Flat_hash_map<Name, std::vector<PlaceID>> ids_by_name;
+    std::array<std::vector<PlaceID>, static_cast<int>(PlaceType::NO_TYPE) + 1> ids_by_type;
+};
+
+// Read-only view of the data, taken by Datastructures::publish_snapshot(). Nothing a snapshot refers to is changed
+// afterwards, so any number of threads can query the same snapshot while one writer thread keeps changing
+// the Datastructures. The parts that have not changed between two snapshots are shared by them.
+// The operations give the same results as the operations of Datastructures with the same names gave when
+// the snapshot was taken, with the same estimates of performance.
+class Query_snapshot
+{
+public:
+    // hierarchy is nullptr if prepare_routing() has not been called for these routes
+    Query_snapshot(std::uint64_t epoch, std::shared_ptr<Route_graph const> routes,
+                   std::shared_ptr<Contraction_hierarchy const> hierarchy, std::shared_ptr<Place_snapshot const> places);
+
+    // Running number of the publish_snapshot() that made this snapshot, starting from 1
+    std::uint64_t epoch() const { return epoch_; }
+
+    std::vector<std::tuple<Coord, WayID, Distance>> route_any(Coord fromxy, Coord toxy) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> route_least_crossroads(Coord fromxy, Coord toxy) const;
+    std::vector<std::tuple<Coord, WayID>> route_with_cycle(Coord fromxy) const;
+    std::vector<std::tuple<Coord, WayID, Distance>> route_shortest_distance(Coord fromxy, Coord toxy) const;
+
+    std::vector<PlaceID> places_closest_to(Coord xy, PlaceType type) const;
+    std::vector<PlaceID> places_k_nearest(Coord xy, PlaceType type, std::size_t k) const;
+    std::vector<PlaceID> places_within_radius(Coord xy, PlaceType type, Distance radius) const;
+    std::vector<PlaceID> find_places_name(Name const& name) const;
+    std::vector<PlaceID> find_places_type(PlaceType type) const;
+
+private:
+    std::uint64_t epoch_;
+    std::shared_ptr<Route_graph const> routes_;
+    std::shared_ptr<Contraction_hierarchy const> hierarchy_;
+    std::shared_ptr<Place_snapshot const> places_;
+};
+
 class Datastructures
 {
 public:
@@ -163,6 +730,13 @@ public:
     // Short rationale for estimate: Simply pushes all of the IDs from the unordered map onto a vector
     std::vector<PlaceID> all_places();
 
+    // Estimate of performance: O(o + k), where o is the offset and k the amount of places visited
+    // Short rationale for estimate: Walks places_by_id_ past the offset and then visits the ids one at a time, nothing is copied
+    // Visits at most limit places from the offset:th on, in the order of all_places() as long as the places do not change.
+    // Returns the amount of places visited.
+    std::size_t visit_all_places(Place_visitor const& visit, std::size_t offset = 0,
+                                 std::size_t limit = std::numeric_limits<std::size_t>::max());
+
     // Estimate of performance: From get_place(id) -> O(n), average case is constant
     // Short rationale for estimate: From get_place(id) -> Up to linear between the searched container: std::find(), rest of the operations are constant
     bool add_place(PlaceID id, Name const& name, PlaceType type, Coord xy);
@@ -175,16 +749,30 @@ public:
     // Short rationale for estimate: From get_place(id) -> Up to linear between the searched container: std::find(), other operations constant
     Coord get_place_coord(PlaceID id);
 
-    // Estimate of performance: O(n*log n), if alphabetical_vector_ids_ is known to be already sorted the runtime is Ω(1)
-    // Short rationale for estimate: Adding a key-value pair to the temporary multimap is log n, so the runtime is therefore
-    // going through the entire container n*log n
+    // Estimate of performance: O(n), if alphabetical_vector_ids_ is known to be up to date the runtime is Ω(1) (plus the copy)
+    // Short rationale for estimate: alphabetical_order_ is always kept sorted by the modifying operations, so the ids only have
+    // to be copied out of it in order
     std::vector<PlaceID> places_alphabetically();
 
-    // Estimate of performance: O(n*log n), if coordinate_vector_ids_ is known to be already sorted the runtime is Ω(1)
-    // Short rationale for estimate: Adding a key-value pair to the temporary multimap is log n, so the runtime is therefore
-    // going through the entire container sized n is n*log n
+    // Estimate of performance: O(n), if coordinate_vector_ids_ is known to be up to date the runtime is Ω(1) (plus the copy)
+    // Short rationale for estimate: coordinate_order_ is always kept sorted by the modifying operations, so the ids only have
+    // to be copied out of it in order
     std::vector<PlaceID> places_coord_order();
 
+    // Estimate of performance: O(k) amortized, where k is the amount of places visited. O(n) for the first page with
+    // an offset after the places have changed.
+    // Short rationale for estimate: The page is read straight from alphabetical_vector_ids_, which is only rebuilt after the
+    // places have changed. The first page (offset 0) of a changed order is walked from alphabetical_order_ instead.
+    // Unlike places_alphabetically() the ids are not copied. Visits at most limit places from the offset:th on, in the same order as places_alphabetically().
+    // Returns the amount of places visited.
+    std::size_t visit_places_alphabetically(Place_visitor const& visit, std::size_t offset = 0,
+                                            std::size_t limit = std::numeric_limits<std::size_t>::max());
+
+    // Estimate of performance: O(k) amortized, O(n) for the first page with an offset after the places have changed
+    // Short rationale for estimate: Same as visit_places_alphabetically(), with coordinate_vector_ids_ and coordinate_order_
+    std::size_t visit_places_coord_order(Place_visitor const& visit, std::size_t offset = 0,
+                                         std::size_t limit = std::numeric_limits<std::size_t>::max());
+
     // Estimate of performance: θ(n), where n is the amount of keys of the specified type, O(n) container size
     // Short rationale for estimate: Since std::equal_range is linear to the number of elements with the specified key, and the for-loop
     // only pushes these values back onto a vector, the runtime is linear to the number of elements. Worst case is if all of the keys
@@ -197,8 +785,23 @@ public:
     // are valid for the operation
     std::vector<PlaceID> find_places_type(PlaceType type);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: O(p log n + k), where n is the amount of places, p the length of the prefix and k the amount of results
+    // Short rationale for estimate: The names starting with the prefix are one contiguous range of alphabetical_order_, found with
+    // one lower_bound and then iterated until the first name without the prefix or until limit places have been found
+    // Returns the places in alphabetical order of their names, ties by id, at most limit of them
+    std::vector<PlaceID> find_places_name_prefix(Name const& prefix, std::size_t limit = std::numeric_limits<std::size_t>::max());
+
+    // Estimate of performance: O(p log c + s + k), where c is the total length of the distinct names, p the length of the part,
+    // s the amount of suffixes looked at (all that start with the part, unless limit places are found before) and k the amount of results. Names added since the last search
+    // add O(a log a + c) for sorting their a suffixes and merging them into the suffix array.
+    // Short rationale for estimate: The suffixes starting with the part are one contiguous range of the suffix array, found with
+    // two binary searches and followed until limit places have been found. The places of each name come from places_by_name_.
+    // Returns at most limit places, ordered by the rest of their name from the first occurrence of the part on, ties by id
+    std::vector<PlaceID> find_places_name_substring(Name const& part, std::size_t limit = std::numeric_limits<std::size_t>::max());
+
+    // Estimate of performance: O(log n), where n is the amount of places, average case for the hash lookups; O(1) in the deferred mode
+    // Short rationale for estimate: From get_place(id) and the name buckets -> constant on average (the slot is moved out by its back-pointer),
+    // the erase and insert of alphabetical_order_ are logarithmic. In the deferred mode the set is only updated by the next merge of the change log
     bool change_place_name(PlaceID id, Name const& newname);
 
     // Estimate of performance: From get_place(id) -> O(n), average case is constant
@@ -221,40 +824,57 @@ public:
     // Short rationale for estimate: Simply pushes all of the IDs from the unordered map onto a vector
     std::vector<AreaID> all_areas();
 
+    // Estimate of performance: O(o + k), where o is the offset and k the amount of areas visited
+    // Short rationale for estimate: Same as visit_all_places(), with areas_by_id_
+    std::size_t visit_all_areas(Area_visitor const& visit, std::size_t offset = 0,
+                                std::size_t limit = std::numeric_limits<std::size_t>::max());
+
     // Estimate of performance: From get_area(id) -> O(n), average case is constant
     // Short rationale for estimate: From get_area(id) -> Up to linear between the searched container: std::find(), rest of the operations constant
     bool add_subarea_to_area(AreaID id, AreaID parentid);
 
     // Estimate of performance: From get_area(id) -> O(n) with the container size, average case is linear with the amount of parents
     // Short rationale for estimate: From get_area(id) -> Up to linear between the searched container: std::find(),
-    // on average linear with the amount of parents, indirect or direct the area has, since the search operation is on average constant
+    // on average linear with the amount of parents, indirect or direct the area has, since the search operation is on average constant.
+    // The parent links are plain slots, and with a valid Area_index the result is allocated once for the depth.
     std::vector<AreaID> subarea_in_areas(AreaID id);
 
-    // Estimate of performance: From get_area(id) -> O(n) with the container size, average case is constant
-    // Short rationale for estimate: From get_area(id) -> Up to linear between the searched container: std::find(), rest of the operations constant
+    // Estimate of performance: O(k log k + a log a), where k is the amount of places and ways added by the bulk operations
+    // since the indices were last built and a the amount of areas, Ω(1) if nothing has changed
+    // Short rationale for estimate: Builds the postponed indices of the bulk operations, see build_pending_indices(),
+    // and the Area_index, see build_area_index()
     void creation_finished();
 
-    // Estimate of performance: O(n) with the container size (if type = PlaceType::NO_TYPE), average case is linear with the defined range of wanted elements
-    // as per with std::equal_range() and the for-loop itself
-    // Short rationale for estimate: The method only loops over the values necessary for the specific case, so if the type is not defined, will have to
-    // loop over the entire structure, otherwise the loop and std::equal_range() is on an average case linear with the number of elements with the wanted key
+    // Estimate of performance: θ(n), where n is the amount of direct and indirect subareas, average case for finding the area is constant
+    // Short rationale for estimate: With a valid Area_index the subareas are one contiguous slice of the preorder, which is copied at once.
+    // Otherwise get_children() visits every subarea once.
     std::vector<AreaID> all_subareas_in_area(AreaID id);
 
-    // Estimate of performance:
-    // Short rationale for estimate:
+    // Estimate of performance: Same as places_k_nearest() with k = 3
+    // Short rationale for estimate: -
     std::vector<PlaceID> places_closest_to(Coord xy, PlaceType type);
 
-    // Estimate of performance: From get_area(id) -> O(n) with the container size, average case is linear in the amount of specified names and placetypes
-    // Short rationale for estimate: From get_area(id) -> Up to linear between the searched container: std::find(); std::find is on average constant,
-    // therefore the for-loops affect the average case the most. They are linear with the amount of elements with the same keys within the places_by_type_
-    // and places_by_name_ data structures, as the loops only go through any elements which have the same key, therefore both of the loops also have
-    // a complexity of O(n) with the container size, but in an average case they are linear with the appropriate elements with the same key as the wanted element.
+    // Estimate of performance: O(k log k) on average with evenly spread places, O(n) worst case in the amount of places
+    // Short rationale for estimate: Place_grid only looks at the rings of cells around xy until k places have been found
+    // and no unvisited cell can contain a closer one
+    std::vector<PlaceID> places_k_nearest(Coord xy, PlaceType type, std::size_t k);
+
+    // Estimate of performance: O(c + p log p), where c is the amount of grid cells overlapping the circle and
+    // p the amount of places found in them
+    // Short rationale for estimate: Place_grid only looks at the cells overlapping the bounding square of the circle
+    std::vector<PlaceID> places_within_radius(Coord xy, PlaceType type, Distance radius);
+
+    // Estimate of performance: O(log n), where n is the amount of places, average case for finding the place is constant
+    // Short rationale for estimate: The place knows its positions in its name and type buckets, so it is removed from them in O(1)
+    // by moving the last slot of the bucket in its place. Erasing it from the two ordered sets is O(log n), and from the
+    // Place_grids linear in the few places of its cell.
     bool remove_place(PlaceID id);
 
-    // Estimate of performance: From get_area(id) -> O(n) with the container size, average case is linear in the amount of parents
-    // Short rationale for estimate: Up to linear between the searched container: std::find(); as std::mismatch is at worst case the range
-    // of the iterators given to it, which have already been processed by the while functions which go through all of the parents, the average case is therefore
-    // the while-loop length while the std::find() still has the worst case as container size.
+    // Estimate of performance: O(log d) with a valid Area_index, where d is the depth of the area forest, otherwise linear in the amount of parents.
+    // Finding the areas is on average constant.
+    // Short rationale for estimate: The Area_index answers whether an area is an ancestor of another in O(1) from the preorder ranges,
+    // so the lowest common parent is found by jumping up in powers of two. Without the index, both parent chains are collected
+    // and compared from the root with std::mismatch.
     AreaID common_area_of_subareas(AreaID id1, AreaID id2);
 
     // Phase 2 operations
@@ -263,6 +883,11 @@ public:
     // Short rationale for estimate: Simply looping over the container
     std::vector<WayID> all_ways();
 
+    // Estimate of performance: O(o + k), where o is the offset and k the amount of ways visited
+    // Short rationale for estimate: Same as visit_all_places(), with ways_by_id_
+    std::size_t visit_all_ways(Way_visitor const& visit, std::size_t offset = 0,
+                               std::size_t limit = std::numeric_limits<std::size_t>::max());
+
     // Estimate of performance: O(n) in the size of the ways_by_id_ unordered map
     // Short rationale for estimate: Simply looping over the container
     bool add_way(WayID id, std::vector<Coord> coords);
@@ -275,18 +900,18 @@ public:
 
     // Estimate of performance: O(n), where n is the container size. Average case constant.
     // Short rationale for estimate: std::find on an unordered map is average case constant,
-    // worst case linear in container size
-    std::vector<Coord> get_way_coords(WayID id);
+    // worst case linear in container size. The coordinates are not copied.
+    // The view is only valid until the next change to the ways, {NO_COORD} if there is no such way.
+    Coord_span get_way_coords(WayID id);
 
     // Estimate of performance: O(n) [Technically all of the data structures can have different sizes,
     // so it would be O(n + m...)]
     // Short rationale for estimate: All of the clear() functions are linear
     void clear_ways();
 
-    // Estimate of performance: Clean_for_search() -> O(n), search_any() -> O(m), therefore technically O(n + m)
-    // Short rationale for estimate: Simply looping over the containers as necessary when cleaning
-    // them ready for the search, so O(n). We traverse without repetition in search_any(), which is a
-    // DFS searching algorithm, therefore O(m).
+    // Estimate of performance: search_any() -> O(n + m), where n is the amount of crossroads and m the amount of ways
+    // Short rationale for estimate: We traverse without repetition in search_any(), which is a
+    // DFS searching algorithm, and the per-query state is reset in O(1) by Search_scratch
     std::vector<std::tuple<Coord, WayID, Distance>> route_any(Coord fromxy, Coord toxy);
 
     // Non-compulsory operations
@@ -296,27 +921,160 @@ public:
     // in worst case
     bool remove_way(WayID id);
 
-    // Estimate of performance: -
-    // Short rationale for estimate: -
+    // Estimate of performance: O(n + m), where n is the amount of crossroads and m the amount of ways, Ω(1) when fromxy == toxy
+    // Short rationale for estimate: Breadth-first search over the Route_graph that stops as soon as the goal is reached,
+    // the per-query state is reset in O(1) by Search_scratch
     std::vector<std::tuple<Coord, WayID, Distance>> route_least_crossroads(Coord fromxy, Coord toxy);
 
-    // Estimate of performance: Clean_for_search() -> O(n), search_any() -> O(m), therefore technically O(n + m)
-    // Short rationale for estimate: Simply looping over the containers as necessary when cleaning
-    // them ready for the search, so O(n). We traverse without repetition in search_any(), which is a
-    // DFS searching algorithm, therefore O(m).
+    // Estimate of performance: search_cycle() -> O(n + m), where n is the amount of crossroads and m the amount of ways
+    // Short rationale for estimate: We traverse without repetition in search_cycle(), which is a
+    // DFS searching algorithm, and the per-query state is reset in O(1) by Search_scratch
     std::vector<std::tuple<Coord, WayID>> route_with_cycle(Coord fromxy);
 
-    // Estimate of performance: -
-    // Short rationale for estimate: -
+    // Estimate of performance: O((n + m) log n), where n is the amount of crossroads and m the amount of ways, Ω(1) when fromxy == toxy
+    // Short rationale for estimate: A* (Dijkstra with an admissible euclidean heuristic) using a binary heap over the Route_graph.
+    // Rebuilding the graph after ways have changed adds O(n + m) to the first search.
+    // After prepare_routing() the search runs on the contraction hierarchy instead, see Contraction_hierarchy.
     std::vector<std::tuple<Coord, WayID, Distance>> route_shortest_distance(Coord fromxy, Coord toxy);
 
-    // Estimate of performance: -
-    // Short rationale for estimate: -
+    // Estimate of performance: O(n d^2 w log w), where n is the amount of crossroads, d their degree when contracted and
+    // w the node limit of the witness searches
+    // Short rationale for estimate: Builds a Contraction_hierarchy over the Route_graph
+    // route_shortest_distance(), route_many() and the snapshots use the hierarchy until the next change to the ways,
+    // which drops it; after that they search the plain graph again until prepare_routing() is called again.
+    // Returns the amount of shortcuts the hierarchy needed.
+    std::size_t prepare_routing();
+
+    // Estimate of performance: O(m log m), where m is the amount of ways, Ω(1) if no ways have been added since the last trim
+    // Short rationale for estimate: Kruskal's algorithm; sorting the ways by length dominates, as the Disjoint_set
+    // operations are practically constant and removing each rejected way is on average constant
     Distance trim_ways();
 
+    // Bulk operations
+
+    // Estimate of performance: O(n + m), where n and m are the given amounts of places and ways
+    // Short rationale for estimate: Only reserves room in the containers for that many places and ways in total,
+    // so that adding them does not have to grow and rehash the containers over and over
+    void reserve(std::size_t place_count, std::size_t way_count);
+
+    // Estimate of performance: O(k) on average, where k is the amount of given places, plus build_pending_indices() later
+    // Short rationale for estimate: Only the Place and its id are stored at once. The other indices of the places are built
+    // in one pass by creation_finished() or by the next operation that needs them.
+    // Returns the amount of places added; places with an id that already exists are skipped, like in add_place()
+    std::size_t add_places_bulk(std::vector<Place_record> const& places);
+
+    // Estimate of performance: O(k) on average, where k is the amount of given ways (with their coordinates),
+    // plus build_pending_indices() later
+    // Short rationale for estimate: Same as add_places_bulk(), the ways by their ends and the crossroads are postponed
+    // Returns the amount of ways added; ways with an id that already exists are skipped, like in add_way()
+    std::size_t add_ways_bulk(std::vector<Way_record> ways);
+
+    // Estimate of performance: O(1) when turned on, build_pending_indices() when turned off
+    // Short rationale for estimate: Turning the mode off merges the postponed changes at once
+    // In the deferred update mode add_place, change_place_name, change_place_coord, remove_place and add_way only update
+    // the elements, their ids and the name and type buckets of the already indexed places, and log the change.
+    // The sorted orders, the place grids and the ways by their ends are brought up to date in one batched merge
+    // by the next operation that needs them, so a burst of changes (and a place changed many times) costs one merge.
+    // The route graph with its component labels and the routing hierarchy are rebuilt lazily in both modes.
+    void set_deferred_updates(bool deferred);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Returns a flag
+    bool deferred_updates() const;
+
+    // Viewport queries, used by the graphical user interface to build only what is visible
+
+    // Estimate of performance: O(c + p), where c is the amount of grid cells overlapping the rectangle (at most the amount
+    // of places) and p the amount of places in them
+    // Short rationale for estimate: The Place_grid of all places only looks at the cells overlapping the rectangle
+    // The places with lower_left.x <= x <= upper_right.x and lower_left.y <= y <= upper_right.y, in no particular order
+    std::vector<PlaceID> places_in_rect(Coord lower_left, Coord upper_right);
+
+    // Estimate of performance: O(c + k log k), where c is the amount of grid cells overlapping the rectangle and k the amount
+    // of ways listed in them, plus O(w) for rebuilding the Way_grid after the ways have changed
+    // Short rationale for estimate: The Way_grid only looks at the cells overlapping the rectangle, and the ways found in
+    // several of them are sorted out
+    // The ways whose bounding box overlaps the rectangle, in no particular order. A few of them may not actually cross it.
+    std::vector<WayID> ways_in_rect(Coord lower_left, Coord upper_right);
+
+    // Estimate of performance: Same as ways_in_rect()
+    // Short rationale for estimate: Both grids know the cells they have places and ways in
+    // A rectangle containing every place and way, slightly larger than needed; {NO_COORD, NO_COORD} if there are none
+    std::pair<Coord, Coord> map_bounds();
+
+    // Concurrent read operations
+
+    // Estimate of performance: O(n + m) for the parts that have changed since the last snapshot, where n is the amount
+    // of places and m the amount of crossroads and ways, Ω(1) if nothing has changed
+    // Short rationale for estimate: The route graph is rebuilt and the place indices are copied only if they have changed,
+    // otherwise the previous snapshot's parts are shared
+    // Makes a Query_snapshot of the current data available through latest_snapshot(). Like the other non-const operations
+    // it is called by the one writer thread, for example after every batch of changes.
+    void publish_snapshot();
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Atomically copies one shared_ptr
+    // Can be called by any thread at any time. nullptr before the first publish_snapshot(); a snapshot stays valid for as
+    // long as it is held, also after newer ones have been published.
+    std::shared_ptr<Query_snapshot const> latest_snapshot() const;
+
+    // Batch query operations
+
+    // Estimate of performance: O(t), where t is the amount of threads
+    // Short rationale for estimate: The old worker threads are stopped and the new ones started
+    // Sets the amount of threads the batch queries run on, the calling thread included. 0 means one per hardware thread.
+    void set_thread_count(unsigned int count);
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Returns the size of the thread pool
+    unsigned int thread_count() const;
+
+    // Estimate of performance: O(q (n + m) log n / t) on top of publish_snapshot(), where q is the amount of queries,
+    // n the amount of crossroads, m the amount of ways and t the amount of threads
+    // Short rationale for estimate: Every query is a route_shortest_distance() on the same snapshot, and the
+    // thread pool spreads them over its threads
+    // The routes are in the order of the queries, in the same form as route_shortest_distance() returns them.
+    std::vector<std::vector<std::tuple<Coord, WayID, Distance>>> route_many(std::vector<std::pair<Coord, Coord>> const& queries);
+
+    // Estimate of performance: O(q c / t) on top of publish_snapshot(), where c is the cost of one places_closest_to()
+    // Short rationale for estimate: Every query is a places_closest_to() on the same snapshot, spread over t threads
+    std::vector<std::vector<PlaceID>> closest_many(std::vector<Coord> const& coords, PlaceType type);
+
+    // Estimate of performance: O(s (n + m) log n / t + s g), where s is the amount of sources and g of targets,
+    // usually much less
+    // Short rationale for estimate: One Dijkstra per source that stops when all of the targets have been settled,
+    // the sources are spread over the t threads of the thread pool
+    // Returns the shortest distances as a dense row-major matrix: the distance from sources[i] to targets[j] is at
+    // i * targets.size() + j. NO_DISTANCE if there is no route or either coordinate has no ways.
+    std::vector<Distance> route_distance_matrix(std::vector<Coord> const& sources, std::vector<Coord> const& targets);
+
+    // Snapshot operations
+
+    // Estimate of performance: O(n + m + w), where n, m and w are the amounts of places, areas and ways (with their coordinates),
+    // plus O(w log w) for sorting the ways
+    // Short rationale for estimate: Every element is appended once to a single buffer, which is written to the file at once
+    bool save_snapshot(std::string const& filename);
+
+    // Estimate of performance: Same as adding every element with add_places_bulk(), add_area(), add_subarea_to_area() and add_ways_bulk()
+    // Short rationale for estimate: The file is memory-mapped and decoded in place without any text parsing, first checked
+    // completely and then added through the bulk operations. If the file is not a valid snapshot nothing is changed.
+    bool load_snapshot(std::string const& filename);
+
+    // Instrumentation
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Reads the fixed set of counters in stats.hh
+    // The counters with their names, empty if they are not compiled in (DATASTRUCTURES_STATS is not defined).
+    // They are shared by all instances and threads, and count from the start or the last reset_stats().
+    std::vector<std::pair<std::string, std::uint64_t>> stats() const;
+
+    // Estimate of performance: O(1)
+    // Short rationale for estimate: Zeroes the fixed set of counters
+    void reset_stats();
+
 private:
     // Used as flags to determine if the alphabetical_vector_ids_ and coordinate_vector_ids_
-    // are already in order to prevent unnecessary sorting
+    // are up to date to prevent unnecessary copying
     bool coordinate_sorted_;
     bool alphabetical_sorted_;
 
@@ -324,64 +1082,154 @@ private:
     std::vector<PlaceID> alphabetical_vector_ids_;
     std::vector<PlaceID> coordinate_vector_ids_;
 
-    // Pointers to all Places are stored in these three structures, keys as IDs, names and types
-    std::unordered_map<PlaceID, std::shared_ptr<Place>> places_by_id_;
-    // Different from IDs, names and types can overlap, using multimap instead of regular map
-    std::unordered_multimap<Name, std::shared_ptr<Place>> places_by_name_;
-    std::unordered_multimap<PlaceType, std::shared_ptr<Place>> places_by_type_;
-
-    // Areas are only stored by ID
-    std::unordered_map<AreaID, std::shared_ptr<Area>> areas_by_id_;
+    // Estimate of performance: O(n) if the places have changed since the last call, otherwise O(1)
+    // Short rationale for estimate: Copies the ids out of alphabetical_order_ or coordinate_order_ in order
+    void update_alphabetical_vector();
+    void update_coordinate_vector();
+
+    // All places in alphabetical and coordinate order, ties broken by the id. Every operation that changes places
+    // updates these in O(log n), so the orders never have to be sorted from scratch.
+    std::set<std::pair<Symbol, PlaceID>, Alphabetical_less> alphabetical_order_;
+    std::set<std::tuple<long long, int, PlaceID>> coordinate_order_;
+
+    // The names of Places and Areas, and the WayIDs of Ways, are stored as Symbols of these tables.
+    // way_ids_ is emptied by clear_ways() and place_names_ by clear_all().
+    Symbol_table place_names_;
+    Symbol_table way_ids_;
+
+    // Suffix array over the texts of place_names_ for find_places_name_substring(). It also contains names that no place
+    // has anymore, which simply have no places in places_by_name_.
+    Substring_index name_substrings_;
+
+    // All Places are stored in places_, the three structures map IDs, names and types to their slots
+    Slab<Place> places_;
+    Flat_hash_map<PlaceID, int> places_by_id_;
+    // Different from IDs, names and types can overlap, so they map to buckets of slots. A name is erased when its
+    // bucket becomes empty. Place::name_position and Place::type_position tell where the slot is in its buckets.
+    Flat_hash_map<Symbol, std::vector<int>> places_by_name_;
+    std::array<std::vector<int>, static_cast<int>(PlaceType::NO_TYPE) + 1> places_by_type_;
+
+    // Estimate of performance: O(1) on average
+    // Short rationale for estimate: One lookup of the name and a push_back or a swap with the last slot of the bucket
+    // Add the place in the given slot to its name or type bucket, or remove it from there
+    void add_to_name_bucket(int slot);
+    void remove_from_name_bucket(int slot);
+    void add_to_type_bucket(int slot);
+    void remove_from_type_bucket(int slot);
+
+    // One Place_grid per PlaceType, the NO_TYPE grid contains all places
+    std::array<Place_grid, static_cast<int>(PlaceType::NO_TYPE) + 1> place_grids_;
+
+    // Areas are only looked up by ID, the parent and subarea links are slots of areas_
+    Slab<Area> areas_;
+    Flat_hash_map<AreaID, int> areas_by_id_;
+
+    // Valid from creation_finished() until the next add_area(), add_subarea_to_area() or clear_all()
+    Area_index area_index_;
+    bool area_index_valid_;
+
+    // Estimate of performance: O(a log a), where a is the amount of areas
+    // Short rationale for estimate: One iterative preorder traversal of the forest, then log a levels of binary lifting
+    void build_area_index();
 
     // Estimate of performance: O(n), average case is constant
     // Short rationale for estimate: Up to linear between the searched container: std::find()
-    // Used to see if a place exists within the data structure
-    std::shared_ptr<Place> get_place(PlaceID id);
+    // Used to see if a place exists within the data structure, nullptr if not
+    Place* get_place(PlaceID id);
 
     // Estimate of performance: O(n), average case is constant
     // Short rationale for estimate: Up to linear between the searched container: std::find()
-    // Used to see if an area exists within the data structure
-    std::shared_ptr<Area> get_area(AreaID id);
+    // Used to see if an area exists within the data structure, nullptr if not
+    Area* get_area(AreaID id);
 
     // Estimate of performance: θ(n) where n is the amount of children, worst case is n where n is the container size
-    // Short rationale for estimate: Since every child only has constant operations done to them, the runtime is linear to the child amount
-    // Used recursively by the all_subareas_in_area method
-    std::vector<AreaID> get_children(std::weak_ptr<Area> current_area);
+    // Short rationale for estimate: Every child is entered once through a subarea or sibling link and left once through its parent link
+    // Used by the all_subareas_in_area method when the Area_index is not up to date, returns the subareas in preorder
+    std::vector<AreaID> get_children(int area_slot);
 
     // PHASE 2
 
-    // Pointers to all Ways are stored by WayID and Coord within these two data structures
-    std::unordered_map<WayID, std::shared_ptr<Way>> ways_by_id_;
-    std::unordered_multimap<Coord, std::shared_ptr<Way>, CoordHash> ways_by_coord_;
+    // All Ways are stored in ways_, and their slots by WayID Symbol and Coord within these two data structures
+    Way_table ways_;
+    Flat_hash_map<Symbol, int> ways_by_id_;
+    // Only built by the viewport queries
+    Way_grid way_grid_;
+    std::unordered_multimap<Coord, int, CoordHash> ways_by_coord_;
 
     // Stores data about any given crossroad, with the Coord as a key
-    std::unordered_map<Coord, std::shared_ptr<Crossroad_data>, CoordHash> visited_coordinates_;
-
-    // Used to build the returned vectors for the route_any and route_with_cycle functions
-    std::vector<std::tuple<Coord, WayID, Distance>> chosen_route_;
-    std::vector<std::tuple<Coord, WayID>> cyclic_route_;
-
-    // Global variable used to signal recursive functions to stop searching when a route is found
-    bool route_found_;
-
-    // Estimate of performance: O(n) to the amount of ways in ways_by_id_
-    // Short rationale for estimate: we traverse without repetition, which is a
-    // DFS searching algorithm, therefore O(n)
-    void search_any(Coord current, Coord goal, int route_length);
-
-    // Estimate of performance: O(n) to the amount of ways in ways_by_id_
-    // Short rationale for estimate: we traverse without repetition (until the single looping node is found), which is a
-    // DFS searching algorithm, therefore O(n)
-    void search_cycle(Coord current, Coord previous);
-
-    // Estimate of performance: O(n) in the visited_coordinates container size
-    // Short rationale for estimate: Simply loops over the container
-    void clean_for_search(int type);
+    Flat_hash_map<Coord, Crossroad_data, CoordHash> visited_coordinates_;
+
+    // Dense crossroad graph used by the route searches, nullptr until it is rebuilt after the ways have changed.
+    // The per-query state of the searches is thread-local, see thread_search_scratch().
+    std::shared_ptr<Route_graph const> route_graph_;
+    // Built over route_graph_ by prepare_routing(), nullptr if it has not been called since the ways last changed
+    std::shared_ptr<Contraction_hierarchy const> routing_hierarchy_;
+    // Total length of all ways, and a flag telling that they contain no cycles (removing ways keeps it true)
+    Distance total_way_length_;
+    bool ways_trimmed_;
+
+    // Amount of ways created so far, gives the creation number of the next way
+    std::uint64_t ways_created_;
+
+    // The place part of the next Query_snapshot, nullptr after the places have changed
+    std::shared_ptr<Place_snapshot const> place_snapshot_;
+    // Accessed only with std::atomic_load() and std::atomic_store(), as the readers may load it at any time
+    std::shared_ptr<Query_snapshot const> published_snapshot_;
+    std::uint64_t snapshots_published_;
+
+    // Runs the batch queries. The threads are only ever given a Query_snapshot, and each of them keeps its own
+    // thread-local Search_scratch between the batches. The worker threads are started by the first batch query.
+    Thread_pool thread_pool_;
+
+    // Slots of the places and ways added by the bulk operations that are not in the secondary indices yet.
+    // Every operation other than the bulk additions calls build_pending_indices() before using those indices.
+    std::vector<int> pending_places_;
+    std::vector<int> pending_ways_;
+
+    // Set by set_deferred_updates(), and the changes of the indexed places logged in that mode
+    bool deferred_updates_;
+    std::vector<Place_change> place_changes_;
+
+    // Estimate of performance: O(1) on average
+    // Short rationale for estimate: Stores the place and its id like add_places_bulk(), the rest is left to build_pending_indices()
+    // Returns false if a place with the id already exists
+    bool add_pending_place(PlaceID id, Name const& name, PlaceType type, Coord xy);
+
+    // Estimate of performance: O(k) on average, where k is the amount of coordinates
+    // Short rationale for estimate: Same as add_pending_place(), for add_ways_bulk() and the deferred add_way()
+    bool add_pending_way(WayID const& id, std::vector<Coord> const& coords);
+
+    // Estimate of performance: O(1) amortized
+    // Short rationale for estimate: Appends to the change log, only the first change of an indexed place is logged
+    // Logs the keys the place has in the indices before a deferred change, the place itself is not changed yet
+    void log_place_change(int slot);
+
+    // Estimate of performance: O(k log k + n), where k is the amount of pending places and ways, Ω(1) if there are none
+    // Short rationale for estimate: The hash containers are reserved once, the new entries of the ordered sets are sorted
+    // and inserted with hints, and each Place_grid is rebuilt at most once
+    // Adds the pending places and ways to the secondary indices, the ways in the order they were added,
+    // and replaces the logged keys of the places changed in the deferred update mode with their current ones
+    void build_pending_indices();
+
+    // Estimate of performance: O(n + m), where n is the amount of crossroads and m the amount of ways
+    // Short rationale for estimate: Every crossroad and both ends of every way are visited once
+    // Rebuilds route_graph_ if the ways have changed since it was last built
+    void build_route_graph();
 
     // Estimate of performance: O(n), average case is constant
     // Short rationale for estimate: Up to linear between the searched container: std::find()
-    // Used to see if a way exists within the data structure
-    std::shared_ptr<Way> get_way(WayID id);
+    // Used to see if a way exists within the data structure, the slot in ways_ or NO_SLOT if not
+    int find_way(WayID id);
+
+    // Estimate of performance: O(n), where n is the amount of ways with the same ends. Average case constant.
+    // Short rationale for estimate: Same as remove_way(), without looking up the id
+    // Removes the way stored in the given slot of ways_
+    void remove_way_in_slot(int slot);
+
+    // Estimate of performance: O(s) in the size of the snapshot when apply is false, otherwise same as load_snapshot()
+    // Short rationale for estimate: Every record is read once
+    // Decodes a snapshot image. Returns false if it is malformed; the data structure is only changed when apply is true.
+    bool read_snapshot(char const* data, std::size_t size, bool apply);
 };
 
 #endif // DATASTRUCTURES_HH
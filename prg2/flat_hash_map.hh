@@ -0,0 +1,254 @@
+// Flat_hash_map.hh
+
+#ifndef FLAT_HASH_MAP_HH
+#define FLAT_HASH_MAP_HH
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+#include "stats.hh"
+
+// Open-addressing hash map with linear probing, used instead of std::unordered_map for the primary lookups.
+// All entries are stored in one contiguous array, so a lookup is usually a single cache miss instead of
+// a pointer chase through the bucket list. Next to the entries is one control byte per slot: 0 for empty,
+// otherwise the top bits of the hash, so most non-matching slots are skipped without comparing the keys.
+// Erasing shifts the following entries back instead of leaving tombstones.
+// Key and Value have to be default constructible. Any insertion or erase invalidates iterators and pointers.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class Flat_hash_map
+{
+public:
+    using value_type = std::pair<Key, Value>;
+
+    template <bool Is_const>
+    class Basic_iterator
+    {
+    public:
+        using Map = typename std::conditional<Is_const, Flat_hash_map const, Flat_hash_map>::type;
+        using Reference = typename std::conditional<Is_const, value_type const&, value_type&>::type;
+        using Pointer = typename std::conditional<Is_const, value_type const*, value_type*>::type;
+
+        Basic_iterator(Map* map, std::size_t slot): map_(map), slot_(slot) { skip_empty(); }
+        // Allows converting an iterator to a const_iterator
+        operator Basic_iterator<true>() const { return {map_, slot_}; }
+
+        Reference operator*() const { return map_->entries_[slot_]; }
+        Pointer operator->() const { return &map_->entries_[slot_]; }
+        Basic_iterator& operator++()
+        {
+            ++slot_;
+            skip_empty();
+            return *this;
+        }
+        Basic_iterator operator++(int)
+        {
+            Basic_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+        bool operator==(Basic_iterator const& other) const { return slot_ == other.slot_; }
+        bool operator!=(Basic_iterator const& other) const { return slot_ != other.slot_; }
+
+    private:
+        friend class Flat_hash_map;
+        Map* map_;
+        std::size_t slot_;
+
+        void skip_empty()
+        {
+            while (slot_ < map_->control_.size() && map_->control_[slot_] == EMPTY) {
+                ++slot_;
+            }
+        }
+    };
+    using iterator = Basic_iterator<false>;
+    using const_iterator = Basic_iterator<true>;
+
+    iterator begin() { return {this, 0}; }
+    iterator end() { return {this, control_.size()}; }
+    const_iterator begin() const { return {this, 0}; }
+    const_iterator end() const { return {this, control_.size()}; }
+
+    std::size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    void clear()
+    {
+        entries_.clear();
+        control_.clear();
+        size_ = 0;
+    }
+
+    // Makes room for count entries without growing again
+    void reserve(std::size_t count)
+    {
+        std::size_t capacity = MIN_CAPACITY;
+        while (capacity * MAX_LOAD_NUMERATOR < count * MAX_LOAD_DENOMINATOR) {
+            capacity *= 2;
+        }
+        if (capacity > control_.size()) {
+            rehash(capacity);
+        }
+    }
+
+    iterator find(Key const& key) { return {this, find_slot(key)}; }
+    const_iterator find(Key const& key) const { return {this, find_slot(key)}; }
+    std::size_t count(Key const& key) const { return find_slot(key) != control_.size(); }
+
+    Value& at(Key const& key)
+    {
+        std::size_t slot = find_slot(key);
+        if (slot == control_.size()) {
+            throw std::out_of_range("Flat_hash_map::at");
+        }
+        return entries_[slot].second;
+    }
+    Value const& at(Key const& key) const
+    {
+        std::size_t slot = find_slot(key);
+        if (slot == control_.size()) {
+            throw std::out_of_range("Flat_hash_map::at");
+        }
+        return entries_[slot].second;
+    }
+
+    // Inserts the value constructed from args only if the key does not exist yet. The table only grows when
+    // the key is really inserted, so finding an existing key never invalidates references or iterators.
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key const& key, Args&&... args)
+    {
+        stats_add(Stat::HASH_LOOKUPS);
+        Stats_tally probes(Stat::HASH_PROBES);
+        std::size_t hash = mixed_hash(key);
+        unsigned char tag = tag_of(hash);
+        std::size_t slot = 0;
+        if (!control_.empty()) {
+            for (slot = hash & mask_; control_[slot] != EMPTY; slot = (slot + 1) & mask_) {
+                probes.add();
+                if (control_[slot] == tag && entries_[slot].first == key) {
+                    return {iterator(this, slot), false};
+                }
+            }
+        }
+        if ((size_ + 1) * MAX_LOAD_DENOMINATOR > control_.size() * MAX_LOAD_NUMERATOR) {
+            rehash(control_.empty() ? MIN_CAPACITY : control_.size() * 2);
+            // The key is not in the table, so only the first empty slot is looked for again
+            for (slot = hash & mask_; control_[slot] != EMPTY; slot = (slot + 1) & mask_) {
+                probes.add();
+            }
+        }
+        control_[slot] = tag;
+        entries_[slot] = value_type(key, Value(std::forward<Args>(args)...));
+        ++size_;
+        return {iterator(this, slot), true};
+    }
+
+    std::pair<iterator, bool> insert(value_type const& entry) { return try_emplace(entry.first, entry.second); }
+
+    Value& operator[](Key const& key) { return try_emplace(key).first->second; }
+
+    // Returns the amount of erased entries, 0 or 1
+    std::size_t erase(Key const& key)
+    {
+        std::size_t slot = find_slot(key);
+        if (slot == control_.size()) {
+            return 0;
+        }
+        erase_slot(slot);
+        return 1;
+    }
+    void erase(const_iterator position) { erase_slot(position.slot_); }
+
+private:
+    static constexpr unsigned char EMPTY = 0;
+    static constexpr std::size_t MIN_CAPACITY = 16;
+    // The table is grown before it gets fuller than 3/4
+    static constexpr std::size_t MAX_LOAD_NUMERATOR = 3;
+    static constexpr std::size_t MAX_LOAD_DENOMINATOR = 4;
+
+    std::vector<value_type> entries_;
+    std::vector<unsigned char> control_;
+    std::size_t size_ = 0;
+    std::size_t mask_ = 0;
+
+    // Linear probing needs the low bits to be well distributed, which std::hash of integers does not do,
+    // so the hash is put through the finalizer of MurmurHash3 first
+    static std::size_t mixed_hash(Key const& key)
+    {
+        std::uint64_t hash = Hash()(key);
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return static_cast<std::size_t>(hash);
+    }
+    // Top 7 bits of the hash with the highest bit set, so that a tag is never EMPTY
+    static unsigned char tag_of(std::size_t hash)
+    {
+        return static_cast<unsigned char>(0x80 | (static_cast<std::uint64_t>(hash) >> 57));
+    }
+
+    std::size_t find_slot(Key const& key) const
+    {
+        stats_add(Stat::HASH_LOOKUPS);
+        if (size_ == 0) {
+            return control_.size();
+        }
+        Stats_tally probes(Stat::HASH_PROBES);
+        std::size_t hash = mixed_hash(key);
+        unsigned char tag = tag_of(hash);
+        for (std::size_t slot = hash & mask_; control_[slot] != EMPTY; slot = (slot + 1) & mask_) {
+            probes.add();
+            if (control_[slot] == tag && entries_[slot].first == key) {
+                return slot;
+            }
+        }
+        return control_.size();
+    }
+
+    // Backward-shift deletion: the entries after the hole that may be moved to it are moved, until an empty slot
+    void erase_slot(std::size_t hole)
+    {
+        control_[hole] = EMPTY;
+        --size_;
+        for (std::size_t slot = (hole + 1) & mask_; control_[slot] != EMPTY; slot = (slot + 1) & mask_) {
+            std::size_t home = mixed_hash(entries_[slot].first) & mask_;
+            // The entry can fill the hole only if its home slot is not in the cyclic range (hole, slot]
+            bool home_after_hole = hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot);
+            if (!home_after_hole) {
+                entries_[hole] = std::move(entries_[slot]);
+                control_[hole] = control_[slot];
+                control_[slot] = EMPTY;
+                hole = slot;
+            }
+        }
+        entries_[hole] = value_type();
+    }
+
+    void rehash(std::size_t capacity)
+    {
+        stats_add(Stat::HASH_REHASHES);
+        std::vector<value_type> old_entries(capacity);
+        std::vector<unsigned char> old_control(capacity, EMPTY);
+        old_entries.swap(entries_);
+        old_control.swap(control_);
+        mask_ = capacity - 1;
+        for (std::size_t i = 0; i != old_control.size(); ++i) {
+            if (old_control[i] == EMPTY) {
+                continue;
+            }
+            std::size_t slot = mixed_hash(old_entries[i].first) & mask_;
+            while (control_[slot] != EMPTY) {
+                slot = (slot + 1) & mask_;
+            }
+            control_[slot] = old_control[i];
+            entries_[slot] = std::move(old_entries[i]);
+        }
+    }
+};
+
+#endif // FLAT_HASH_MAP_HH
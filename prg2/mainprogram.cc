@@ -109,6 +109,7 @@ using std::transform;
 using std::back_inserter;
 
 #include <cstddef>
+#include <cctype>
 #include <cassert>
 
 
@@ -116,10 +117,46 @@ using std::back_inserter;
 
 #include "datastructures.hh"
 
+#include "allocation_count.hh"
+
 #ifdef GRAPHICAL_GUI
 #include "mainwindow.hh"
 #endif
 
+// Peak resident set size of the process in kB. On Linux the peak can be reset, so that perftest can report
+// the memory high-water mark of each N separately, elsewhere 0 is reported.
+void reset_peak_rss()
+{
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5" << flush;
+#endif
+}
+
+unsigned long int peak_rss_kb()
+{
+#ifdef __linux__
+    ifstream status("/proc/self/status");
+    for (string line; getline(status, line); )
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            return std::strtoul(line.c_str() + 6, nullptr, 10);
+        }
+    }
+#endif
+    return 0;
+}
+
+// Nearest-rank percentile, reorders the values
+double percentile(vector<double>& values, double fraction)
+{
+    if (values.empty()) { return 0; }
+    auto rank = static_cast<vector<double>::size_type>(std::ceil(fraction * values.size()));
+    auto pos = values.begin() + (rank == 0 ? 0 : rank - 1);
+    std::nth_element(values.begin(), pos, values.end());
+    return *pos;
+}
+
 string const MainProgram::PROMPT = "> ";
 
 MainProgram::CmdResult MainProgram::cmd_add_place(std::ostream& output, MatchIter begin, MatchIter end)
@@ -132,13 +169,19 @@ MainProgram::CmdResult MainProgram::cmd_add_place(std::ostream& output, MatchIte
     assert( begin == end && "Impossible number of parameters!");
 
     PlaceID id = convert_string_to<PlaceID>(idstr);
+    Coord xy = {convert_string_to<int>(xstr), convert_string_to<int>(ystr)};
+
+    return add_place_parsed(output, id, name, typestr, xy);
+}
+
+MainProgram::CmdResult MainProgram::add_place_parsed(std::ostream& output, PlaceID id, Name const& name, std::string const& typestr, Coord xy)
+{
     PlaceType type = convert_string_to_placetype(typestr);
     if (type == PlaceType::NO_TYPE)
     {
         output << "Impossible place type: " << typestr << endl;
         return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{NO_AREA, {NO_PLACE}}};
     }
-    Coord xy = {convert_string_to<int>(xstr), convert_string_to<int>(ystr)};
 
     bool success = ds_.add_place(id, name, type, xy);
     if (!success) { id = NO_PLACE; }
@@ -168,9 +211,9 @@ MainProgram::CmdResult MainProgram::cmd_place_name_type(std::ostream &output, Ma
 
 void MainProgram::test_place_name_type()
 {
-    if (random_places_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
     {
-        PlaceID id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
+        PlaceID id = random_data_.n_to_placeid(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
         ds_.get_place_name_type(id);
     }
 }
@@ -197,9 +240,9 @@ MainProgram::CmdResult MainProgram::cmd_place_coord(std::ostream &output, MainPr
 
 void MainProgram::test_place_coord()
 {
-    if (random_places_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
     {
-        PlaceID id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
+        PlaceID id = random_data_.n_to_placeid(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
         ds_.get_place_coord(id);
     }
 }
@@ -213,15 +256,11 @@ MainProgram::CmdResult MainProgram::cmd_add_area(std::ostream& output, MainProgr
 
     AreaID id = convert_string_to<AreaID>(idstr);
 
-    vector<Coord> coords;
-    smatch coord;
-    auto sbeg = coordsstr.cbegin();
-    auto send = coordsstr.cend();
-    for ( ; regex_search(sbeg, send, coord, coords_regex_); sbeg = coord.suffix().first)
-    {
-        coords.push_back({convert_string_to<int>(coord[1]),convert_string_to<int>(coord[2])});
-    }
+    return add_area_parsed(output, id, name, parse_coords(coordsstr));
+}
 
+MainProgram::CmdResult MainProgram::add_area_parsed(std::ostream& output, AreaID id, Name const& name, std::vector<Coord> const& coords)
+{
     if (coords.size() < 3)
     {
         output << "An area must have at least 3 coords, only " << coords.size() << " coords given!" << endl;
@@ -263,9 +302,9 @@ MainProgram::CmdResult MainProgram::cmd_area_name(std::ostream &output, MainProg
 
 void MainProgram::test_area_name()
 {
-    if (random_areas_added_ > 0)
+    if (random_data_.areas_added > 0)
     {
-        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
         ds_.get_area_name(id);
     }
 }
@@ -322,10 +361,10 @@ MainProgram::CmdResult MainProgram::cmd_change_place_name(std::ostream& /*output
 
 void MainProgram::test_change_place_name()
 {
-  if (random_places_added_ > 0) // Don't do anything if there's no places
+  if (random_data_.places_added > 0) // Don't do anything if there's no places
   {
-      PlaceID id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
-      auto newname = n_to_name(random<decltype(random_places_added_)>(0, random_places_added_));
+      PlaceID id = random_data_.n_to_placeid(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
+      auto newname = random_data_.n_to_name(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
       ds_.change_place_name(id, newname);
   }
 }
@@ -351,9 +390,9 @@ MainProgram::CmdResult MainProgram::cmd_change_place_coord(std::ostream& /*outpu
 
 void MainProgram::test_change_place_coord()
 {
-    if (random_places_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
     {
-        PlaceID id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
+        PlaceID id = random_data_.n_to_placeid(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
         auto x = random(0, 1000);
         auto y = random(0, 1000);
         ds_.change_place_coord(id, {x, y});
@@ -394,6 +433,11 @@ MainProgram::CmdResult MainProgram::cmd_add_way(std::ostream& output, MainProgra
 
     WayID id = idstr;
 
+    return add_way_parsed(output, id, parse_coords(coordsstr));
+}
+
+std::vector<Coord> MainProgram::parse_coords(std::string const& coordsstr)
+{
     vector<Coord> coords;
     smatch coord;
     auto sbeg = coordsstr.cbegin();
@@ -402,7 +446,11 @@ MainProgram::CmdResult MainProgram::cmd_add_way(std::ostream& output, MainProgra
     {
         coords.push_back({convert_string_to<int>(coord[1]),convert_string_to<int>(coord[2])});
     }
+    return coords;
+}
 
+MainProgram::CmdResult MainProgram::add_way_parsed(std::ostream& output, WayID const& id, std::vector<Coord> const& coords)
+{
     if (coords.size() < 2)
     {
         output << "A way must have at least 2 points, only " << coords.size() << " points given!" << endl;
@@ -445,9 +493,9 @@ MainProgram::CmdResult MainProgram::cmd_subarea_in_areas(std::ostream& output, M
 
 void MainProgram::test_subarea_in_areas()
 {
-    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.areas_added > 0) // Don't do anything if there's no places
     {
-        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
         ds_.subarea_in_areas(id);
     }
 }
@@ -470,9 +518,9 @@ MainProgram::CmdResult MainProgram::cmd_all_subareas_in_area(std::ostream &outpu
 
 void MainProgram::test_all_subareas_in_area()
 {
-    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.areas_added > 0) // Don't do anything if there's no places
     {
-        auto id = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
         ds_.all_subareas_in_area(id);
     }
 }
@@ -497,7 +545,7 @@ MainProgram::CmdResult MainProgram::cmd_places_closest_to(std::ostream& /*output
 
 void MainProgram::test_places_closest_to()
 {
-    if (random_places_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
     {
         auto x = random<int>(0, 1000);
         auto y = random<int>(0, 1000);
@@ -506,6 +554,74 @@ void MainProgram::test_places_closest_to()
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_places_k_nearest(std::ostream& /*output*/, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+  string xstr = *begin++;
+  string ystr = *begin++;
+  string kstr = *begin++;
+  string typestr = *begin++;
+  assert( begin == end && "Impossible number of parameters!");
+
+  Coord coord = {convert_string_to<int>(xstr),convert_string_to<int>(ystr)};
+  unsigned int k = convert_string_to<unsigned int>(kstr);
+  PlaceType type = PlaceType::NO_TYPE;
+  if (!typestr.empty())
+  {
+      type = convert_string_to_placetype(typestr);
+  }
+
+  auto result = ds_.places_k_nearest(coord, type, k);
+  return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{NO_AREA, result}};
+}
+
+void MainProgram::test_places_k_nearest()
+{
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
+    {
+        auto x = random<int>(0, 1000);
+        auto y = random<int>(0, 1000);
+        auto k = random<unsigned int>(1, 20);
+        PlaceType type{random(0, static_cast<int>(PlaceType::NO_TYPE))};
+        ds_.places_k_nearest({x,y}, type, k);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_places_within_radius(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+  string xstr = *begin++;
+  string ystr = *begin++;
+  string radiusstr = *begin++;
+  string typestr = *begin++;
+  assert( begin == end && "Impossible number of parameters!");
+
+  Coord coord = {convert_string_to<int>(xstr),convert_string_to<int>(ystr)};
+  Distance radius = convert_string_to<Distance>(radiusstr);
+  PlaceType type = PlaceType::NO_TYPE;
+  if (!typestr.empty())
+  {
+      type = convert_string_to_placetype(typestr);
+  }
+
+  auto result = ds_.places_within_radius(coord, type, radius);
+  if (result.empty())
+  {
+      output << "No Places!" << std::endl;
+  }
+  return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{NO_AREA, result}};
+}
+
+void MainProgram::test_places_within_radius()
+{
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
+    {
+        auto x = random<int>(0, 1000);
+        auto y = random<int>(0, 1000);
+        auto radius = random<Distance>(1, 100);
+        PlaceType type{random(0, static_cast<int>(PlaceType::NO_TYPE))};
+        ds_.places_within_radius({x,y}, type, radius);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_common_area_of_subareas(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     string id1str = *begin++;
@@ -528,10 +644,10 @@ MainProgram::CmdResult MainProgram::cmd_common_area_of_subareas(std::ostream &ou
 
 void MainProgram::test_common_area_of_subareas()
 {
-    if (random_areas_added_ > 0) // Don't do anything if there's no places
+    if (random_data_.areas_added > 0) // Don't do anything if there's no places
     {
-        auto id1 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
-        auto id2 = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+        auto id1 = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
+        auto id2 = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
         ds_.common_area_of_subareas(id1, id2);
     }
 }
@@ -583,9 +699,9 @@ MainProgram::CmdResult MainProgram::cmd_ways_from(std::ostream& output, MainProg
 
 void MainProgram::test_ways_from()
 {
- if (random_ways_added_ > 0) // Don't do anything if there's no ways
+ if (random_data_.ways_added > 0) // Don't do anything if there's no ways
  {
-     auto coord = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+     auto coord = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
      ds_.ways_from(coord);
  }
 }
@@ -615,9 +731,9 @@ MainProgram::CmdResult MainProgram::cmd_way_coords(std::ostream& output, MainPro
 
 void MainProgram::test_way_coords()
 {
-    if (random_ways_added_ > 0)
+    if (random_data_.ways_added > 0)
     {
-        WayID id = n_to_wayid(random<decltype(random_ways_added_)>(0, random_ways_added_));
+        WayID id = random_data_.n_to_wayid(random<decltype(random_data_.ways_added)>(0, random_data_.ways_added));
         ds_.get_way_coords(id);
     }
 }
@@ -645,48 +761,16 @@ MainProgram::CmdResult MainProgram::cmd_remove_place(std::ostream& output, Match
 void MainProgram::test_remove_place()
 {
     // Choose random number to remove
-    if (random_places_added_ > 0) // Don't remove if there's nothing to remove
+    if (random_data_.places_added > 0) // Don't remove if there's nothing to remove
     {
-        auto id = n_to_placeid(random<decltype(random_places_added_)>(0, random_places_added_));
+        auto id = random_data_.n_to_placeid(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
         ds_.remove_place(id);
     }
 }
 
 void MainProgram::add_random_places_areas(unsigned int size, Coord min, Coord max)
 {
-    for (unsigned int i = 0; i < size; ++i)
-    {
-        auto name = n_to_name(random_places_added_);
-        PlaceID id = n_to_placeid(random_places_added_);
-        PlaceType type{random(0, static_cast<int>(PlaceType::NO_TYPE))};
-
-        int x = random<int>(min.x, max.x);
-        int y = random<int>(min.y, max.y);
-
-        ds_.add_place(id, name, type, {x, y});
-
-        // Add a new area for every 10 places
-        if (random_places_added_ % 10 == 0)
-        {
-            auto areaid = n_to_areaid(random_areas_added_);
-            vector<Coord> coords;
-            for (int j=0; j<3; ++j)
-            {
-                coords.push_back({random<int>(min.x, max.x),random<int>(min.y, max.y)});
-            }
-            ds_.add_area(areaid, convert_to_string(areaid), std::move(coords));
-            // Add area as subarea so that we get a binary tree
-            if (random_areas_added_ > 0)
-            {
-//                auto parentid = random<decltype(random_areas_added_)>(0, random_areas_added_);
-                auto parentid = n_to_areaid(random_areas_added_ / 2);
-                ds_.add_subarea_to_area(areaid, parentid);
-            }
-            ++random_areas_added_;
-        }
-
-        ++random_places_added_;
-    }
+    random_data_.add_places_areas(ds_, size, min, max);
 }
 
 MainProgram::CmdResult MainProgram::cmd_random_add(std::ostream& output, MatchIter begin, MatchIter end)
@@ -778,8 +862,8 @@ MainProgram::CmdResult MainProgram::cmd_randseed(std::ostream& output, MatchIter
 
     unsigned long int seed = convert_string_to<unsigned long int>(seedstr);
 
-    rand_engine_.seed(seed);
-    init_primes();
+    random_data_.engine.seed(seed);
+    random_data_.init_primes();
 
     output << "Random seed set to " << seed << endl;
 
@@ -931,6 +1015,93 @@ MainProgram::CmdResult MainProgram::cmd_testread(std::ostream& output, MatchIter
     return {};
 }
 
+MainProgram::CmdResult MainProgram::cmd_parse_benchmark(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    string repeatstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int repeat_count = convert_string_to<unsigned int>(repeatstr);
+    ifstream input(filename);
+    if (!input)
+    {
+        output << "Cannot open file '" << filename << "'!" << endl;
+        return {};
+    }
+    vector<string> lines;
+    for (string line; getline(input, line); )
+    {
+        lines.push_back(line);
+    }
+
+    output << "Parsing " << lines.size() << " lines of '" << filename << "' " << repeat_count << " times (the data is cleared before each time)" << endl;
+    bool fast_was_enabled = fast_parse_enabled_;
+    for (bool fast : {false, true})
+    {
+        fast_parse_enabled_ = fast;
+        Stopwatch stopwatch;
+        for (unsigned int i = 0; i < repeat_count; ++i)
+        {
+            ds_.clear_all();
+            ds_.clear_ways();
+            ostringstream discarded_output;
+            stopwatch.start();
+            for (auto const& line : lines)
+            {
+                command_parse_line(line, discarded_output);
+            }
+            stopwatch.stop();
+        }
+        double seconds = stopwatch.elapsed();
+        output << (fast ? "Fast path:  " : "Regex only: ") << seconds << " sec, ";
+        if (seconds > 0) { output << static_cast<unsigned long int>(lines.size() * repeat_count / seconds) << " lines/sec"; }
+        output << endl;
+    }
+    fast_parse_enabled_ = fast_was_enabled;
+
+    random_data_.init_primes();
+    view_dirty = true;
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (ds_.save_snapshot(filename))
+    {
+        output << "Snapshot saved to '" << filename << "'" << endl;
+    }
+    else
+    {
+        output << "Cannot write snapshot to file '" << filename << "'!" << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string filename = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (ds_.load_snapshot(filename))
+    {
+        // The previous places, areas and ways are gone, so random ids start from the beginning again
+        random_data_.init_primes();
+        output << "Snapshot loaded from '" << filename << "': " << ds_.place_count() << " places, "
+               << ds_.all_areas().size() << " areas, " << ds_.all_ways().size() << " ways" << endl;
+        view_dirty = true;
+    }
+    else
+    {
+        output << "Cannot load snapshot from file '" << filename << "'!" << endl;
+    }
+
+    return {};
+}
+
 MainProgram::CmdResult MainProgram::cmd_place_count(std::ostream& output, MatchIter begin, MatchIter end)
 {
     assert( begin == end && "Impossible number of parameters!");
@@ -970,18 +1141,7 @@ MainProgram::CmdResult MainProgram::cmd_all_areas(std::ostream& output, MainProg
 
 void MainProgram::add_random_ways(unsigned int n)
 {
-    for (unsigned int i=0; i<n; ++i)
-    {
-        ++random_ways_added_;
-
-        WayID id = n_to_wayid(random_ways_added_);
-        Coord c1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
-        Coord c2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
-        if (c1.x != c2.x || c1.y != c2.y)
-        {
-            ds_.add_way(id, {c1,c2});
-        }
-    }
+    random_data_.add_ways(ds_, n);
 }
 
 MainProgram::CmdResult MainProgram::cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end)
@@ -1019,7 +1179,7 @@ MainProgram::CmdResult MainProgram::cmd_clear_all(std::ostream& output, MatchIte
     assert(begin == end && "Invalid number of parameters");
 
     ds_.clear_all();
-    init_primes();
+    random_data_.init_primes();
 
     output << "Cleared everything." << endl;
 
@@ -1167,13 +1327,74 @@ MainProgram::CmdResult MainProgram::cmd_find_places_name(std::ostream& output, M
 void MainProgram::test_find_places_name()
 {
     // Choose random number to remove
-    if (random_places_added_ > 0) // Don't find if there's nothing to find
+    if (random_data_.places_added > 0) // Don't find if there's nothing to find
     {
-        auto name = n_to_name(random<decltype(random_places_added_)>(0, random_places_added_));
+        auto name = random_data_.n_to_name(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
         ds_.find_places_name(name);
     }
 }
 
+MainProgram::CmdResult MainProgram::cmd_find_places_name_prefix(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string prefix = *begin++;
+    string limitstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    size_t limit = std::numeric_limits<size_t>::max();
+    if (!limitstr.empty())
+    {
+        limit = convert_string_to<size_t>(limitstr);
+    }
+
+    auto result = ds_.find_places_name_prefix(prefix, limit);
+    if (result.empty())
+    {
+        output << "No Places!" << std::endl;
+    }
+    // Kept in the alphabetical order of the names
+    return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{NO_AREA, result}};
+}
+
+void MainProgram::test_find_places_name_prefix()
+{
+    if (random_data_.places_added > 0) // Don't find if there's nothing to find
+    {
+        auto name = random_data_.n_to_name(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
+        ds_.find_places_name_prefix(name.substr(0, random<size_t>(1, 4)), 10);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_find_places_name_substring(std::ostream& output, MatchIter begin, MatchIter end)
+{
+    string part = *begin++;
+    string limitstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    size_t limit = std::numeric_limits<size_t>::max();
+    if (!limitstr.empty())
+    {
+        limit = convert_string_to<size_t>(limitstr);
+    }
+
+    auto result = ds_.find_places_name_substring(part, limit);
+    if (result.empty())
+    {
+        output << "No Places!" << std::endl;
+    }
+    // Kept in the order the matches were found in
+    return {ResultType::PLACEIDLIST, CmdResultPlaceIDs{NO_AREA, result}};
+}
+
+void MainProgram::test_find_places_name_substring()
+{
+    if (random_data_.places_added > 0) // Don't find if there's nothing to find
+    {
+        auto name = random_data_.n_to_name(random<decltype(random_data_.places_added)>(0, random_data_.places_added));
+        auto start = random<size_t>(0, name.size());
+        ds_.find_places_name_substring(name.substr(start, 3), 10);
+    }
+}
+
 MainProgram::CmdResult MainProgram::cmd_find_places_type(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     string typestr = *begin++;
@@ -1199,7 +1420,7 @@ MainProgram::CmdResult MainProgram::cmd_find_places_type(std::ostream &output, M
 void MainProgram::test_find_places_type()
 {
     // Choose random number to remove
-    if (random_places_added_ > 0) // Don't find if there's nothing to find
+    if (random_data_.places_added > 0) // Don't find if there's nothing to find
     {
         PlaceType type{random<int>(0, static_cast<int>(PlaceType::NO_TYPE))};
         ds_.find_places_type(type);
@@ -1247,8 +1468,8 @@ MainProgram::CmdResult MainProgram::cmd_route_any(std::ostream& output, MainProg
 void MainProgram::test_route_any()
 {
     // Choose two random places
-    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
-    Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord1 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
+    Coord coord2 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
 
     ds_.route_any(coord1, coord2);
 }
@@ -1275,9 +1496,9 @@ MainProgram::CmdResult MainProgram::cmd_remove_way(std::ostream &output, MainPro
 
 void MainProgram::test_remove_way()
 {
-    if (random_ways_added_ > 0)
+    if (random_data_.ways_added > 0)
     {
-        WayID id = n_to_wayid(random<decltype(random_ways_added_)>(0, random_ways_added_));
+        WayID id = random_data_.n_to_wayid(random<decltype(random_data_.ways_added)>(0, random_data_.ways_added));
         ds_.remove_way(id);
     }
 }
@@ -1323,8 +1544,8 @@ MainProgram::CmdResult MainProgram::cmd_route_shortest_distance(std::ostream& ou
 void MainProgram::test_route_shortest_distance()
 {
     // Choose two random places
-    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
-    Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord1 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
+    Coord coord2 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
 
     ds_.route_shortest_distance(coord1, coord2);
 }
@@ -1370,8 +1591,8 @@ MainProgram::CmdResult MainProgram::cmd_route_least_crossroads(std::ostream& out
 void MainProgram::test_route_least_crossroads()
 {
     // Choose two random places
-    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
-    Coord coord2 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord1 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
+    Coord coord2 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
 
     ds_.route_least_crossroads(coord1, coord2);
 }
@@ -1447,7 +1668,7 @@ MainProgram::CmdResult MainProgram::cmd_route_with_cycle(std::ostream& output, M
 void MainProgram::test_route_with_cycle()
 {
     // Choose two random places
-    Coord coord1 = n_to_coord(random(decltype(random_ways_added_)(0),random_ways_added_));
+    Coord coord1 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
 
     ds_.route_with_cycle(coord1);
 }
@@ -1470,76 +1691,413 @@ void MainProgram::test_trim_ways()
     ds_.trim_ways();
 }
 
-MainProgram::CmdResult MainProgram::cmd_clear_ways(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+MainProgram::CmdResult MainProgram::cmd_prepare_routing(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
 {
     assert( begin == end && "Impossible number of parameters!");
 
-    ds_.clear_ways();
-    output << "All routes removed." << std::endl;
+    auto shortcuts = ds_.prepare_routing();
+
+    output << "Contraction hierarchy ready with " << shortcuts << " shortcuts" << endl;
 
     return {};
 }
 
-string const plcidx = "([0-9]+)";
-string const areaidx = "([0-9]+)";
-string const wayidx = "([a-zA-Z0-9]+)";
-string const namex = "'([a-zA-Z0-9 -]+)'";
-string const typex = "([a-zA-Z0-9]+)";
-string const numx = "([0-9]+)";
-string const optcoordx = "\\([[:space:]]*[0-9]+[[:space:]]*,[[:space:]]*[0-9]+[[:space:]]*\\)";
-string const coordx = "\\([[:space:]]*([0-9]+)[[:space:]]*,[[:space:]]*([0-9]+)[[:space:]]*\\)";
-string const wsx = "[[:space:]]+";
-
-vector<MainProgram::CmdInfo> MainProgram::cmds_ =
+void MainProgram::test_prepare_routing()
 {
-    {"add_place", "ID 'Name' Type (x,y)", plcidx+wsx+namex+wsx+typex+wsx+coordx, &MainProgram::cmd_add_place, nullptr },
-    {"random_add", "number_of_places_to_add  [(minx,miny) (maxx,maxy)] (coordinates optional)", numx+"(?:"+wsx+coordx+wsx+coordx+")?",
-     &MainProgram::cmd_random_add, &MainProgram::test_random_add },
-    {"all_places", "", "", &MainProgram::cmd_all_places, nullptr },
-    {"place_name_type", "ID", plcidx, &MainProgram::cmd_place_name_type, &MainProgram::test_place_name_type },
-    {"place_coord", "ID", plcidx, &MainProgram::cmd_place_coord, &MainProgram::test_place_coord },
-    {"add_area", "ID Name (x,y) (x,y)...", areaidx+wsx+namex+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_area, nullptr },
-    {"all_areas", "", "", &MainProgram::cmd_all_areas, nullptr },
-    {"area_name", "AreaID", areaidx, &MainProgram::cmd_area_name, &MainProgram::test_area_name },
-    {"area_coords", "AreaID", areaidx, &MainProgram::cmd_area_coords, nullptr },
-    {"creation_finished", "", "", &MainProgram::cmd_creation_finished, nullptr },
-    {"place_count", "", "", &MainProgram::cmd_place_count, nullptr },
-    {"clear_all", "", "", &MainProgram::cmd_clear_all, nullptr },
-    {"places_alphabetically", "", "", &MainProgram::NoParPlaceListCmd<&Datastructures::places_alphabetically>, &MainProgram::NoParPlaceListTestCmd<&Datastructures::places_alphabetically> },
-    {"places_coord_order", "", "", &MainProgram::NoParPlaceListCmd<&Datastructures::places_coord_order>, &MainProgram::NoParPlaceListTestCmd<&Datastructures::places_coord_order> },
-    {"places_closest_to", "Coord [type] (type optional)", coordx+"(?:"+wsx+typex+")?", &MainProgram::cmd_places_closest_to, &MainProgram::test_places_closest_to },
-    {"common_area_of_subareas", "ID1 ID2", plcidx+wsx+plcidx, &MainProgram::cmd_common_area_of_subareas, &MainProgram::test_common_area_of_subareas },
-    {"remove_place", "ID", plcidx, &MainProgram::cmd_remove_place, &MainProgram::test_remove_place },
-    {"find_places_name", "'Name'", namex, &MainProgram::cmd_find_places_name, &MainProgram::test_find_places_name },
-    {"find_places_type", "type", typex, &MainProgram::cmd_find_places_type, &MainProgram::test_find_places_type },
-    {"change_place_name", "ID 'Newname'", plcidx+wsx+namex, &MainProgram::cmd_change_place_name, &MainProgram::test_change_place_name },
-    {"change_place_coord", "ID (x,y)", plcidx+wsx+coordx, &MainProgram::cmd_change_place_coord, &MainProgram::test_change_place_coord },
-    {"add_subarea_to_area", "SubareaID AreaID", areaidx+wsx+areaidx, &MainProgram::cmd_add_subarea_to_area, nullptr },
-    {"all_ways", "", "", &MainProgram::cmd_all_ways, nullptr },
-    {"add_way", "WayID (x,y) (x,y)...", wayidx+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_way, nullptr },
-    {"random_ways", "number_of_ways_to_add", numx,
-     &MainProgram::cmd_random_ways, &MainProgram::test_random_ways },
-    {"way_coords", "WayID", wayidx, &MainProgram::cmd_way_coords, &MainProgram::test_way_coords },
-    {"ways_from", "Coord", coordx, &MainProgram::cmd_ways_from, &MainProgram::test_ways_from },
-    {"clear_ways", "", "", &MainProgram::cmd_clear_ways, nullptr },
-    {"remove_way", "WayID", wayidx, &MainProgram::cmd_remove_way, &MainProgram::test_remove_way },
-    {"subarea_in_areas", "AreaID", areaidx, &MainProgram::cmd_subarea_in_areas, &MainProgram::test_subarea_in_areas },
-    {"all_subareas_in_area", "AreaID", areaidx, &MainProgram::cmd_all_subareas_in_area, &MainProgram::test_all_subareas_in_area },
-    {"route_any", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_any, &MainProgram::test_route_any },
-    {"route_least_crossroads", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_least_crossroads, &MainProgram::test_route_least_crossroads },
-    {"route_shortest_distance", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_shortest_distance, &MainProgram::test_route_shortest_distance },
-    {"route_with_cycle", "Coordfrom", coordx, &MainProgram::cmd_route_with_cycle, &MainProgram::test_route_with_cycle },
-    {"trim_ways", "", "", &MainProgram::cmd_trim_ways, &MainProgram::test_trim_ways },
-    {"quit", "", "", nullptr, nullptr },
-    {"help", "", "", &MainProgram::help_command, nullptr },
-    {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
-    {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
-    {"perftest", "cmd1|all|compulsory[;cmd2...] timeout repeat_count n1[;n2...] (parts in [] are optional, alternatives separated by |)",
-     "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)", &MainProgram::cmd_perftest, nullptr },
-    {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
-    {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
-    {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
-};
+    ds_.prepare_routing();
+}
+
+// Amount of queries in one batch of the route_many and closest_many perftests
+unsigned int const BATCH_TEST_SIZE = 100;
+
+MainProgram::CmdResult MainProgram::cmd_route_many(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string countstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int count = convert_string_to<unsigned int>(countstr);
+
+    // The routes are searched between random ends of the existing ways
+    vector<Coord> crossroads;
+    for (auto const& wayid : ds_.all_ways())
+    {
+        auto coords = ds_.get_way_coords(wayid);
+        crossroads.push_back(coords.front());
+        crossroads.push_back(coords.back());
+    }
+    if (crossroads.empty())
+    {
+        output << "No ways!" << endl;
+        return {};
+    }
+    vector<pair<Coord, Coord>> queries;
+    queries.reserve(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        Coord fromxy = crossroads[random<size_t>(0, crossroads.size())];
+        Coord toxy = crossroads[random<size_t>(0, crossroads.size())];
+        queries.emplace_back(fromxy, toxy);
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    auto routes = ds_.route_many(queries);
+    stopwatch.stop();
+
+    auto found = count_if(routes.begin(), routes.end(), [](auto const& route){ return !route.empty(); });
+    output << found << " of the routes found" << endl;
+    if (stopwatch_mode != StopwatchMode::OFF)
+    {
+        print_batch_throughput(output, count, "routes", stopwatch);
+    }
+
+    return {};
+}
+
+void MainProgram::test_route_many()
+{
+    vector<pair<Coord, Coord>> queries;
+    for (unsigned int i = 0; i < BATCH_TEST_SIZE; ++i)
+    {
+        Coord coord1 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
+        Coord coord2 = random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added));
+        queries.emplace_back(coord1, coord2);
+    }
+    ds_.route_many(queries);
+}
+
+MainProgram::CmdResult MainProgram::cmd_closest_many(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string countstr = *begin++;
+    string typestr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    unsigned int count = convert_string_to<unsigned int>(countstr);
+    PlaceType type = PlaceType::NO_TYPE;
+    if (!typestr.empty())
+    {
+        type = convert_string_to_placetype(typestr);
+    }
+
+    // The queries are spread over the bounding box of the existing places
+    auto placeids = ds_.all_places();
+    if (placeids.empty())
+    {
+        output << "No places!" << endl;
+        return {};
+    }
+    Coord min = ds_.get_place_coord(placeids.front());
+    Coord max = min;
+    for (auto id : placeids)
+    {
+        Coord xy = ds_.get_place_coord(id);
+        min = {std::min(min.x, xy.x), std::min(min.y, xy.y)};
+        max = {std::max(max.x, xy.x), std::max(max.y, xy.y)};
+    }
+    vector<Coord> coords;
+    coords.reserve(count);
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        coords.push_back({random<int>(min.x, max.x+1), random<int>(min.y, max.y+1)});
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    auto places = ds_.closest_many(coords, type);
+    stopwatch.stop();
+
+    auto found = count_if(places.begin(), places.end(), [](auto const& result){ return !result.empty(); });
+    output << found << " of the queries found places" << endl;
+    if (stopwatch_mode != StopwatchMode::OFF)
+    {
+        print_batch_throughput(output, count, "queries", stopwatch);
+    }
+
+    return {};
+}
+
+void MainProgram::test_closest_many()
+{
+    if (random_data_.places_added > 0) // Don't do anything if there's no places
+    {
+        vector<Coord> coords;
+        for (unsigned int i = 0; i < BATCH_TEST_SIZE; ++i)
+        {
+            coords.push_back({random<int>(0, 1000), random<int>(0, 1000)});
+        }
+        PlaceType type{random(0, static_cast<int>(PlaceType::NO_TYPE))};
+        ds_.closest_many(coords, type);
+    }
+}
+
+MainProgram::CmdResult MainProgram::cmd_route_distance_matrix(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string sourcesstr = *begin++;
+    string targetsstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    vector<Coord> sources = parse_coords(sourcesstr);
+    vector<Coord> targets = parse_coords(targetsstr);
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+    auto matrix = ds_.route_distance_matrix(sources, targets);
+    stopwatch.stop();
+
+    // One row per source, with the distances to the targets in the order they were given
+    output << "Distances to";
+    for (auto target : targets)
+    {
+        output << " ";
+        print_coord(target, output, false);
+    }
+    output << endl;
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        print_coord(sources[i], output, false);
+        output << ":";
+        for (size_t j = 0; j < targets.size(); ++j)
+        {
+            Distance dist = matrix[i * targets.size() + j];
+            output << " ";
+            if (dist == NO_DISTANCE) { output << "--"; }
+            else { output << dist; }
+        }
+        output << endl;
+    }
+    if (stopwatch_mode != StopwatchMode::OFF)
+    {
+        print_batch_throughput(output, sources.size() * targets.size(), "distances", stopwatch);
+    }
+
+    return {};
+}
+
+void MainProgram::test_route_distance_matrix()
+{
+    vector<Coord> sources;
+    vector<Coord> targets;
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        sources.push_back(random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added)));
+        targets.push_back(random_data_.n_to_coord(random(decltype(random_data_.ways_added)(0),random_data_.ways_added)));
+    }
+    ds_.route_distance_matrix(sources, targets);
+}
+
+MainProgram::CmdResult MainProgram::cmd_thread_count(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string countstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (!countstr.empty())
+    {
+        ds_.set_thread_count(convert_string_to<unsigned int>(countstr));
+    }
+    output << "Batch queries use " << ds_.thread_count() << " threads" << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_stats(std::ostream &output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string resetstr = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    auto stats = ds_.stats();
+    if (stats.empty())
+    {
+        output << "Statistics are not compiled in, define DATASTRUCTURES_STATS to enable them" << endl;
+        return {};
+    }
+    for (auto const& [name, value] : stats)
+    {
+        output << name << ": " << value << endl;
+    }
+    if (!resetstr.empty())
+    {
+        ds_.reset_stats();
+        output << "Statistics reset" << endl;
+    }
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_deferred_updates(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string on = *begin++;
+    string off = *begin++;
+    assert( begin == end && "Impossible number of parameters!");
+
+    if (!on.empty())
+    {
+        ds_.set_deferred_updates(true);
+    }
+    else if (!off.empty())
+    {
+        // Merges every change made in the deferred mode
+        ds_.set_deferred_updates(false);
+    }
+    output << "Deferred updates: " << (ds_.deferred_updates() ? "on" : "off") << endl;
+
+    return {};
+}
+
+MainProgram::CmdResult MainProgram::cmd_list_page(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    string kind = *begin++;
+    size_t offset = convert_string_to<size_t>(*begin++);
+    size_t limit = convert_string_to<size_t>(*begin++);
+    assert( begin == end && "Impossible number of parameters!");
+
+    // Each id is printed as soon as the data structures produce it, nothing collects the whole list.
+    // The numbers continue from the offset, so consecutive pages number the ids like the full list.
+    size_t num = offset;
+    auto print_place_line = [&output,&num,this](PlaceID id) { output << ++num << ". "; print_place(id, output); return true; };
+    size_t count = 0;
+    if (kind == "places")
+    {
+        count = ds_.visit_all_places(print_place_line, offset, limit);
+    }
+    else if (kind == "alphabetically")
+    {
+        count = ds_.visit_places_alphabetically(print_place_line, offset, limit);
+    }
+    else if (kind == "coord_order")
+    {
+        count = ds_.visit_places_coord_order(print_place_line, offset, limit);
+    }
+    else if (kind == "areas")
+    {
+        count = ds_.visit_all_areas([&output,&num,this](AreaID id) { output << ++num << ". "; print_area(id, output); return true; },
+                                    offset, limit);
+    }
+    else
+    {
+        count = ds_.visit_all_ways([&output,&num](WayID const& id) { output << ++num << ". " << id << endl; return true; },
+                                   offset, limit);
+    }
+
+    if (count == 0)
+    {
+        output << "No " << kind << " from " << offset << " on!" << endl;
+    }
+
+    return {};
+}
+
+void MainProgram::test_list_page()
+{
+    // One page of 100 ids from a random offset, visited without printing
+    static vector<string> const kinds = {"places", "alphabetically", "coord_order", "areas", "ways"};
+    auto const& kind = kinds[random<size_t>(0, kinds.size())];
+    size_t offset = random<size_t>(0, static_cast<size_t>(ds_.place_count()) + 1);
+    auto ignore = [](auto const&) { return true; };
+    if (kind == "places") { ds_.visit_all_places(ignore, offset, 100); }
+    else if (kind == "alphabetically") { ds_.visit_places_alphabetically(ignore, offset, 100); }
+    else if (kind == "coord_order") { ds_.visit_places_coord_order(ignore, offset, 100); }
+    else if (kind == "areas") { ds_.visit_all_areas(ignore, offset, 100); }
+    else { ds_.visit_all_ways(ignore, offset, 100); }
+}
+
+void MainProgram::print_batch_throughput(std::ostream& output, std::size_t count, std::string const& what, Stopwatch& stopwatch)
+{
+    double seconds = stopwatch.elapsed();
+    output << count << " " << what << " with " << ds_.thread_count() << " threads in " << seconds << " sec";
+    if (seconds > 0) { output << ", " << static_cast<unsigned long int>(count / seconds) << " " << what << "/sec"; }
+    output << endl;
+}
+
+MainProgram::CmdResult MainProgram::cmd_clear_ways(std::ostream& output, MainProgram::MatchIter begin, MainProgram::MatchIter end)
+{
+    assert( begin == end && "Impossible number of parameters!");
+
+    ds_.clear_ways();
+    output << "All routes removed." << std::endl;
+
+    return {};
+}
+
+string const plcidx = "([0-9]+)";
+string const areaidx = "([0-9]+)";
+string const wayidx = "([a-zA-Z0-9]+)";
+string const namex = "'([a-zA-Z0-9 -]+)'";
+string const typex = "([a-zA-Z0-9]+)";
+string const numx = "([0-9]+)";
+string const optcoordx = "\\([[:space:]]*[0-9]+[[:space:]]*,[[:space:]]*[0-9]+[[:space:]]*\\)";
+string const coordx = "\\([[:space:]]*([0-9]+)[[:space:]]*,[[:space:]]*([0-9]+)[[:space:]]*\\)";
+string const wsx = "[[:space:]]+";
+
+vector<MainProgram::CmdInfo> MainProgram::cmds_ =
+{
+    {"add_place", "ID 'Name' Type (x,y)", plcidx+wsx+namex+wsx+typex+wsx+coordx, &MainProgram::cmd_add_place, nullptr },
+    {"random_add", "number_of_places_to_add  [(minx,miny) (maxx,maxy)] (coordinates optional)", numx+"(?:"+wsx+coordx+wsx+coordx+")?",
+     &MainProgram::cmd_random_add, &MainProgram::test_random_add },
+    {"all_places", "", "", &MainProgram::cmd_all_places, nullptr },
+    {"place_name_type", "ID", plcidx, &MainProgram::cmd_place_name_type, &MainProgram::test_place_name_type },
+    {"place_coord", "ID", plcidx, &MainProgram::cmd_place_coord, &MainProgram::test_place_coord },
+    {"add_area", "ID Name (x,y) (x,y)...", areaidx+wsx+namex+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_area, nullptr },
+    {"all_areas", "", "", &MainProgram::cmd_all_areas, nullptr },
+    {"area_name", "AreaID", areaidx, &MainProgram::cmd_area_name, &MainProgram::test_area_name },
+    {"area_coords", "AreaID", areaidx, &MainProgram::cmd_area_coords, nullptr },
+    {"creation_finished", "", "", &MainProgram::cmd_creation_finished, nullptr },
+    {"place_count", "", "", &MainProgram::cmd_place_count, nullptr },
+    {"clear_all", "", "", &MainProgram::cmd_clear_all, nullptr },
+    {"places_alphabetically", "", "", &MainProgram::NoParPlaceListCmd<&Datastructures::places_alphabetically>, &MainProgram::NoParPlaceListTestCmd<&Datastructures::places_alphabetically> },
+    {"places_coord_order", "", "", &MainProgram::NoParPlaceListCmd<&Datastructures::places_coord_order>, &MainProgram::NoParPlaceListTestCmd<&Datastructures::places_coord_order> },
+    {"places_closest_to", "Coord [type] (type optional)", coordx+"(?:"+wsx+typex+")?", &MainProgram::cmd_places_closest_to, &MainProgram::test_places_closest_to },
+    {"places_k_nearest", "Coord k [type] (type optional)", coordx+wsx+numx+"(?:"+wsx+typex+")?", &MainProgram::cmd_places_k_nearest, &MainProgram::test_places_k_nearest },
+    {"places_within_radius", "Coord radius [type] (type optional)", coordx+wsx+numx+"(?:"+wsx+typex+")?", &MainProgram::cmd_places_within_radius, &MainProgram::test_places_within_radius },
+    {"common_area_of_subareas", "ID1 ID2", plcidx+wsx+plcidx, &MainProgram::cmd_common_area_of_subareas, &MainProgram::test_common_area_of_subareas },
+    {"remove_place", "ID", plcidx, &MainProgram::cmd_remove_place, &MainProgram::test_remove_place },
+    {"find_places_name", "'Name'", namex, &MainProgram::cmd_find_places_name, &MainProgram::test_find_places_name },
+    {"find_places_name_prefix", "'Prefix' [limit] (limit optional)", namex+"(?:"+wsx+numx+")?", &MainProgram::cmd_find_places_name_prefix, &MainProgram::test_find_places_name_prefix },
+    {"find_places_name_substring", "'Part' [limit] (limit optional)", namex+"(?:"+wsx+numx+")?", &MainProgram::cmd_find_places_name_substring, &MainProgram::test_find_places_name_substring },
+    {"find_places_type", "type", typex, &MainProgram::cmd_find_places_type, &MainProgram::test_find_places_type },
+    {"change_place_name", "ID 'Newname'", plcidx+wsx+namex, &MainProgram::cmd_change_place_name, &MainProgram::test_change_place_name },
+    {"change_place_coord", "ID (x,y)", plcidx+wsx+coordx, &MainProgram::cmd_change_place_coord, &MainProgram::test_change_place_coord },
+    {"add_subarea_to_area", "SubareaID AreaID", areaidx+wsx+areaidx, &MainProgram::cmd_add_subarea_to_area, nullptr },
+    {"all_ways", "", "", &MainProgram::cmd_all_ways, nullptr },
+    {"add_way", "WayID (x,y) (x,y)...", wayidx+"((?:"+wsx+optcoordx+")+)", &MainProgram::cmd_add_way, nullptr },
+    {"random_ways", "number_of_ways_to_add", numx,
+     &MainProgram::cmd_random_ways, &MainProgram::test_random_ways },
+    {"way_coords", "WayID", wayidx, &MainProgram::cmd_way_coords, &MainProgram::test_way_coords },
+    {"ways_from", "Coord", coordx, &MainProgram::cmd_ways_from, &MainProgram::test_ways_from },
+    {"clear_ways", "", "", &MainProgram::cmd_clear_ways, nullptr },
+    {"remove_way", "WayID", wayidx, &MainProgram::cmd_remove_way, &MainProgram::test_remove_way },
+    {"subarea_in_areas", "AreaID", areaidx, &MainProgram::cmd_subarea_in_areas, &MainProgram::test_subarea_in_areas },
+    {"all_subareas_in_area", "AreaID", areaidx, &MainProgram::cmd_all_subareas_in_area, &MainProgram::test_all_subareas_in_area },
+    {"route_any", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_any, &MainProgram::test_route_any },
+    {"route_least_crossroads", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_least_crossroads, &MainProgram::test_route_least_crossroads },
+    {"route_shortest_distance", "CoordFrom CoordTo", coordx+wsx+coordx, &MainProgram::cmd_route_shortest_distance, &MainProgram::test_route_shortest_distance },
+    {"route_with_cycle", "Coordfrom", coordx, &MainProgram::cmd_route_with_cycle, &MainProgram::test_route_with_cycle },
+    {"trim_ways", "", "", &MainProgram::cmd_trim_ways, &MainProgram::test_trim_ways },
+    {"prepare_routing", "", "", &MainProgram::cmd_prepare_routing, &MainProgram::test_prepare_routing },
+    {"route_many", "number_of_routes", numx, &MainProgram::cmd_route_many, &MainProgram::test_route_many },
+    {"closest_many", "number_of_queries [type] (type optional)", numx+"(?:"+wsx+typex+")?", &MainProgram::cmd_closest_many, &MainProgram::test_closest_many },
+    {"route_distance_matrix", "(x,y)... to (x,y)... (sources before 'to', targets after it)",
+     "("+optcoordx+"(?:"+wsx+optcoordx+")*)"+wsx+"to"+wsx+"("+optcoordx+"(?:"+wsx+optcoordx+")*)",
+     &MainProgram::cmd_route_distance_matrix, &MainProgram::test_route_distance_matrix },
+    {"thread_count", "[number_of_threads] (0 = one per hardware thread, prints the current count if left out)", "(?:"+numx+")?", &MainProgram::cmd_thread_count, nullptr },
+    {"deferred_updates", "[on|off] (changes only log themselves and the indices are merged when needed, prints the mode if left out)",
+     "(?:(on)|(off))?", &MainProgram::cmd_deferred_updates, nullptr },
+    {"list_page", "places|alphabetically|coord_order|areas|ways offset count (prints the ids as they are visited, alternatives separated by |)",
+     "(places|alphabetically|coord_order|areas|ways)"+wsx+numx+wsx+numx, &MainProgram::cmd_list_page, &MainProgram::test_list_page },
+    {"stats", "[reset] (prints the counters of the data structures, and zeroes them if reset is given)", "(?:(reset))?", &MainProgram::cmd_stats, nullptr },
+    {"quit", "", "", nullptr, nullptr },
+    {"help", "", "", &MainProgram::help_command, nullptr },
+    {"read", "\"in-filename\" [silent]", "\"([-a-zA-Z0-9 ./:_]+)\"(?:"+wsx+"(silent))?", &MainProgram::cmd_read, nullptr },
+    {"testread", "\"in-filename\" \"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+"\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_testread, nullptr },
+    {"parse_benchmark", "\"in-filename\" repeat_count", "\"([-a-zA-Z0-9 ./:_]+)\""+wsx+numx, &MainProgram::cmd_parse_benchmark, nullptr },
+    {"save_snapshot", "\"out-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_save_snapshot, nullptr },
+    {"load_snapshot", "\"in-filename\"", "\"([-a-zA-Z0-9 ./:_]+)\"", &MainProgram::cmd_load_snapshot, nullptr },
+    {"perftest", "cmd1|all|compulsory[;cmd2...] timeout repeat_count n1[;n2...] [csv|json] [counters=counter1[;counter2...]] (parts in [] are optional, alternatives separated by |)",
+     "([0-9a-zA-Z_]+(?:;[0-9a-zA-Z_]+)*)"+wsx+numx+wsx+numx+wsx+"([0-9]+(?:;[0-9]+)*)(?:"+wsx+"(csv|json))?(?:"+wsx+"counters=([a-z_]+(?:;[a-z_]+)*))?",
+     &MainProgram::cmd_perftest, nullptr },
+    {"stopwatch", "on|off|next (alternatives separated by |)", "(?:(on)|(off)|(next))", &MainProgram::cmd_stopwatch, nullptr },
+    {"random_seed", "new-random-seed-integer", numx, &MainProgram::cmd_randseed, nullptr },
+    {"#", "comment text", ".*", &MainProgram::cmd_comment, nullptr },
+};
 
 MainProgram::CmdResult MainProgram::help_command(std::ostream& output, MatchIter /*begin*/, MatchIter /*end*/)
 {
@@ -1558,16 +2116,56 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     output << "WARNING: Debug STL enabled, performance will be worse than expected (maybe also asymptotically)!" << endl;
 #endif // _GLIBCXX_DEBUG
 
-    vector<string> optional_cmds({"places_closest_to", "places_common_area", "route_least_crossroads", "route_with_cycle", "route_shortest_distance",
+    vector<string> optional_cmds({"places_closest_to", "places_k_nearest", "places_within_radius", "places_common_area", "route_least_crossroads", "route_with_cycle", "route_shortest_distance",
                                   "add_walking_connections"});
-    vector<string> nondefault_cmds({"remove_place", "find_places", "way_coords"});
+    vector<string> nondefault_cmds({"remove_place", "find_places", "way_coords", "find_places_name_prefix", "find_places_name_substring",
+                                    "route_many", "closest_many", "route_distance_matrix", "prepare_routing", "list_page"});
 
     string commandstr = *begin++;
     unsigned int timeout = convert_string_to<unsigned int>(*begin++);
     unsigned int repeat_count = convert_string_to<unsigned int>(*begin++);
 //    unsigned int friend_count = convert_string_to<unsigned int>(*begin++);
     string sizes = *begin++;
+    string format = *begin++;
+    string counter_list = *begin++;
     assert(begin == end && "Invalid number of parameters");
+    // The csv and json formats print only the results, one row per command or one object per N
+    bool text_output = format.empty();
+
+    // Hardware counters measured for each command, instructions always first so that IPC can be given
+    vector<Stopwatch::Counter> counters{Stopwatch::Counter::INSTRUCTIONS};
+    std::size_t cycles_index = 0; // 0 if cycles are not measured
+    if (!counter_list.empty())
+    {
+        istringstream names(counter_list);
+        string name;
+        while (getline(names, name, ';'))
+        {
+            auto pos = find(Stopwatch::counter_names.begin(), Stopwatch::counter_names.end(), name);
+            if (pos == Stopwatch::counter_names.end())
+            {
+                output << "Unknown counter " << name << ", known counters:";
+                for (auto counter_name : Stopwatch::counter_names) { output << " " << counter_name; }
+                output << endl;
+                return {};
+            }
+            auto counter = static_cast<Stopwatch::Counter>(pos - Stopwatch::counter_names.begin());
+            if (find(counters.begin(), counters.end(), counter) == counters.end())
+            {
+                if (counter == Stopwatch::Counter::CYCLES) { cycles_index = counters.size(); }
+                counters.push_back(counter);
+            }
+        }
+    }
+#ifdef USE_PERF_EVENT
+    bool report_counters = !counter_list.empty();
+#else
+    bool report_counters = false;
+    if (!counter_list.empty())
+    {
+        output << "Hardware counters are not available, compile with USE_PERF_EVENT to measure them" << endl;
+    }
+#endif
 
     vector<string> testcmds;
     bool additional_get_cmds = true;
@@ -1592,12 +2190,15 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
         init_ns.push_back(convert_string_to<unsigned int>(size[1]));
     }
 
-    output << "Timeout for each N is " << timeout << " sec. " << endl;
+    ostringstream discarded_output;
+    ostream& text = text_output ? output : discarded_output;
+    text << "Timeout for each N is " << timeout << " sec. " << endl;
 //    output << "Add 0.." << friend_count << " friends for every employee." << endl;
-    output << "For each N perform " << repeat_count << " random command(s) from:" << endl;
+    text << "For each N perform " << repeat_count << " random command(s) from:" << endl;
 
     // Initialize test functions
     vector<void(MainProgram::*)()> testfuncs;
+    vector<string> testnames;
     if (testcmds.empty())
     { // Add all commands
         for (auto& i : cmds_)
@@ -1607,8 +2208,9 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
                 if (find(nondefault_cmds.begin(), nondefault_cmds.end(), i.cmd) == nondefault_cmds.end() &&
                     (commandstr == "all" || find(optional_cmds.begin(), optional_cmds.end(), i.cmd) == optional_cmds.end()))
                 {
-                    output << i.cmd << " ";
+                    text << i.cmd << " ";
                     testfuncs.push_back(i.testfunc);
+                    testnames.push_back(i.cmd);
                 }
             }
         }
@@ -1620,16 +2222,17 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             auto pos = find_if(cmds_.begin(), cmds_.end(), [&i](auto const& cmd){ return cmd.cmd == i; });
             if (pos != cmds_.end() && pos->testfunc)
             {
-                output << i << " ";
+                text << i << " ";
                 testfuncs.push_back(pos->testfunc);
+                testnames.push_back(i);
             }
             else
             {
-                output << "(cannot test " << i << ") ";
+                text << "(cannot test " << i << ") ";
             }
         }
     }
-    output << endl << endl;
+    text << endl << endl;
 
     if (testfuncs.empty())
     {
@@ -1638,27 +2241,55 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
     }
 
 #ifdef USE_PERF_EVENT
-    output << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "add (count)" << " , " << setw(12) << "cmds (sec)" << " , "
-           << setw(12) << "cmds (count)"  << " , " << setw(12) << "total (sec)" << " , " << setw(12) << "total (count)" << endl;
+    text << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "add (count)" << " , " << setw(12) << "cmds (sec)" << " , "
+           << setw(12) << "cmds (count)"  << " , " << setw(12) << "total (sec)" << " , " << setw(12) << "total (count)";
 #else
-    output << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "cmds (sec)" << " , "
-           << setw(12) << "total (sec)" << endl;
+    text << setw(7) << "N" << " , " << setw(12) << "add (sec)" << " , " << setw(12) << "cmds (sec)" << " , "
+           << setw(12) << "total (sec)";
 #endif
+    text << " , " << setw(12) << "peak RSS(kB)" << " , " << setw(12) << "allocations" << endl;
+    if (format == "csv")
+    {
+        output << "n,command,calls,total_sec,p50_sec,p99_sec,max_sec,allocations,peak_rss_kb";
+        if (report_counters)
+        {
+            for (auto counter : counters) { output << "," << Stopwatch::counter_names[static_cast<std::size_t>(counter)]; }
+            if (cycles_index != 0) { output << ",ipc"; }
+        }
+        output << endl;
+    }
+    else if (format == "json")
+    {
+        output << "[";
+    }
     flush_output(output);
 
     auto stop = false;
+    bool first_result = true;
     for (unsigned int n : init_ns)
     {
         if (stop) { break; }
 
-        output << setw(7) << n << " , " << flush;
+        text << setw(7) << n << " , " << flush;
 
         ds_.clear_all();
         ds_.clear_ways();
-        init_primes();
+        random_data_.init_primes();
+        reset_peak_rss();
+        auto start_allocations = allocation_count();
+
+        // Latencies of the calls of each test command, and the allocations they made
+        vector<vector<double>> latencies(testfuncs.size());
+        vector<unsigned long long> cmd_allocations(testfuncs.size(), 0);
+        vector<vector<long long>> cmd_counts(testfuncs.size(), vector<long long>(counters.size(), 0));
+        Stopwatch cmd_stopwatch(report_counters, counters);
 
         Stopwatch stopwatch(true); // Use also instruction counting, if enabled
 
+        stopwatch.start();
+        ds_.reserve(n, n);
+        stopwatch.stop();
+
         // Add random places
         for (unsigned int i = 0; i < n / 1000; ++i)
         {
@@ -1668,13 +2299,13 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 
             if (stopwatch.elapsed() >= timeout)
             {
-                output << "Timeout!" << endl;
+                text << "Timeout!" << endl;
                 stop = true;
                 break;
             }
             if (check_stop())
             {
-                output << "Stopped!" << endl;
+                text << "Stopped!" << endl;
                 stop = true;
                 break;
             }
@@ -1697,13 +2328,13 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 
             if (stopwatch.elapsed() >= timeout)
             {
-                output << "Timeout!" << endl;
+                text << "Timeout!" << endl;
                 stop = true;
                 break;
             }
             if (check_stop())
             {
-                output << "Stopped!" << endl;
+                text << "Stopped!" << endl;
                 stop = true;
                 break;
             }
@@ -1717,42 +2348,63 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
             stopwatch.stop();
         }
 
+        // The bulk additions leave the secondary indices pending, so building them belongs to the add phase
+        stopwatch.start();
+        ds_.creation_finished();
+        stopwatch.stop();
+
 #ifdef USE_PERF_EVENT
         auto addcount = stopwatch.count();
 #endif
         auto addsec = stopwatch.elapsed();
 
+        auto add_allocations = allocation_count() - start_allocations;
+
 #ifdef USE_PERF_EVENT
-        output << setw(12) << addsec << " , " << setw(12) << addcount << " , " << flush;
+        text << setw(12) << addsec << " , " << setw(12) << addcount << " , " << flush;
 #else
-        output << setw(12) << addsec << " , " << flush;
+        text << setw(12) << addsec << " , " << flush;
 #endif
 
         if (addsec >= timeout)
         {
-            output << "Timeout!" << endl;
+            text << "Timeout!" << endl;
             stop = true;
             break;
         }
 
         stopwatch.start();
-        ds_.creation_finished();
         for (unsigned int repeat = 0; repeat < repeat_count; ++repeat)
         {
-            auto cmdpos = random(testfuncs.begin(), testfuncs.end());
-
-            (this->**cmdpos)();
+            auto cmdindex = random<vector<string>::size_type>(0, testfuncs.size());
+
+            auto cmd_start_allocations = allocation_count();
+            cmd_stopwatch.reset();
+            cmd_stopwatch.start();
+            (this->*testfuncs[cmdindex])();
+            cmd_stopwatch.stop();
+            cmd_allocations[cmdindex] += allocation_count() - cmd_start_allocations;
+            latencies[cmdindex].push_back(cmd_stopwatch.elapsed());
+#ifdef USE_PERF_EVENT
+            if (report_counters)
+            {
+                for (std::size_t counter = 0; counter < counters.size(); ++counter)
+                {
+                    cmd_counts[cmdindex][counter] += cmd_stopwatch.count(counter);
+                }
+            }
+#endif
             if (additional_get_cmds)
             {
-                if (random_places_added_ > 0) // Don't do anything if there's no places
+                if (random_data_.places_added > 0) // Don't do anything if there's no places
                 {
-                    PlaceID id = random<decltype(random_places_added_)>(0, random_places_added_);
+                    PlaceID id = random<decltype(random_data_.places_added)>(0, random_data_.places_added);
                     ds_.get_place_name_type(id);
                     ds_.get_place_coord(id);
                 }
-                if (random_areas_added_ > 0)
+                if (random_data_.areas_added > 0)
                 {
-                    auto areaid = n_to_areaid(random<decltype(random_areas_added_)>(0, random_areas_added_));
+                    auto areaid = random_data_.n_to_areaid(random<decltype(random_data_.areas_added)>(0, random_data_.areas_added));
                     ds_.get_area_name(areaid);
                 }
             }
@@ -1762,13 +2414,13 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
                 stopwatch.stop();
                 if (stopwatch.elapsed() >= timeout)
                 {
-                    output << "Timeout!" << endl;
+                    text << "Timeout!" << endl;
                     stop = true;
                     break;
                 }
                 if (check_stop())
                 {
-                    output << "Stopped!" << endl;
+                    text << "Stopped!" << endl;
                     stop = true;
                     break;
                 }
@@ -1783,27 +2435,102 @@ MainProgram::CmdResult MainProgram::cmd_perftest(std::ostream& output, MatchIter
 #endif
         auto totalsec = stopwatch.elapsed();
 
+        auto total_allocations = allocation_count() - start_allocations;
+        auto peak_rss = peak_rss_kb();
+
 #ifdef USE_PERF_EVENT
-        output << setw(12) << totalsec-addsec << " , " << setw(12) << totalcount-addcount << " , " << setw(12) << totalsec << " , " << setw(12) << totalcount;
+        text << setw(12) << totalsec-addsec << " , " << setw(12) << totalcount-addcount << " , " << setw(12) << totalsec << " , " << setw(12) << totalcount;
 #else
-        output << setw(12) << totalsec-addsec << " , " << setw(12) << totalsec;
+        text << setw(12) << totalsec-addsec << " , " << setw(12) << totalsec;
 #endif
+        text << " , " << setw(12) << peak_rss << " , " << setw(12) << total_allocations << endl;
 
-//        unsigned long int maxmem;
-//        string unit;
-//        tie(maxmem, unit) = mempeak();
-//        maxmem -=  startmem;
-//        if (maxmem != 0)
-//        {
-//            output << ", memory " << maxmem << " " << unit;
-//        }
-        output << endl;
+        if (format == "json")
+        {
+            output << (first_result ? "" : ",") << endl
+                   << "  {\"n\": " << n << ", \"add_sec\": " << addsec << ", \"cmds_sec\": " << totalsec-addsec
+                   << ", \"total_sec\": " << totalsec << ", \"peak_rss_kb\": " << peak_rss
+                   << ", \"add_allocations\": " << add_allocations << ", \"total_allocations\": " << total_allocations
+                   << ", \"commands\": [";
+        }
+        else if (format == "csv")
+        {
+            output << n << ",add,," << addsec << ",,,," << add_allocations << "," << peak_rss
+                   << (report_counters ? string(counters.size() + (cycles_index != 0), ',') : "") << endl;
+        }
+        first_result = false;
+        bool first_command = true;
+        for (vector<string>::size_type cmd = 0; cmd < testfuncs.size(); ++cmd)
+        {
+            auto& times = latencies[cmd];
+            if (times.empty()) { continue; }
+            double cmd_total = 0;
+            for (double time : times) { cmd_total += time; }
+            double p50 = percentile(times, 0.5);
+            double p99 = percentile(times, 0.99);
+            double max = *std::max_element(times.begin(), times.end());
+            auto& counts = cmd_counts[cmd];
+            double ipc = (cycles_index != 0 && counts[cycles_index] != 0) ? double(counts[0]) / counts[cycles_index] : 0;
+            text << "        " << testnames[cmd] << ": " << times.size() << " calls, p50 " << p50 << " sec, p99 " << p99
+                 << " sec, max " << max << " sec, " << cmd_allocations[cmd] << " allocations";
+            if (report_counters)
+            {
+                for (std::size_t counter = 0; counter < counters.size(); ++counter)
+                {
+                    text << ", " << counts[counter] << " " << Stopwatch::counter_names[static_cast<std::size_t>(counters[counter])];
+                }
+                if (cycles_index != 0) { text << ", IPC " << ipc; }
+            }
+            text << endl;
+            if (format == "json")
+            {
+                output << (first_command ? "" : ",") << endl
+                       << "    {\"command\": \"" << testnames[cmd] << "\", \"calls\": " << times.size() << ", \"total_sec\": " << cmd_total
+                       << ", \"p50_sec\": " << p50 << ", \"p99_sec\": " << p99 << ", \"max_sec\": " << max
+                       << ", \"allocations\": " << cmd_allocations[cmd];
+                if (report_counters)
+                {
+                    for (std::size_t counter = 0; counter < counters.size(); ++counter)
+                    {
+                        output << ", \"" << Stopwatch::counter_names[static_cast<std::size_t>(counters[counter])] << "\": " << counts[counter];
+                    }
+                    if (cycles_index != 0) { output << ", \"ipc\": " << ipc; }
+                }
+                output << "}";
+            }
+            else if (format == "csv")
+            {
+                output << n << "," << testnames[cmd] << "," << times.size() << "," << cmd_total << "," << p50 << "," << p99
+                       << "," << max << "," << cmd_allocations[cmd] << "," << peak_rss;
+                if (report_counters)
+                {
+                    for (auto count : counts) { output << "," << count; }
+                    if (cycles_index != 0) { output << "," << ipc; }
+                }
+                output << endl;
+            }
+            first_command = false;
+        }
+        if (format == "json")
+        {
+            output << (first_command ? "" : "\n  ") << "]}";
+        }
+        else if (format == "csv")
+        {
+            output << n << ",total," << repeat_count << "," << totalsec << ",,,," << total_allocations << "," << peak_rss
+                   << (report_counters ? string(counters.size() + (cycles_index != 0), ',') : "") << endl;
+        }
         flush_output(output);
     }
 
+    if (format == "json")
+    {
+        output << endl << "]" << endl;
+    }
+
     ds_.clear_all();
     ds_.clear_ways();
-    init_primes();
+    random_data_.init_primes();
 
 #ifdef _GLIBCXX_DEBUG
     output << "WARNING: Debug STL enabled, performance will be worse than expected (maybe also asymptotically)!" << endl;
@@ -1817,190 +2544,343 @@ MainProgram::CmdResult MainProgram::cmd_comment(std::ostream& /*output*/, MatchI
     return {};
 }
 
-bool MainProgram::command_parse_line(string inputline, ostream& output)
+template <typename Command>
+void MainProgram::run_command(std::string const& cmd, std::ostream& output, Command command)
 {
-//    static unsigned int nesting_level = 0; // UGLY! Remember nesting level to print correct amount of >:s.
-//    if (promptstyle != PromptStyle::NO_NESTING) { ++nesting_level; }
+    Stopwatch stopwatch;
+    bool use_stopwatch = (stopwatch_mode != StopwatchMode::OFF);
+    // Reset stopwatch mode if only for the next command
+    if (stopwatch_mode == StopwatchMode::NEXT) { stopwatch_mode = StopwatchMode::OFF; }
 
-    if (inputline.empty()) { return true; }
+    TestStatus initial_status = test_status_;
+    test_status_ = TestStatus::NOT_RUN;
 
-    smatch match;
-    bool matched = regex_match(inputline, match, cmds_regex_);
-    if (matched)
+    if (use_stopwatch)
     {
-        assert(match.size() == 3);
-        string cmd = match[1];
-        string params = match[2];
+        stopwatch.start();
+    }
 
-        auto pos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
-        assert(pos != cmds_.end());
+    CmdResult result;
+    try
+    {
+        result = command(output);
+    }
+    catch (std::exception const& e)
+    {
+        output << "Error: " << e.what() << endl;
+    }
 
-        smatch match2;
-        bool matched2 = regex_match(params, match2, pos->param_regex);
-        if (matched2)
+    if (use_stopwatch)
+    {
+        stopwatch.stop();
+    }
+
+    switch (result.first)
+    {
+        case ResultType::NOTHING:
         {
-            if (pos->func)
+            break;
+        }
+        case ResultType::PLACEIDLIST:
+        {
+            auto& [area, places] = std::get<CmdResultPlaceIDs>(result.second);
+            if (area != NO_AREA)
             {
-                assert(!match2.empty());
-
-                Stopwatch stopwatch;
-                bool use_stopwatch = (stopwatch_mode != StopwatchMode::OFF);
-                // Reset stopwatch mode if only for the next command
-                if (stopwatch_mode == StopwatchMode::NEXT) { stopwatch_mode = StopwatchMode::OFF; }
-
-               TestStatus initial_status = test_status_;
-               test_status_ = TestStatus::NOT_RUN;
-
-                if (use_stopwatch)
-                {
-                    stopwatch.start();
-                }
-
-                CmdResult result;
-                try
+                output << "Area: ";
+                print_area(area, output);
+            }
+            if (!places.empty())
+            {
+                if (places.size() == 1 && places.front() == NO_PLACE)
                 {
-                    result = (this->*(pos->func))(output, ++(match2.begin()), match2.end());
+                    output << "Failed (NO_... returned)!!" << std::endl;
                 }
-                catch (std::exception const& e)
+                else
                 {
-                    output << "Error: " << e.what() << endl;
+                    unsigned int num = 0;
+                    for (PlaceID id : places)
+                    {
+                        ++num;
+                        if (places.size() > 1) { output << num << ". "; }
+                        print_place(id, output);
+                    }
                 }
-
-                if (use_stopwatch)
+            }
+            break;
+        }
+        case ResultType::AREAIDLIST:
+        {
+            auto& areas = std::get<CmdResultAreaIDs>(result.second);
+            if (!areas.empty())
+            {
+                if (areas.size() == 1 && areas.front() == NO_AREA)
                 {
-                    stopwatch.stop();
+                    output << "Failed (NO_... returned)!!" << std::endl;
                 }
-
-                switch (result.first)
+                else
                 {
-                    case ResultType::NOTHING:
-                    {
-                        break;
-                    }
-                    case ResultType::PLACEIDLIST:
+                    unsigned int num = 0;
+                    for (auto area : areas)
                     {
-                        auto& [area, places] = std::get<CmdResultPlaceIDs>(result.second);
-                        if (area != NO_AREA)
-                        {
-                            output << "Area: ";
-                            print_area(area, output);
-                        }
-                        if (!places.empty())
-                        {
-                            if (places.size() == 1 && places.front() == NO_PLACE)
-                            {
-                                output << "Failed (NO_... returned)!!" << std::endl;
-                            }
-                            else
-                            {
-                                unsigned int num = 0;
-                                for (PlaceID id : places)
-                                {
-                                    ++num;
-                                    if (places.size() > 1) { output << num << ". "; }
-                                    print_place(id, output);
-                                }
-                            }
-                        }
-                        break;
+                        ++num;
+                        if (areas.size() > 1) { output << num << ". "; }
+                        print_area(area, output);
                     }
-                    case ResultType::AREAIDLIST:
-                    {
-                        auto& areas = std::get<CmdResultAreaIDs>(result.second);
-                        if (!areas.empty())
-                        {
-                            if (areas.size() == 1 && areas.front() == NO_AREA)
-                            {
-                                output << "Failed (NO_... returned)!!" << std::endl;
-                            }
-                            else
-                            {
-                                unsigned int num = 0;
-                                for (auto area : areas)
-                                {
-                                    ++num;
-                                    if (areas.size() > 1) { output << num << ". "; }
-                                    print_area(area, output);
-                                }
-                            }
-                        }
-                        break;
-                    }
-                    case ResultType::ROUTE:
-                    {
-                        auto& route = std::get<CmdResultRoute>(result.second);
-                        if (!route.empty())
-                        {
-                            if (route.size() == 1 && get<0>(route.front()) == NO_COORD)
-                            {
-                                output << "Failed (NO_... returned)!!" << std::endl;
-                            }
-                            else
-                            {
-                                unsigned int num = 1;
-                                for (auto& [coord, nextcoord, wayid, distance] : route)
-                                {
-                                    output << num << ". ";
-                                    ++num;
-                                    print_coord(coord, output, false);
-                                    if (wayid != NO_WAY) { output << " way " << wayid; }
-                                    if (distance != NO_DISTANCE) { output << " distance " << distance; }
-                                    output << endl;
-                                }
-                            }
-                        }
-                        break;
-                    }
-                case ResultType::WAYS:
+                }
+            }
+            break;
+        }
+        case ResultType::ROUTE:
+        {
+            auto& route = std::get<CmdResultRoute>(result.second);
+            if (!route.empty())
+            {
+                if (route.size() == 1 && get<0>(route.front()) == NO_COORD)
                 {
-                    auto& ways = std::get<CmdResultRoute>(result.second);
-                    if (!ways.empty())
-                    {
-                        if (ways.size() == 1 && get<0>(ways.front()) == NO_COORD)
-                        {
-                            output << "Failed (NO_... returned)!!" << std::endl;
-                        }
-                        else
-                        {
-                            unsigned int num = 1;
-                            for (auto& [fromcoord, tocoord, wayid, distance] : ways)
-                            {
-                                output << num << ". ";
-                                ++num;
-                                print_coord(tocoord, output, false);
-                                if (wayid != NO_WAY) { output << " way " << wayid << " "; }
-                                if (distance != NO_DISTANCE) { output << "distance " << distance; }
-                                output << endl;
-                            }
-                        }
-                    }
-                    break;
+                    output << "Failed (NO_... returned)!!" << std::endl;
                 }
-                    default:
+                else
+                {
+                    unsigned int num = 1;
+                    for (auto& [coord, nextcoord, wayid, distance] : route)
                     {
-                        assert(false && "Unsupported result type!");
+                        output << num << ". ";
+                        ++num;
+                        print_coord(coord, output, false);
+                        if (wayid != NO_WAY) { output << " way " << wayid; }
+                        if (distance != NO_DISTANCE) { output << " distance " << distance; }
+                        output << endl;
                     }
                 }
-
-                if (result != prev_result)
+            }
+            break;
+        }
+    case ResultType::WAYS:
+    {
+        auto& ways = std::get<CmdResultRoute>(result.second);
+        if (!ways.empty())
+        {
+            if (ways.size() == 1 && get<0>(ways.front()) == NO_COORD)
+            {
+                output << "Failed (NO_... returned)!!" << std::endl;
+            }
+            else
+            {
+                unsigned int num = 1;
+                for (auto& [fromcoord, tocoord, wayid, distance] : ways)
                 {
-                    prev_result = move(result);
-                    view_dirty = true;
+                    output << num << ". ";
+                    ++num;
+                    print_coord(tocoord, output, false);
+                    if (wayid != NO_WAY) { output << " way " << wayid << " "; }
+                    if (distance != NO_DISTANCE) { output << "distance " << distance; }
+                    output << endl;
                 }
+            }
+        }
+        break;
+    }
+        default:
+        {
+            assert(false && "Unsupported result type!");
+        }
+    }
 
-                if (use_stopwatch)
-                {
-                    output << "Command '" << cmd << "': " << stopwatch.elapsed() << " sec" << endl;
-                }
+    if (result != prev_result)
+    {
+        prev_result = move(result);
+        view_dirty = true;
+    }
 
-                if (test_status_ != TestStatus::NOT_RUN)
-                {
-                    output << "Testread-tests have been run, " << ((test_status_ == TestStatus::DIFFS_FOUND) ? "differences found!" : "no differences found.") << endl;
-                }
-                if (test_status_ == TestStatus::NOT_RUN || (test_status_ == TestStatus::NO_DIFFS && initial_status == TestStatus::DIFFS_FOUND))
-                {
-                    test_status_ = initial_status;
-                }
+    if (use_stopwatch)
+    {
+        output << "Command '" << cmd << "': " << stopwatch.elapsed() << " sec" << endl;
+    }
+
+    if (test_status_ != TestStatus::NOT_RUN)
+    {
+        output << "Testread-tests have been run, " << ((test_status_ == TestStatus::DIFFS_FOUND) ? "differences found!" : "no differences found.") << endl;
+    }
+    if (test_status_ == TestStatus::NOT_RUN || (test_status_ == TestStatus::NO_DIFFS && initial_status == TestStatus::DIFFS_FOUND))
+    {
+        test_status_ = initial_status;
+    }
+}
+
+// Scanner of the regex-free fast path. It only accepts the plain form of the lines, which the regexes
+// would also accept, so anything unexpected makes the caller fall back to the regexes and their error messages.
+class FastScanner
+{
+public:
+    explicit FastScanner(std::string const& line) : pos_(line.data()), end_(line.data() + line.size()) {}
+
+    bool at_end() const { return pos_ == end_; }
+
+    // Skips spaces and tabs, returns true if at least one was skipped
+    bool skip_space()
+    {
+        char const* start = pos_;
+        while (pos_ != end_ && (*pos_ == ' ' || *pos_ == '\t')) { ++pos_; }
+        return pos_ != start;
+    }
+
+    // A non-empty run of characters accepted by allowed
+    template <typename Allowed>
+    bool token(std::string& result, Allowed allowed)
+    {
+        char const* start = pos_;
+        while (pos_ != end_ && allowed(*pos_)) { ++pos_; }
+        result.assign(start, pos_);
+        return pos_ != start;
+    }
+
+    // An unsigned decimal number of at most max_digits digits, so that it cannot overflow
+    template <typename Number>
+    bool number(Number& result, unsigned int max_digits)
+    {
+        char const* start = pos_;
+        result = 0;
+        while (pos_ != end_ && *pos_ >= '0' && *pos_ <= '9')
+        {
+            result = result * 10 + (*pos_ - '0');
+            ++pos_;
+        }
+        return pos_ != start && static_cast<unsigned int>(pos_ - start) <= max_digits;
+    }
+
+    // 'Name' with the characters of namex
+    bool quoted_name(std::string& result)
+    {
+        if (!expect('\'')) { return false; }
+        if (!token(result, [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == ' ' || c == '-'; })) { return false; }
+        return expect('\'');
+    }
+
+    // (x,y) with optional spaces around the numbers, as in coordx
+    bool coord(Coord& result)
+    {
+        if (!expect('(')) { return false; }
+        skip_space();
+        if (!number(result.x, 9)) { return false; }
+        skip_space();
+        if (!expect(',')) { return false; }
+        skip_space();
+        if (!number(result.y, 9)) { return false; }
+        skip_space();
+        return expect(')');
+    }
+
+    // One or more coordinates, each preceded by whitespace, until the end of the line
+    bool coord_list(std::vector<Coord>& result)
+    {
+        while (true)
+        {
+            bool spaced = skip_space();
+            if (at_end()) { return !result.empty(); }
+            Coord xy;
+            if (!spaced || !coord(xy)) { return false; }
+            result.push_back(xy);
+        }
+    }
+
+private:
+    char const* pos_;
+    char const* end_;
+
+    bool expect(char c)
+    {
+        if (pos_ == end_ || *pos_ != c) { return false; }
+        ++pos_;
+        return true;
+    }
+};
+
+bool MainProgram::fast_parse_line(std::string const& inputline, std::ostream& output)
+{
+    auto is_alnum = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) != 0; };
+
+    FastScanner scan(inputline);
+    scan.skip_space();
+    string cmd;
+    if (!scan.token(cmd, [](char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }) || !scan.skip_space())
+    {
+        return false;
+    }
+
+    if (cmd == "add_place")
+    {
+        PlaceID id;
+        string name;
+        string typestr;
+        Coord xy;
+        if (!scan.number(id, 18) || !scan.skip_space() || !scan.quoted_name(name) || !scan.skip_space()
+            || !scan.token(typestr, is_alnum) || !scan.skip_space() || !scan.coord(xy))
+        {
+            return false;
+        }
+        scan.skip_space();
+        if (!scan.at_end()) { return false; }
+        run_command(cmd, output, [&](std::ostream& cmd_output) { return add_place_parsed(cmd_output, id, name, typestr, xy); });
+        return true;
+    }
+    else if (cmd == "add_area")
+    {
+        AreaID id;
+        string name;
+        vector<Coord> coords;
+        if (!scan.number(id, 18) || !scan.skip_space() || !scan.quoted_name(name) || !scan.coord_list(coords))
+        {
+            return false;
+        }
+        run_command(cmd, output, [&](std::ostream& cmd_output) { return add_area_parsed(cmd_output, id, name, coords); });
+        return true;
+    }
+    else if (cmd == "add_way")
+    {
+        WayID id;
+        vector<Coord> coords;
+        if (!scan.token(id, is_alnum) || !scan.coord_list(coords))
+        {
+            return false;
+        }
+        run_command(cmd, output, [&](std::ostream& cmd_output) { return add_way_parsed(cmd_output, id, coords); });
+        return true;
+    }
+    return false;
+}
+
+bool MainProgram::command_parse_line(string inputline, ostream& output)
+{
+//    static unsigned int nesting_level = 0; // UGLY! Remember nesting level to print correct amount of >:s.
+//    if (promptstyle != PromptStyle::NO_NESTING) { ++nesting_level; }
+
+    if (inputline.empty()) { return true; }
+
+    // Most lines of the data files are add_place, add_area or add_way, and those can skip the regexes
+    if (fast_parse_enabled_ && fast_parse_line(inputline, output)) { return true; }
+
+    smatch match;
+    bool matched = regex_match(inputline, match, cmds_regex_);
+    if (matched)
+    {
+        assert(match.size() == 3);
+        string cmd = match[1];
+        string params = match[2];
+
+        auto pos = find_if(cmds_.begin(), cmds_.end(), [cmd](CmdInfo const& ci) { return ci.cmd == cmd; });
+        assert(pos != cmds_.end());
+
+        smatch match2;
+        bool matched2 = regex_match(params, match2, pos->param_regex);
+        if (matched2)
+        {
+            if (pos->func)
+            {
+                assert(!match2.empty());
+
+                run_command(cmd, output, [&](std::ostream& cmd_output) {
+                    return (this->*(pos->func))(cmd_output, ++(match2.begin()), match2.end());
+                });
             }
             else
             { // No function to run = quit command
@@ -2079,18 +2959,13 @@ bool MainProgram::check_stop() const
     return false;
 }
 
-std::array<unsigned long int, 20> const MainProgram::primes1{4943,   4951,   4957,   4967,   4969,   4973,   4987,   4993,   4999,   5003,
-                                                             5009,   5011,   5021,   5023,   5039,   5051,   5059,   5077,   5081,   5087};
-std::array<unsigned long int, 20> const MainProgram::primes2{81031,  81041,  81043,  81047,  81049,  81071,  81077,  81083,  81097,  81101,
-                                                             81119,  81131,  81157,  81163,  81173,  81181,  81197,  81199,  81203,  81223};
-
 MainProgram::MainProgram()
 {
-    rand_engine_.seed(time(nullptr));
+    random_data_.engine.seed(time(nullptr));
 
     //    startmem = get<0>(mempeak());
 
-    init_primes();
+    random_data_.init_primes();
     init_regexs();
 }
 
@@ -2185,58 +3060,6 @@ std::string MainProgram::convert_placetype_to_string(PlaceType type)
 }
 
 
-void MainProgram::init_primes()
-{
-    // Initialize id generator
-    prime1_ = primes1[random<int>(0, primes1.size())];
-    prime2_ = primes2[random<int>(0, primes2.size())];
-    random_places_added_ = 0;
-    random_areas_added_ = 0;
-    random_ways_added_ = 0;
-}
-
-Name MainProgram::n_to_name(unsigned long n)
-{
-    unsigned long int hash = prime1_*n + prime2_;
-    string name;
-
-    while (hash > 0)
-    {
-        auto hexnum = hash % 26;
-        hash /= 26;
-        name.push_back('a'+hexnum);
-    }
-
-    return name;
-}
-
-AreaID MainProgram::n_to_areaid(unsigned long n)
-{
-    return n_to_placeid(n);
-}
-
-WayID MainProgram::n_to_wayid(unsigned long n)
-{
- std::ostringstream ostr;
- ostr << "R" << n;
- return ostr.str();
-}
-
-PlaceID MainProgram::n_to_placeid(unsigned long int n)
-{
-    unsigned long int hash = prime2_*n + prime1_;
-
-    return hash % static_cast<unsigned long int>(std::numeric_limits<PlaceID>::max());
-}
-
-Coord MainProgram::n_to_coord(unsigned long n)
-{
-    unsigned long int hash = prime1_ * n + prime2_;
-    hash = hash ^ (hash + 0x9e3779b9 + (hash << 6) + (hash >> 2)); // :-P
-
-    return {static_cast<int>(hash % 1000), static_cast<int>((hash/1000) % 1000)};
-}
-
 void MainProgram::init_regexs()
 {
     // Create regex <whitespace>(cmd1|cmd2|...)<whitespace>(.*)
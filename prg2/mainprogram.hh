@@ -25,6 +25,7 @@
 #include <cassert>
 
 #include "datastructures.hh"
+#include "random_data.hh"
 
 class MainWindow; // In case there's UI
 
@@ -55,21 +56,8 @@ private:
 
     static std::string const PROMPT;
 
-    std::minstd_rand rand_engine_;
-
-    static std::array<unsigned long int, 20> const primes1;
-    static std::array<unsigned long int, 20> const primes2;
-    unsigned long int prime1_ = 0; // Will be initialized to random value from above
-    unsigned long int prime2_ = 0; // Will be initialized to random value from above
-    unsigned long int random_places_added_ = 0; // Counter for random places added
-    unsigned long int random_areas_added_ = 0; // Counter for random areas added
-    unsigned long int random_ways_added_ = 0; // Counter for random routes added
-    void init_primes();
-    Name n_to_name(unsigned long int n);
-    AreaID n_to_areaid(unsigned long int n);
-    WayID n_to_wayid(unsigned long int n);
-    PlaceID n_to_placeid(unsigned long int n);
-    Coord n_to_coord(unsigned long int n);
+    // The random number generator, and the ids and counters of the random places, areas and ways
+    Random_data random_data_;
 
 
     enum class StopwatchMode { OFF, ON, NEXT };
@@ -104,6 +92,20 @@ private:
     std::regex sizes_regex_;
     void init_regexs();
 
+    // Regex-free parsing of the plain add_place, add_area and add_way lines that make up the data files.
+    // Returns false without doing anything if the line is not in that form, and it then goes through the regexes.
+    bool fast_parse_line(std::string const& inputline, std::ostream& output);
+    bool fast_parse_enabled_ = true;
+
+    // Runs one command with the stopwatch, prints its result and updates the test status
+    template <typename Command>
+    void run_command(std::string const& cmd, std::ostream& output, Command command);
+
+    // The parts of the add commands after the parameters have been parsed, shared by the regex and fast paths
+    CmdResult add_place_parsed(std::ostream& output, PlaceID id, Name const& name, std::string const& typestr, Coord xy);
+    CmdResult add_area_parsed(std::ostream& output, AreaID id, Name const& name, std::vector<Coord> const& coords);
+    CmdResult add_way_parsed(std::ostream& output, WayID const& id, std::vector<Coord> const& coords);
+
 
     CmdResult help_command(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_place_count(std::ostream& output, MatchIter begin, MatchIter end);
@@ -117,6 +119,8 @@ private:
     CmdResult cmd_area_coords(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_creation_finished(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_find_places_name(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_find_places_name_prefix(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_find_places_name_substring(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_find_places_type(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_change_place_name(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_change_place_coord(std::ostream& output, MatchIter begin, MatchIter end);
@@ -125,6 +129,8 @@ private:
     CmdResult cmd_subarea_in_areas(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_subareas_in_area(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_places_closest_to(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_places_k_nearest(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_places_within_radius(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_common_area_of_subareas(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_all_ways(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_add_way(std::ostream& output, MatchIter begin, MatchIter end);
@@ -138,11 +144,22 @@ private:
     CmdResult cmd_route_shortest_distance(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_route_with_cycle(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_trim_ways(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_prepare_routing(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_many(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_closest_many(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_route_distance_matrix(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_thread_count(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_stats(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_deferred_updates(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_list_page(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_add(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_random_ways(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_randseed(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_read(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_testread(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_parse_benchmark(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_save_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
+    CmdResult cmd_load_snapshot(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_stopwatch(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_perftest(std::ostream& output, MatchIter begin, MatchIter end);
     CmdResult cmd_comment(std::ostream& output, MatchIter begin, MatchIter end);
@@ -152,6 +169,8 @@ private:
     void test_place_name_type();
     void test_place_coord();
     void test_find_places_name();
+    void test_find_places_name_prefix();
+    void test_find_places_name_substring();
     void test_find_places_type();
     void test_change_place_name();
     void test_change_place_coord();
@@ -159,6 +178,8 @@ private:
     void test_subarea_in_areas();
     void test_all_subareas_in_area();
     void test_places_closest_to();
+    void test_places_k_nearest();
+    void test_places_within_radius();
     void test_remove_place();
     void test_common_area_of_subareas();
     void test_ways_from();
@@ -169,9 +190,17 @@ private:
     void test_route_shortest_distance();
     void test_route_with_cycle();
     void test_trim_ways();
+    void test_prepare_routing();
+    void test_route_many();
+    void test_closest_many();
+    void test_route_distance_matrix();
+    void test_list_page();
 
     void add_random_places_areas(unsigned int size, Coord min = {1,1}, Coord max = {10000, 10000});
     void add_random_ways(unsigned int n);
+    std::vector<Coord> parse_coords(std::string const& coordsstr);
+    // Prints the size, time and queries per second of one batch query
+    void print_batch_throughput(std::ostream& output, std::size_t count, std::string const& what, Stopwatch& stopwatch);
     std::string print_place(PlaceID id, std::ostream& output, bool nl = true);
     std::string print_place_name(PlaceID id, std::ostream& output, bool nl = true);
     std::string print_area(AreaID id, std::ostream& output, bool nl = true);
@@ -206,12 +235,7 @@ private:
 template <typename Type>
 Type MainProgram::random(Type start, Type end)
 {
-    auto range = end-start;
-    assert(range != 0 && "random() with zero range!");
-
-    auto num = std::uniform_int_distribution<unsigned long int>(0, range-1)(rand_engine_);
-
-    return static_cast<Type>(start+num);
+    return random_data_.random(start, end);
 }
 
 template <typename To>
@@ -271,6 +295,8 @@ void MainProgram::NoParPlaceListTestCmd()
 
 
 #ifdef USE_PERF_EVENT
+#include <cstring>
+
 extern "C"
 {
 #include <unistd.h>
@@ -296,23 +322,49 @@ class MainProgram::Stopwatch
 public:
     using Clock = std::chrono::high_resolution_clock;
 
-    Stopwatch(bool use_counter = false) : use_counter_(use_counter)
+    // Hardware counters that can be measured, the names are the ones accepted by perftest
+    enum class Counter { INSTRUCTIONS, CYCLES, CACHE_MISSES, BRANCH_MISSES };
+    static constexpr std::array<char const*, 4> counter_names{{"instructions", "cycles", "cache_misses", "branch_misses"}};
+
+    // Only the instructions are counted by default. Without use_counter no counters are kept at all, so building
+    // the Stopwatch of every command allocates nothing.
+    explicit Stopwatch(bool use_counter = false)
+        : Stopwatch(use_counter, default_counters())
+    {
+    }
+
+    // The counters are opened as one perf event group with the first one as the leader, so the kernel
+    // schedules them together and they all cover exactly the same instructions (ratios like IPC stay valid)
+    Stopwatch(bool use_counter, std::vector<Counter> const& counters)
+        : use_counter_(use_counter), counters_(use_counter ? counters : std::vector<Counter>())
     {
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            memset(&pe_, 0, sizeof(pe_));
-            pe_.type = PERF_TYPE_HARDWARE;
-            pe_.size = sizeof(pe_);
-            pe_.config = PERF_COUNT_HW_INSTRUCTIONS;
-            pe_.disabled = 1;
-            pe_.exclude_kernel = 1;
-            pe_.exclude_hv = 1;
-
-            fd_ = perf_event_open(&pe_, 0, -1, -1, 0);
-            if (fd_ == -1) {
-                throw "Couldn't open perf events!";
+            assert(!counters_.empty() && "Stopwatch needs at least one counter");
+            for (auto counter : counters_)
+            {
+                struct perf_event_attr pe;
+                memset(&pe, 0, sizeof(pe));
+                pe.type = PERF_TYPE_HARDWARE;
+                pe.size = sizeof(pe);
+                pe.config = perf_config(counter);
+                pe.disabled = fds_.empty() ? 1 : 0; // The other counters follow the leader
+                pe.exclude_kernel = 1;
+                pe.exclude_hv = 1;
+                pe.read_format = PERF_FORMAT_GROUP;
+
+                int fd = perf_event_open(&pe, 0, -1, fds_.empty() ? -1 : fds_.front(), 0);
+                if (fd == -1) {
+                    close_counters();
+                    throw "Couldn't open perf events!";
+                }
+                fds_.push_back(fd);
             }
+            startcounts_.assign(counters_.size(), 0);
+            counts_.assign(counters_.size(), 0);
+            readcounts_.assign(counters_.size(), 0);
+            readbuffer_.assign(counters_.size() + 1, 0);
         }
 #endif
         reset();
@@ -323,11 +375,13 @@ public:
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            close(fd_);
+            close_counters();
         }
 #endif
     }
 
+    std::vector<Counter> const& counters() const { return counters_; }
+
     void start()
     {
         running_ = true;
@@ -335,9 +389,11 @@ public:
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
-            read(fd_, &startcount_, sizeof(startcount_));
-            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+            ioctl(fds_.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            if (read_counters(startcounts_))
+            {
+                ioctl(fds_.front(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
         }
 #endif
     }
@@ -348,9 +404,14 @@ public:
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
-            long long c; read(fd_, &c, sizeof(c));
-            counter_ += (c - startcount_);
+            ioctl(fds_.front(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            if (read_counters(readcounts_))
+            {
+                for (std::size_t i = 0; i < counts_.size(); ++i)
+                {
+                    counts_[i] += (readcounts_[i] - startcounts_[i]);
+                }
+            }
         }
 #endif
         elapsed_ += (Clock::now() - starttime_);
@@ -362,9 +423,9 @@ public:
 #ifdef USE_PERF_EVENT
         if (use_counter_)
         {
-            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
-            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
-            counter_ = 0;
+            ioctl(fds_.front(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            ioctl(fds_.front(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            counts_.assign(counters_.size(), 0);
         }
 #endif
         elapsed_ = elapsed_.zero();
@@ -384,39 +445,104 @@ public:
     }
 
 #ifdef USE_PERF_EVENT
+    // The value of the first counter (instructions by default)
     long long count()
+    {
+        return count(0);
+    }
+
+    // The value of counters()[index]
+    long long count(std::size_t index)
     {
         if (use_counter_)
         {
+            assert(index < counters_.size() && "No such counter in the Stopwatch!");
             if (!running_)
             {
-                return counter_;
+                return counts_[index];
             }
             else
             {
-                long long c;
-                read(fd_, &c, sizeof(c));
-                return counter_ + (c - startcount_);
+                if (!read_counters(readcounts_)) { return counts_[index]; }
+                return counts_[index] + (readcounts_[index] - startcounts_[index]);
             }
         }
+        else if (counters_failed_)
+        {
+            return 0; // Disabled after a failed read, which has already been reported
+        }
         else
         {
             assert(!"perf_event not enabled during StopWatch creation!");
+            return 0;
         }
     }
 #endif
 
 private:
+    static std::vector<Counter> const& default_counters()
+    {
+        static std::vector<Counter> const counters{Counter::INSTRUCTIONS};
+        return counters;
+    }
+
     std::chrono::time_point<Clock> starttime_;
     Clock::duration elapsed_ = Clock::duration::zero();
     bool running_ = false;
 
     bool use_counter_;
+    std::vector<Counter> counters_;
 #ifdef USE_PERF_EVENT
-    struct perf_event_attr pe_;
-    long long startcount_ = 0;
-    long long counter_ = 0;
-    int fd_ = 0;
+    std::vector<int> fds_; // fds_.front() is the group leader
+    std::vector<long long> startcounts_;
+    std::vector<long long> counts_;
+    // Sized when the counters are opened, so that start(), stop() and count() allocate nothing
+    // (perftest counts the allocations made between them)
+    std::vector<long long> readcounts_;
+    std::vector<unsigned long long> readbuffer_;
+    bool counters_failed_ = false;
+
+    static unsigned long long perf_config(Counter counter)
+    {
+        switch (counter)
+        {
+        case Counter::INSTRUCTIONS: return PERF_COUNT_HW_INSTRUCTIONS;
+        case Counter::CYCLES: return PERF_COUNT_HW_CPU_CYCLES;
+        case Counter::CACHE_MISSES: return PERF_COUNT_HW_CACHE_MISSES; // Usually the last level cache
+        case Counter::BRANCH_MISSES: return PERF_COUNT_HW_BRANCH_MISSES;
+        }
+        return PERF_COUNT_HW_INSTRUCTIONS;
+    }
+
+    // A group read gives the number of counters followed by their values, in the order they were opened.
+    // A short or failed read closes the counters like a failed open does, instead of giving zeros as counts.
+    bool read_counters(std::vector<long long>& values)
+    {
+        auto size = static_cast<ssize_t>(readbuffer_.size() * sizeof(readbuffer_[0]));
+        if (read(fds_.front(), readbuffer_.data(), size) != size)
+        {
+            std::cerr << "Couldn't read perf events, counters disabled!" << std::endl;
+            close_counters();
+            use_counter_ = false;
+            counters_failed_ = true;
+            counts_.assign(counters_.size(), 0);
+            return false;
+        }
+        for (std::size_t i = 0; i < values.size(); ++i)
+        {
+            values[i] = static_cast<long long>(readbuffer_[i + 1]);
+        }
+        return true;
+    }
+
+    void close_counters()
+    {
+        for (auto fd : fds_)
+        {
+            close(fd);
+        }
+        fds_.clear();
+    }
 #endif
 };
 
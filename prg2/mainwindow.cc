@@ -21,6 +21,9 @@
 #include <QPen>
 #include <QGraphicsItem>
 #include <QVariant>
+#include <QPainterPath>
+#include <QScrollBar>
+#include <QResizeEvent>
 
 #include <string>
 using std::string;
@@ -37,6 +40,8 @@ using std::ostringstream;
 #include <tuple>
 
 #include <cassert>
+#include <cmath>
+#include <limits>
 
 #include "mainwindow.hh"
 #include "ui_mainwindow.h"
@@ -100,10 +105,18 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(gscene_, &QGraphicsScene::selectionChanged, this, &MainWindow::scene_selection_change);
 //    connect(this, &MainProgram::signal_clear_selection, this, &MainProgram::clear_selection);
 
+    // Only the visible part of the map is in the scene, so scrolling and zooming build the newly visible part
+    view_timer_ = new QTimer(this);
+    view_timer_->setSingleShot(true);
+    view_timer_->setInterval(50);
+    connect(view_timer_, &QTimer::timeout, this, &MainWindow::update_view);
+    connect(ui->graphics_view->horizontalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::view_moved);
+    connect(ui->graphics_view->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::view_moved);
+
     // Zoom slider changes graphics view scale
-    connect(ui->zoom_plus, &QToolButton::clicked, [this]{ this->ui->graphics_view->scale(1.1, 1.1); });
-    connect(ui->zoom_minus, &QToolButton::clicked, [this]{ this->ui->graphics_view->scale(1/1.1, 1/1.1); });
-    connect(ui->zoom_1, &QToolButton::clicked, [this]{ this->ui->graphics_view->resetTransform(); });
+    connect(ui->zoom_plus, &QToolButton::clicked, [this]{ this->ui->graphics_view->scale(1.1, 1.1); this->view_moved(); });
+    connect(ui->zoom_minus, &QToolButton::clicked, [this]{ this->ui->graphics_view->scale(1/1.1, 1/1.1); this->view_moved(); });
+    connect(ui->zoom_1, &QToolButton::clicked, [this]{ this->ui->graphics_view->resetTransform(); this->view_moved(); });
     connect(ui->zoom_fit, &QToolButton::clicked, this, &MainWindow::fit_view);
 
     // Changing checkboxes updates view
@@ -126,9 +139,9 @@ MainWindow::MainWindow(QWidget *parent) :
 //    connect(ui->regions_checkbox, &QCheckBox::clicked,
 //            [this]{ this->ui->regionnames_checkbox->setEnabled(this->ui->regions_checkbox->isChecked()); });
 
-    // Changing font or points scale updates view
-    connect(ui->fontscale, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), this, &MainWindow::update_view);
-    connect(ui->pointscale, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), this, &MainWindow::update_view);
+    // Changing font or points scale redraws everything, the scales are not part of the states of the items
+    connect(ui->fontscale, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), this, &MainWindow::redraw_view);
+    connect(ui->pointscale, static_cast<void(QDoubleSpinBox::*)(double)>(&QDoubleSpinBox::valueChanged), this, &MainWindow::redraw_view);
 
     // Clear input button
     connect(ui->clear_input_button, &QPushButton::clicked, this, &MainWindow::clear_input_line);
@@ -144,16 +157,38 @@ MainWindow::~MainWindow()
     delete ui;
 }
 
+// Appends a coordinate to the state of scene items
+static void append_state(std::string& state, Coord xy)
+{
+    state += std::to_string(xy.x);
+    state += ',';
+    state += std::to_string(xy.y);
+    state += ' ';
+}
+
 void MainWindow::update_view()
 {
 //    ui->output->appendPlainText("Update view:");
 
-    gscene_->clear();
+    // Only the objects within the visible part of the map are drawn. The items of an object are kept from one update to
+    // the next as long as it stays in view and its state (what it was drawn from) does not change, so a command that
+    // changes a few objects only rebuilds their items.
+    ++view_generation_;
     auto pointscale = ui->pointscale->value();
     auto fontscale = ui->fontscale->value();
     bool errors = false;
     std::ostringstream errorout;
 
+    // Marks the items as drawn by this update. Returns true if they have to be (re)built, after removing the old ones.
+    auto refresh = [this](SceneItems& entry, std::string&& state)
+    {
+        entry.generation = view_generation_;
+        if (!entry.items.empty() && entry.state == state) { return false; }
+        remove_items(entry);
+        entry.state = std::move(state);
+        return true;
+    };
+
     std::unordered_map<PlaceID, std::string> result_places;
     MainProgram::CmdResultRoute result_route;
     if (mainprg_.prev_result.first == MainProgram::ResultType::PLACEIDLIST)
@@ -169,15 +204,66 @@ void MainWindow::update_view()
         result_route = std::get<MainProgram::CmdResultRoute>(mainprg_.prev_result.second);
     }
 
-
-    if (ui->places_checkbox->isChecked())
+    // The areas have no spatial index, but there are few of them. Their coordinates are needed for the scene rect too.
+    std::vector<std::pair<AreaID, std::vector<Coord>>> areas;
+    if (ui->areas_checkbox->isChecked())
     {
-        auto places = mainprg_.ds_.all_places();
-        if (!errors && places.size() == 1 && places.front() == NO_PLACE)
+        auto areaids = mainprg_.ds_.all_areas();
+        if (!errors && areaids.size() == 1 && areaids.front() == NO_AREA)
         {
-            errorout << "Error from GUI: all_places() returned error {NO_PLACE}" << std::endl;
+            errorout << "GUI error: all_regions() returned error {NO_REGION}" << std::endl;
             errors = true;
         }
+        for (auto areaid : areaids)
+        {
+            if (areaid != NO_AREA) { areas.emplace_back(areaid, mainprg_.ds_.get_area_coords(areaid)); }
+        }
+    }
+
+    // The scene rect covers the whole map even though only the visible part has items, so that the scroll bars
+    // reach all of it
+    auto [map_lower_left, map_upper_right] = mainprg_.ds_.map_bounds();
+    for (auto& area : areas)
+    {
+        for (auto& coord : area.second)
+        {
+            if (coord == NO_COORD) { continue; }
+            if (map_lower_left == NO_COORD) { map_lower_left = coord; map_upper_right = coord; }
+            map_lower_left = {std::min(map_lower_left.x, coord.x), std::min(map_lower_left.y, coord.y)};
+            map_upper_right = {std::max(map_upper_right.x, coord.x), std::max(map_upper_right.y, coord.y)};
+        }
+    }
+    if (map_lower_left != NO_COORD)
+    {
+        QRectF maprect(QPointF(20.0*map_lower_left.x, -20.0*map_upper_right.y), QPointF(20.0*map_upper_right.x, -20.0*map_lower_left.y));
+        gscene_->setSceneRect(maprect.adjusted(-100-maprect.width()/20, -100-maprect.height()/20, 100+maprect.width()/20, 100+maprect.height()/20));
+    }
+    else
+    {
+        gscene_->setSceneRect(QRectF());
+    }
+
+    // Build the items for the visible part and half a view around it, so that small scrolls need no update
+    Coord lower_left = NO_COORD;
+    Coord upper_right = NO_COORD;
+    std::tie(lower_left, upper_right) = visible_map_rect();
+    long long margin_x = (static_cast<long long>(upper_right.x) - lower_left.x)/2 + 1;
+    long long margin_y = (static_cast<long long>(upper_right.y) - lower_left.y)/2 + 1;
+    auto clamped = [](long long value)
+    {
+        return static_cast<int>(std::min<long long>(std::max<long long>(value, std::numeric_limits<int>::min()+1), std::numeric_limits<int>::max()));
+    };
+    lower_left = {clamped(lower_left.x - margin_x), clamped(lower_left.y - margin_y)};
+    upper_right = {clamped(upper_right.x + margin_x), clamped(upper_right.y + margin_y)};
+    built_lower_left_ = lower_left;
+    built_upper_right_ = upper_right;
+    built_detail_level_ = detail_level();
+    view_timer_->stop(); // Setting the scene rect may have moved the view
+    long long simplify_step = built_detail_level_ == 0 ? 0 : 1LL << built_detail_level_;
+
+    if (ui->places_checkbox->isChecked())
+    {
+        auto places = mainprg_.ds_.places_in_rect(lower_left, upper_right);
 
         for (auto placeid : places)
         {
@@ -205,7 +291,8 @@ void MainWindow::update_view()
                 errors = true;
             }
 
-            if (x == NO_VALUE || y == NO_VALUE)
+            bool invalid = (x == NO_VALUE || y == NO_VALUE);
+            if (invalid)
             {
                 x = 0; y = 0;
                 placecolor = Qt::magenta;
@@ -215,7 +302,8 @@ void MainWindow::update_view()
 
             string prefix;
             auto res_place = result_places.find(placeid);
-            if (res_place != result_places.end())
+            bool in_result = (res_place != result_places.end());
+            if (in_result)
             {
                 if (result_places.size() > 1) { prefix = res_place->second; }
                 namecolor = Qt::red;
@@ -223,54 +311,60 @@ void MainWindow::update_view()
                 placezvalue = 2;
             }
 
-            if (ui->places_checkbox->isChecked())
+            // Draw place names
+            string label = prefix;
+            if (ui->placenames_checkbox->isChecked())
             {
-                auto groupitem = gscene_->createItemGroup({});
-                groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
-                groupitem->setData(0, QVariant::fromValue(placeid));
-
-                QPen placepen(placeborder);
-                placepen.setWidth(0); // Cosmetic pen
-                auto dotitem = gscene_->addEllipse(-4*pointscale, -4*pointscale, 8*pointscale, 8*pointscale,
-                                                   placepen, QBrush(placecolor));
-                dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
-                groupitem->addToGroup(dotitem);
-                //        dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
-                //        dotitem->setData(0, QVariant::fromValue(town));
-
-                // Draw place names
-                string label = prefix;
-                if (ui->placenames_checkbox->isChecked())
+                auto [name,type] = mainprg_.ds_.get_place_name_type(placeid);
+                if (!errors && name == NO_NAME)
                 {
-                    auto [name,type] = mainprg_.ds_.get_place_name_type(placeid);
-                    if (!errors && name == NO_NAME)
-                    {
-                        errorout << "GUI error: get_stop_name(" << placeid << ") returned error {NO_NAME}" << std::endl;
-                        errors = true;
-                    }
-
-                    label += name;
+                    errorout << "GUI error: get_stop_name(" << placeid << ") returned error {NO_NAME}" << std::endl;
+                    errors = true;
                 }
 
-                if (!label.empty())
-                {
-                    // Create extra item group to be able to set ItemIgnoresTransformations on the correct level (addSimpleText does not allow
-                    // setting initial coordinates in item coordinates
-                    auto textgroupitem = gscene_->createItemGroup({});
-                    auto textitem = gscene_->addSimpleText(QString::fromStdString(label));
-                    auto font = textitem->font();
-                    font.setPointSizeF(font.pointSizeF()*fontscale);
-                    textitem->setFont(font);
-                    textitem->setBrush(QBrush(namecolor));
-                    textitem->setPos(-textitem->boundingRect().width()/2, -4*pointscale - textitem->boundingRect().height());
-                    textgroupitem->addToGroup(textitem);
-                    textgroupitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
-                    groupitem->addToGroup(textgroupitem);
-                }
+                label += name;
+            }
 
-                groupitem->setPos(20*x, -20*y);
-                groupitem->setZValue(placezvalue);
+            string state = label;
+            state += '\n';
+            append_state(state, {x, y});
+            state += invalid ? 'i' : '-';
+            state += in_result ? 'r' : '-';
+            auto& entry = place_items_[placeid];
+            if (!refresh(entry, std::move(state))) { continue; }
+
+            auto groupitem = gscene_->createItemGroup({});
+            groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
+            groupitem->setData(0, QVariant::fromValue(placeid));
+
+            QPen placepen(placeborder);
+            placepen.setWidth(0); // Cosmetic pen
+            auto dotitem = gscene_->addEllipse(-4*pointscale, -4*pointscale, 8*pointscale, 8*pointscale,
+                                               placepen, QBrush(placecolor));
+            dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+            groupitem->addToGroup(dotitem);
+            //        dotitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+            //        dotitem->setData(0, QVariant::fromValue(town));
+
+            if (!label.empty())
+            {
+                // Create extra item group to be able to set ItemIgnoresTransformations on the correct level (addSimpleText does not allow
+                // setting initial coordinates in item coordinates
+                auto textgroupitem = gscene_->createItemGroup({});
+                auto textitem = gscene_->addSimpleText(QString::fromStdString(label));
+                auto font = textitem->font();
+                font.setPointSizeF(font.pointSizeF()*fontscale);
+                textitem->setFont(font);
+                textitem->setBrush(QBrush(namecolor));
+                textitem->setPos(-textitem->boundingRect().width()/2, -4*pointscale - textitem->boundingRect().height());
+                textgroupitem->addToGroup(textitem);
+                textgroupitem->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+                groupitem->addToGroup(textgroupitem);
             }
+
+            groupitem->setPos(20*x, -20*y);
+            groupitem->setZValue(placezvalue);
+            entry.items.push_back(groupitem);
         }
     }
 
@@ -288,61 +382,72 @@ void MainWindow::update_view()
             resultareas.insert(prevresult.begin(), prevresult.end());
         }
 
-        auto areaids = mainprg_.ds_.all_areas();
-        if (!errors && areaids.size() == 1 && areaids.front() == NO_AREA)
-        {
-            errorout << "GUI error: all_regions() returned error {NO_REGION}" << std::endl;
-            errors = true;
-        }
-
-        for (auto areaid : areaids)
+        for (auto& [areaid, coords] : areas)
         {
             QColor areacolor = Qt::blue;
             int areazvalue = -3;
 
-            if (areaid != NO_AREA)
+            bool in_result = (resultareas.find(areaid) != resultareas.end());
+            if (in_result)
+            {
+                areacolor = Qt::green;
+                areazvalue = -2;
+            }
+            if (!errors && (coords.size() < 3 || std::find(coords.begin(), coords.end(), NO_COORD) != coords.end()))
             {
-                if (resultareas.find(areaid) != resultareas.end())
+                errorout << "GUI error: get_area_coords(" << areaid << ") returned error { ";
+                for (auto& coord : coords)
                 {
-                    areacolor = Qt::green;
-                    areazvalue = -2;
+                    mainprg_.print_coord(coord, errorout);
+                    errorout << " ";
                 }
-                auto coords = mainprg_.ds_.get_area_coords(areaid);
-                if (!errors && (coords.size() < 3 || std::find(coords.begin(), coords.end(), NO_COORD) != coords.end()))
+                errorout << "}" << std::endl;
+                errors = true;
+            }
+            else
+            {
+                // Areas entirely outside of the view are not drawn
+                if (coords.empty()) { continue; }
+                Coord arealow = coords.front();
+                Coord areahigh = coords.front();
+                for (auto& coord : coords)
                 {
-                    errorout << "GUI error: get_area_coords(" << areaid << ") returned error { ";
-                    for (auto& coord : coords)
-                    {
-                        mainprg_.print_coord(coord, errorout);
-                        errorout << " ";
-                    }
-                    errorout << "}" << std::endl;
-                    errors = true;
+                    arealow = {std::min(arealow.x, coord.x), std::min(arealow.y, coord.y)};
+                    areahigh = {std::max(areahigh.x, coord.x), std::max(areahigh.y, coord.y)};
                 }
-                else
+                if (areahigh.x < lower_left.x || arealow.x > upper_right.x || areahigh.y < lower_left.y || arealow.y > upper_right.y)
                 {
-                    auto pen = QPen(areacolor);
-                    pen.setWidth(0); // "Cosmetic" pen
-                    Coord prevcoord = NO_COORD;
-                    for (auto& coord : coords)
+                    continue;
+                }
+
+                string state(in_result ? "r" : "-");
+                for (auto& coord : coords) { append_state(state, coord); }
+                auto& entry = area_items_[areaid];
+                if (!refresh(entry, std::move(state))) { continue; }
+
+                auto pen = QPen(areacolor);
+                pen.setWidth(0); // "Cosmetic" pen
+                Coord prevcoord = NO_COORD;
+                for (auto& coord : coords)
+                {
+                    if (prevcoord != NO_COORD)
                     {
-                        if (prevcoord != NO_COORD)
-                        {
-                            QLineF line(QPointF(20*prevcoord.x, -20*prevcoord.y), QPointF(20*coord.x, -20*coord.y));
-                            auto lineitem = gscene_->addLine(line, pen);
-                            lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
-                            lineitem->setData(0, QVariant::fromValue(AreaIDcont{areaid}));
-                            lineitem->setZValue(areazvalue);
-                        }
-                        prevcoord = coord;
+                        QLineF line(QPointF(20*prevcoord.x, -20*prevcoord.y), QPointF(20*coord.x, -20*coord.y));
+                        auto lineitem = gscene_->addLine(line, pen);
+                        lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
+                        lineitem->setData(0, QVariant::fromValue(AreaIDcont{areaid}));
+                        lineitem->setZValue(areazvalue);
+                        entry.items.push_back(lineitem);
                     }
-                    // Close the loop
-                    QLineF line(QPointF(20*prevcoord.x, -20*prevcoord.y), QPointF(20*coords.front().x, -20*coords.front().y));
-                    auto lineitem = gscene_->addLine(line, pen);
-                    lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
-                    lineitem->setData(0, QVariant::fromValue(AreaIDcont{areaid}));
-                    lineitem->setZValue(areazvalue);
+                    prevcoord = coord;
                 }
+                // Close the loop
+                QLineF line(QPointF(20*prevcoord.x, -20*prevcoord.y), QPointF(20*coords.front().x, -20*coords.front().y));
+                auto lineitem = gscene_->addLine(line, pen);
+                lineitem->setFlag(QGraphicsItem::ItemIsSelectable);
+                lineitem->setData(0, QVariant::fromValue(AreaIDcont{areaid}));
+                lineitem->setZValue(areazvalue);
+                entry.items.push_back(lineitem);
             }
         }
     }
@@ -351,9 +456,15 @@ void MainWindow::update_view()
     if (ui->ways_checkbox->isChecked())
     {
         std::unordered_set<Coord, CoordHash> crossroads;
-        auto ways = mainprg_.ds_.all_ways();
+        auto ways = mainprg_.ds_.ways_in_rect(lower_left, upper_right);
+
+        std::unordered_set<WayID> result_ways;
+        if (mainprg_.prev_result.first == MainProgram::ResultType::ROUTE || mainprg_.prev_result.first == MainProgram::ResultType::WAYS)
+        {
+            for (auto& item : result_route) { result_ways.insert(std::get<2>(item)); }
+        }
 
-        for (auto wayid : ways)
+        for (auto& wayid : ways)
         {
             auto coords = mainprg_.ds_.get_way_coords(wayid);
 
@@ -364,14 +475,45 @@ void MainWindow::update_view()
             QColor linecolor = Qt::gray;
             int zvalue = -2;
 
-            if (mainprg_.prev_result.first == MainProgram::ResultType::ROUTE || mainprg_.prev_result.first == MainProgram::ResultType::WAYS)
+            bool in_result = (result_ways.find(wayid) != result_ways.end());
+            if (in_result)
+            {
+                linecolor = Qt::red;
+                zvalue = 10;
+            }
+
+            bool valid = std::none_of(coords.begin(), coords.end(),
+                                      [](auto& coord){ return coord.x == NO_VALUE || coord.y == NO_VALUE; });
+
+            string state(in_result ? "r" : "-");
+            state += std::to_string(valid ? simplify_step : 0);
+            state += ' ';
+            for (auto& coord : coords) { append_state(state, coord); }
+            auto& entry = way_items_[wayid];
+            if (!refresh(entry, std::move(state))) { continue; }
+
+            if (valid)
             {
-                auto res_place2 = std::find_if(result_route.begin(), result_route.end(), [wayid](auto& item){ return std::get<2>(item) == wayid; });
-                if (res_place2 != result_route.end())
+                auto pen = QPen(linecolor);
+                pen.setWidth(0); // "Cosmetic" pen
+
+                // One path item per way. At low zoom the points closer than simplify_step to the previous drawn point
+                // are left out, they would be within the same pixel anyway.
+                QPainterPath path(QPointF(20*coords.front().x, -20*coords.front().y));
+                Coord prevcoord = coords.front();
+                for (std::size_t i = 1; i < coords.size(); ++i)
                 {
-                    linecolor = Qt::red;
-                    zvalue = 10;
+                    auto& coord = coords[i];
+                    long long dx = static_cast<long long>(coord.x) - prevcoord.x;
+                    long long dy = static_cast<long long>(coord.y) - prevcoord.y;
+                    if (i + 1 < coords.size() && dx*dx + dy*dy < simplify_step*simplify_step) { continue; }
+                    path.lineTo(20*coord.x, -20*coord.y);
+                    prevcoord = coord;
                 }
+                auto pathitem = gscene_->addPath(path, pen);
+                pathitem->setZValue(zvalue);
+                entry.items.push_back(pathitem);
+                continue;
             }
 
             Coord prevcoord = NO_COORD;
@@ -393,6 +535,9 @@ void MainWindow::update_view()
                     }
                     errorout << ")" << std::endl;
                     errors = true;
+                }
+                if (x == NO_VALUE || y == NO_VALUE)
+                {
                     x = 0; y = 0;
                 }
 
@@ -415,6 +560,7 @@ void MainWindow::update_view()
                     QLineF line(QPointF(20*rx, -20*ry), QPointF(20*x, -20*y));
                     auto lineitem = gscene_->addLine(line, pen);
                     lineitem->setZValue(zvalue);
+                    entry.items.push_back(lineitem);
                 }
 
                 prevcoord = coord;
@@ -432,6 +578,7 @@ void MainWindow::update_view()
                 int dotzvalue = 1;
 
                 string label;
+                bool in_result = false;
 
                 if (mainprg_.prev_result.first == MainProgram::ResultType::ROUTE)
                 {
@@ -442,9 +589,7 @@ void MainWindow::update_view()
                         if (res_place != result_route.end())
                         {
                             if (result_route.size() > 1) { label += MainProgram::convert_to_string(res_place - result_route.begin() + 1)+". "; }
-                            labelcolor = Qt::red;
-                            dotborder = Qt::red;
-                            dotzvalue = 2;
+                            in_result = true;
                             ++res_place;
                         }
                     }
@@ -458,17 +603,27 @@ void MainWindow::update_view()
                         if (res_place != result_route.end())
                         {
                             if (result_route.size() > 1) { label += MainProgram::convert_to_string(res_place - result_route.begin() + 1)+". "; }
-                            labelcolor = Qt::red;
-                            dotborder = Qt::red;
-                            dotzvalue = 2;
+                            in_result = true;
                             ++res_place;
                         }
                     }
                 }
 
+                if (in_result)
+                {
+                    labelcolor = Qt::red;
+                    dotborder = Qt::red;
+                    dotzvalue = 2;
+                }
+
                 auto [x,y] = coord;
                 if (x != NO_VALUE && y != NO_VALUE)
                 {
+                    string state = label;
+                    state += in_result ? "\nr" : "\n-";
+                    auto& entry = crossroad_items_[coord];
+                    if (!refresh(entry, std::move(state))) { continue; }
+
                     auto groupitem = gscene_->createItemGroup({});
                     groupitem->setFlag(QGraphicsItem::ItemIsSelectable);
                     groupitem->setData(0, QVariant::fromValue(coord));
@@ -501,12 +656,33 @@ void MainWindow::update_view()
 
                     groupitem->setPos(20*x, -20*y);
                     groupitem->setZValue(dotzvalue);
-
+                    entry.items.push_back(groupitem);
                 }
             }
         }
     }
 
+    // Remove the items of the objects this update did not draw: gone, changed out of view, or of an unchecked kind
+    auto remove_undrawn = [this](auto& items)
+    {
+        for (auto entry = items.begin(); entry != items.end(); )
+        {
+            if (entry->second.generation != view_generation_)
+            {
+                remove_items(entry->second);
+                entry = items.erase(entry);
+            }
+            else
+            {
+                ++entry;
+            }
+        }
+    };
+    remove_undrawn(place_items_);
+    remove_undrawn(area_items_);
+    remove_undrawn(way_items_);
+    remove_undrawn(crossroad_items_);
+
     if (errors)
     {
         output_text(errorout);
@@ -563,6 +739,8 @@ void MainWindow::execute_line()
 
     ui->lineEdit->setFocus();
 
+    // Not all commands that change the data set view_dirty, so the view is always updated. The items of the objects
+    // that did not change are kept as they are, so this only costs the lookups of the visible objects.
 //    if (mainprg_.view_dirty)
 //    {
 //        update_view();
@@ -617,7 +795,75 @@ void MainWindow::clear_input_line()
 
 void MainWindow::fit_view()
 {
-    ui->graphics_view->fitInView(gscene_->itemsBoundingRect(), Qt::KeepAspectRatio);
+    // The scene rect covers the whole map, the items only the visible part of it
+    ui->graphics_view->fitInView(gscene_->sceneRect(), Qt::KeepAspectRatio);
+    view_moved();
+}
+
+void MainWindow::view_moved()
+{
+    // Nothing new becomes visible as long as the view stays within the part the items were built for
+    auto [lower_left, upper_right] = visible_map_rect();
+    if (built_lower_left_ != NO_COORD && detail_level() == built_detail_level_ &&
+        lower_left.x >= built_lower_left_.x && lower_left.y >= built_lower_left_.y &&
+        upper_right.x <= built_upper_right_.x && upper_right.y <= built_upper_right_.y)
+    {
+        return;
+    }
+    view_timer_->start();
+}
+
+void MainWindow::redraw_view()
+{
+    auto remove_all = [this](auto& items)
+    {
+        for (auto& entry : items) { remove_items(entry.second); }
+        items.clear();
+    };
+    remove_all(place_items_);
+    remove_all(area_items_);
+    remove_all(way_items_);
+    remove_all(crossroad_items_);
+    update_view();
+}
+
+void MainWindow::resizeEvent(QResizeEvent* event)
+{
+    QMainWindow::resizeEvent(event);
+    if (view_timer_) { view_moved(); }
+}
+
+std::pair<Coord, Coord> MainWindow::visible_map_rect() const
+{
+    // The scene has 20 units per map unit, and its y axis points down
+    QRectF visible = ui->graphics_view->mapToScene(ui->graphics_view->viewport()->rect()).boundingRect();
+    auto to_map = [](double value)
+    {
+        return static_cast<int>(std::min(std::max(value, static_cast<double>(std::numeric_limits<int>::min()+1)),
+                                         static_cast<double>(std::numeric_limits<int>::max())));
+    };
+    return {{to_map(std::floor(visible.left()/20)), to_map(std::floor(-visible.bottom()/20))},
+            {to_map(std::ceil(visible.right()/20)), to_map(std::ceil(-visible.top()/20))}};
+}
+
+int MainWindow::detail_level() const
+{
+    // The ways leave out the points closer than two pixels to the previous drawn point. The distance is rounded
+    // down to a power of two map units, so that zooming out only changes the ways each time the scale halves.
+    double pixels_per_unit = 20*ui->graphics_view->transform().m11();
+    double tolerance = pixels_per_unit > 0 ? 2/pixels_per_unit : 0;
+    if (tolerance < 2) { return 0; }
+    return std::min(std::ilogb(tolerance), 30);
+}
+
+void MainWindow::remove_items(SceneItems& entry)
+{
+    // Deleting an item also removes it from the scene and deletes its children
+    for (auto item : entry.items)
+    {
+        delete item;
+    }
+    entry.items.clear();
 }
 
 void MainWindow::scene_selection_change()
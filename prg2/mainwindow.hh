@@ -13,6 +13,11 @@
 
 #include <QMainWindow>
 #include <QGraphicsScene>
+#include <QTimer>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace Ui {
 class MainWindow;
@@ -41,6 +46,11 @@ public slots:
     void fit_view();
     void scene_selection_change();
     void clear_selection();
+    void view_moved();
+    void redraw_view();
+
+protected:
+    void resizeEvent(QResizeEvent* event) override;
 
 private:
     Ui::MainWindow *ui = nullptr;
@@ -52,6 +62,34 @@ private:
     bool stop_pressed_ = false;
 
     bool selection_clear_in_progress = false;
+
+    // Graphics items of one place, area, way or crossroad, kept from one update_view() to the next. The state
+    // tells what they were drawn from, so they are only rebuilt when it changes, and removed when the
+    // object is no longer drawn (generation is that of the last update_view() that drew it).
+    struct SceneItems
+    {
+        std::vector<QGraphicsItem*> items;
+        std::string state;
+        unsigned int generation = 0;
+    };
+
+    std::unordered_map<PlaceID, SceneItems> place_items_;
+    std::unordered_map<AreaID, SceneItems> area_items_;
+    std::unordered_map<WayID, SceneItems> way_items_;
+    std::unordered_map<Coord, SceneItems, CoordHash> crossroad_items_;
+    unsigned int view_generation_ = 0;
+
+    // The part of the map (in map coordinates) the items have been built for, and the level of detail of the ways
+    Coord built_lower_left_ = NO_COORD;
+    Coord built_upper_right_ = NO_COORD;
+    int built_detail_level_ = 0;
+
+    // Gathers the steps of scrolling and zooming into one update_view()
+    QTimer* view_timer_ = nullptr;
+
+    std::pair<Coord, Coord> visible_map_rect() const;
+    int detail_level() const;
+    void remove_items(SceneItems& entry);
 };
 
 #endif // MAINWINDOW_HH
@@ -16,6 +16,11 @@
 # NOTE 2: If you uncomment or recomment the line, remember to recompile EVERYTHING by selecting
 # "Rebuild all" from the Build menu
 
+# Uncomment the line below to count the work done inside Datastructures (hash lookups, nodes expanded by the
+# route searches, heap pushes, rehashes and rebuilds), which the stats command prints. Without it the counters
+# are not compiled in at all. Remember to recompile EVERYTHING after changing it.
+#DEFINES += DATASTRUCTURES_STATS
+
 QT       += core gui
 
 CONFIG += c++17 warn_on
@@ -38,12 +43,18 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 
 SOURCES += \
+    allocation_count.cc \
     datastructures.cc \
     mainwindow.cc \
     mainprogram.cc
 
 HEADERS += \
+    allocation_count.hh \
     datastructures.hh \
+    flat_hash_map.hh \
+    thread_pool.hh \
+    random_data.hh \
+    stats.hh \
     mainwindow.hh \
     mainprogram.hh
 
@@ -0,0 +1,162 @@
+// Random_data.hh
+
+#ifndef RANDOM_DATA_HH
+#define RANDOM_DATA_HH
+
+#include <array>
+#include <cassert>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "datastructures.hh"
+
+// Random number generator and the generation of the random places, areas and ways, shared by MainProgram
+// (random_add, random_ways and perftest) and the headless benchmark so that both measure the same kind of data.
+// The ids, names and way end coordinates come from the number of the element, scrambled with two primes
+// chosen at random by init_primes(), so the same seed always gives the same data.
+class Random_data
+{
+public:
+    explicit Random_data(unsigned int seed = 1) : engine(seed) {}
+
+    std::minstd_rand engine;
+
+    unsigned long int places_added = 0; // Counter for random places added
+    unsigned long int areas_added = 0; // Counter for random areas added
+    unsigned long int ways_added = 0; // Counter for random routes added
+
+    // In [start, end)
+    template <typename Type>
+    Type random(Type start, Type end)
+    {
+        auto range = end-start;
+        assert(range != 0 && "random() with zero range!");
+
+        auto num = std::uniform_int_distribution<unsigned long int>(0, range-1)(engine);
+
+        return static_cast<Type>(start+num);
+    }
+
+    // Chooses new primes and starts the numbering of the generated elements from the beginning
+    void init_primes()
+    {
+        prime1_ = primes1[random<int>(0, primes1.size())];
+        prime2_ = primes2[random<int>(0, primes2.size())];
+        places_added = 0;
+        areas_added = 0;
+        ways_added = 0;
+    }
+
+    Name n_to_name(unsigned long int n) const
+    {
+        unsigned long int hash = prime1_*n + prime2_;
+        Name name;
+
+        while (hash > 0)
+        {
+            auto hexnum = hash % 26;
+            hash /= 26;
+            name.push_back('a'+hexnum);
+        }
+
+        return name;
+    }
+
+    PlaceID n_to_placeid(unsigned long int n) const
+    {
+        unsigned long int hash = prime2_*n + prime1_;
+
+        return hash % static_cast<unsigned long int>(std::numeric_limits<PlaceID>::max());
+    }
+
+    AreaID n_to_areaid(unsigned long int n) const
+    {
+        return n_to_placeid(n);
+    }
+
+    WayID n_to_wayid(unsigned long int n) const
+    {
+        return "R" + std::to_string(n);
+    }
+
+    Coord n_to_coord(unsigned long int n) const
+    {
+        unsigned long int hash = prime1_ * n + prime2_;
+        hash = hash ^ (hash + 0x9e3779b9 + (hash << 6) + (hash >> 2)); // :-P
+
+        return {static_cast<int>(hash % 1000), static_cast<int>((hash/1000) % 1000)};
+    }
+
+    // Adds size places at random coordinates in [min, max), and an area for every 10 places linked into a binary tree
+    void add_places_areas(Datastructures& ds, unsigned int size, Coord min = {1,1}, Coord max = {10000, 10000})
+    {
+        std::vector<Place_record> places;
+        places.reserve(size);
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            auto name = n_to_name(places_added);
+            PlaceID id = n_to_placeid(places_added);
+            PlaceType type{random(0, static_cast<int>(PlaceType::NO_TYPE))};
+
+            int x = random<int>(min.x, max.x);
+            int y = random<int>(min.y, max.y);
+
+            places.push_back({id, std::move(name), type, {x, y}});
+
+            // Add a new area for every 10 places
+            if (places_added % 10 == 0)
+            {
+                auto areaid = n_to_areaid(areas_added);
+                std::vector<Coord> coords;
+                for (int j=0; j<3; ++j)
+                {
+                    coords.push_back({random<int>(min.x, max.x),random<int>(min.y, max.y)});
+                }
+                ds.add_area(areaid, std::to_string(areaid), std::move(coords));
+                // Add area as subarea so that we get a binary tree
+                if (areas_added > 0)
+                {
+                    auto parentid = n_to_areaid(areas_added / 2);
+                    ds.add_subarea_to_area(areaid, parentid);
+                }
+                ++areas_added;
+            }
+
+            ++places_added;
+        }
+        ds.add_places_bulk(places);
+    }
+
+    // Adds n ways, each between the end coordinates of two random earlier ways
+    void add_ways(Datastructures& ds, unsigned int n)
+    {
+        std::vector<Way_record> ways;
+        ways.reserve(n);
+        for (unsigned int i=0; i<n; ++i)
+        {
+            ++ways_added;
+
+            WayID id = n_to_wayid(ways_added);
+            Coord c1 = n_to_coord(random(decltype(ways_added)(0),ways_added));
+            Coord c2 = n_to_coord(random(decltype(ways_added)(0),ways_added));
+            if (c1.x != c2.x || c1.y != c2.y)
+            {
+                ways.push_back({std::move(id), {c1,c2}});
+            }
+        }
+        ds.add_ways_bulk(std::move(ways));
+    }
+
+private:
+    static constexpr std::array<unsigned long int, 20> primes1{4943,   4951,   4957,   4967,   4969,   4973,   4987,   4993,   4999,   5003,
+                                                               5009,   5011,   5021,   5023,   5039,   5051,   5059,   5077,   5081,   5087};
+    static constexpr std::array<unsigned long int, 20> primes2{81031,  81041,  81043,  81047,  81049,  81071,  81077,  81083,  81097,  81101,
+                                                               81119,  81131,  81157,  81163,  81173,  81181,  81197,  81199,  81203,  81223};
+    unsigned long int prime1_ = 0; // Will be initialized to random value from above
+    unsigned long int prime2_ = 0; // Will be initialized to random value from above
+};
+
+#endif // RANDOM_DATA_HH
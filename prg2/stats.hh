@@ -0,0 +1,85 @@
+// Stats.hh
+
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Counters of the work done inside the data structures: hash lookups and the slots they probed, rehashes,
+// route queries with the nodes they expanded and heap pushes, and full rebuilds of the sorted place vectors
+// and the route graph. They tell whether a slow query did a lot of work or stalled on memory.
+// The counters are only compiled in when DATASTRUCTURES_STATS is defined. Otherwise stats_add() is an empty
+// inline function and Stats_tally an empty class, so the instrumented code is exactly the same as without them.
+// The counters are process-wide relaxed atomics shared by all the threads, each on its own cache line.
+enum class Stat { HASH_LOOKUPS, HASH_PROBES, HASH_REHASHES, ROUTE_QUERIES, NODES_EXPANDED, HEAP_PUSHES,
+                  ALPHABETICAL_REBUILDS, COORDINATE_REBUILDS, ROUTE_GRAPH_REBUILDS, STAT_COUNT };
+
+constexpr std::array<char const*, static_cast<std::size_t>(Stat::STAT_COUNT)> STAT_NAMES{{
+    "hash_lookups", "hash_probes", "hash_rehashes", "route_queries", "nodes_expanded", "heap_pushes",
+    "alphabetical_rebuilds", "coordinate_rebuilds", "route_graph_rebuilds"}};
+
+#ifdef DATASTRUCTURES_STATS
+
+constexpr bool STATS_ENABLED = true;
+
+struct alignas(64) Stat_counter {
+    std::atomic<std::uint64_t> value{0};
+};
+
+inline std::array<Stat_counter, static_cast<std::size_t>(Stat::STAT_COUNT)> stat_counters;
+
+inline void stats_add(Stat stat, std::uint64_t amount = 1)
+{
+    stat_counters[static_cast<std::size_t>(stat)].value.fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline std::uint64_t stats_value(Stat stat)
+{
+    return stat_counters[static_cast<std::size_t>(stat)].value.load(std::memory_order_relaxed);
+}
+
+inline void stats_reset()
+{
+    for (auto& counter : stat_counters) {
+        counter.value.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Counts in a local variable and adds the total to the counter when it goes out of scope,
+// used in the inner loops so that they do not touch the shared counter on every step
+class Stats_tally
+{
+public:
+    explicit Stats_tally(Stat stat): stat_(stat) {}
+    ~Stats_tally() { stats_add(stat_, count_); }
+    Stats_tally(Stats_tally const&) = delete;
+    Stats_tally& operator=(Stats_tally const&) = delete;
+
+    void add(std::uint64_t amount = 1) { count_ += amount; }
+
+private:
+    Stat stat_;
+    std::uint64_t count_ = 0;
+};
+
+#else
+
+constexpr bool STATS_ENABLED = false;
+
+inline void stats_add(Stat, std::uint64_t = 1) {}
+inline std::uint64_t stats_value(Stat) { return 0; }
+inline void stats_reset() {}
+
+class Stats_tally
+{
+public:
+    explicit Stats_tally(Stat) {}
+    void add(std::uint64_t = 1) {}
+};
+
+#endif // DATASTRUCTURES_STATS
+
+#endif // STATS_HH
@@ -0,0 +1,164 @@
+// Thread_pool.hh
+
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// Fixed set of worker threads that run the independent tasks of one batch at a time, used by the batch queries.
+// The task indices of a batch are split into one contiguous range per thread (the calling thread included).
+// Each thread takes small chunks from the front of its own range, and when its range is empty it steals
+// chunks from the ranges of the others, so a thread that got the slow tasks does not hold up the batch.
+// Taking a chunk is a single atomic fetch_add, the mutex is only used to start and finish a batch.
+// The workers are only started by the first batch that needs them, so a pool that never runs a batch of several
+// tasks costs no threads. They stay alive between the batches, so their thread-local state is reused.
+class Thread_pool
+{
+public:
+    // thread_count includes the calling thread, 0 means one per hardware thread
+    explicit Thread_pool(unsigned int thread_count = 0) { resize(thread_count); }
+    ~Thread_pool() { stop_workers(); }
+
+    Thread_pool(Thread_pool const&) = delete;
+    Thread_pool& operator=(Thread_pool const&) = delete;
+
+    unsigned int thread_count() const { return thread_count_; }
+
+    // Must not be called while a batch is running
+    void resize(unsigned int thread_count)
+    {
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        stop_workers();
+        thread_count_ = thread_count;
+        ranges_.reset(new Range[thread_count]);
+        stopping_ = false;
+    }
+
+    // Calls task(i) once for every i in [0, count) and returns when all of them have finished.
+    // The calls may run in any order and at the same time, and they must not throw.
+    void run(std::size_t count, std::function<void(std::size_t)> const& task)
+    {
+        std::size_t threads = thread_count();
+        if (threads == 1 || count < 2) {
+            for (std::size_t i = 0; i != count; ++i) {
+                task(i);
+            }
+            return;
+        }
+        if (workers_.empty()) {
+            start_workers();
+        }
+        // Several chunks per thread leave something to steal, but the chunks stay large enough
+        // that the atomic counters are not touched for every task
+        chunk_size_ = std::max<std::size_t>(1, count / (threads * 16));
+        for (std::size_t thread = 0; thread != threads; ++thread) {
+            ranges_[thread].next.store(count * thread / threads, std::memory_order_relaxed);
+            ranges_[thread].end = count * (thread + 1) / threads;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            task_ = &task;
+            busy_workers_ = workers_.size();
+            ++batch_;
+        }
+        start_batch_.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        batch_done_.wait(lock, [this]() { return busy_workers_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+    // Padded to a cache line so that the threads taking chunks from different ranges do not slow each other
+    struct alignas(64) Range {
+        std::atomic<std::size_t> next{0};
+        std::size_t end = 0;
+    };
+
+    std::vector<std::thread> workers_;
+    unsigned int thread_count_ = 1;
+    std::unique_ptr<Range[]> ranges_;
+    std::size_t chunk_size_ = 1;
+
+    std::mutex mutex_;
+    std::condition_variable start_batch_;
+    std::condition_variable batch_done_;
+    std::function<void(std::size_t)> const* task_ = nullptr;
+    std::size_t busy_workers_ = 0;
+    std::uint64_t batch_ = 0;
+    bool stopping_ = false;
+
+    void worker_loop(std::size_t self, std::uint64_t batches_seen)
+    {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                start_batch_.wait(lock, [this, batches_seen]() { return stopping_ || batch_ != batches_seen; });
+                if (stopping_) {
+                    return;
+                }
+                batches_seen = batch_;
+            }
+            work(self);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_workers_ == 0) {
+                batch_done_.notify_one();
+            }
+        }
+    }
+
+    // Runs the own range first and then steals from the other threads, starting from the next one
+    void work(std::size_t self)
+    {
+        std::size_t threads = thread_count();
+        for (std::size_t offset = 0; offset != threads; ++offset) {
+            Range& range = ranges_[(self + offset) % threads];
+            while (true) {
+                std::size_t begin = range.next.fetch_add(chunk_size_, std::memory_order_relaxed);
+                if (begin >= range.end) {
+                    break;
+                }
+                std::size_t end = std::min(begin + chunk_size_, range.end);
+                for (std::size_t i = begin; i != end; ++i) {
+                    (*task_)(i);
+                }
+            }
+        }
+    }
+
+    void start_workers()
+    {
+        // The new workers must not take the last batch for a new one
+        for (unsigned int worker = 1; worker != thread_count_; ++worker) {
+            workers_.emplace_back([this, worker, batches_seen = batch_]() { worker_loop(worker, batches_seen); });
+        }
+    }
+
+    void stop_workers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        start_batch_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+        workers_.clear();
+    }
+};
+
+#endif // THREAD_POOL_HH